@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CompressedGrid.h"
+
+namespace
+{
+	struct FPlane
+	{
+		uint64 Words[FCompressedGrid::BrickSize * FCompressedGrid::BrickSize * FCompressedGrid::BrickSize / 64] = {};
+
+		bool operator==(const FPlane& Other) const
+		{
+			return FMemory::Memcmp(Words, Other.Words, sizeof(Words)) == 0;
+		}
+
+		friend uint32 GetTypeHash(const FPlane& Plane)
+		{
+			return FCrc::MemCrc32(Plane.Words, sizeof(Plane.Words));
+		}
+	};
+}
+
+void FCompressedGrid::Build(const FIntVector& NodeCount, TConstArrayView<uint8> Flags)
+{
+	Reset();
+	if (NodeCount.X <= 0 || NodeCount.Y <= 0 || NodeCount.Z <= 0 || Flags.Num() != NodeCount.X * NodeCount.Y * NodeCount.Z) return;
+
+	BrickCount = FIntVector(FMath::DivideAndRoundUp(NodeCount.X, BrickSize),
+		FMath::DivideAndRoundUp(NodeCount.Y, BrickSize),
+		FMath::DivideAndRoundUp(NodeCount.Z, BrickSize));
+	BrickPlanes.SetNumUninitialized(BrickCount.X * BrickCount.Y * BrickCount.Z * PlaneCount);
+
+	//The two uniform planes first, every other plane gets added the first time it shows up
+	TMap<FPlane, uint32> PlaneIndices;
+	FPlane Uniform;
+	PlaneIndices.Add(Uniform, 0);
+	Words.Append(Uniform.Words, WordsPerPlane);
+	FMemory::Memset(Uniform.Words, 0xFF, sizeof(Uniform.Words));
+	PlaneIndices.Add(Uniform, 1);
+	Words.Append(Uniform.Words, WordsPerPlane);
+
+	for (int32 BrickX = 0; BrickX < BrickCount.X; BrickX++)
+	{
+		for (int32 BrickY = 0; BrickY < BrickCount.Y; BrickY++)
+		{
+			for (int32 BrickZ = 0; BrickZ < BrickCount.Z; BrickZ++)
+			{
+				//Nodes past the end of the grid are blocked without connections
+				FPlane Planes[PlaneCount];
+				for (int32 x = 0; x < BrickSize; x++)
+				{
+					for (int32 y = 0; y < BrickSize; y++)
+					{
+						for (int32 z = 0; z < BrickSize; z++)
+						{
+							const FIntVector Node(BrickX * BrickSize + x, BrickY * BrickSize + y, BrickZ * BrickSize + z);
+							const bool Inside = Node.X < NodeCount.X && Node.Y < NodeCount.Y && Node.Z < NodeCount.Z;
+							const uint8 NodeFlags = Inside ? Flags[(Node.X * NodeCount.Y + Node.Y) * NodeCount.Z + Node.Z] : BlockedBit;
+
+							const int32 Local = (x * BrickSize + y) * BrickSize + z;
+							for (int32 Plane = 0; Plane < PlaneCount; Plane++)
+							{
+								const uint8 Bit = Plane < 6 ? uint8(1 << Plane) : BlockedBit;
+								if (NodeFlags & Bit) Planes[Plane].Words[Local >> 6] |= uint64(1) << (Local & 63);
+							}
+						}
+					}
+				}
+
+				const int32 Brick = (BrickX * BrickCount.Y + BrickY) * BrickCount.Z + BrickZ;
+				for (int32 Plane = 0; Plane < PlaneCount; Plane++)
+				{
+					if (const uint32* Existing = PlaneIndices.Find(Planes[Plane]))
+					{
+						BrickPlanes[Brick * PlaneCount + Plane] = *Existing;
+						continue;
+					}
+
+					const uint32 PlaneIndex = uint32(Words.Num() / WordsPerPlane);
+					PlaneIndices.Add(Planes[Plane], PlaneIndex);
+					Words.Append(Planes[Plane].Words, WordsPerPlane);
+					BrickPlanes[Brick * PlaneCount + Plane] = PlaneIndex;
+				}
+			}
+		}
+	}
+	Words.Shrink();
+}
+
+void FCompressedGrid::Reset()
+{
+	BrickCount = FIntVector::ZeroValue;
+	BrickPlanes.Empty();
+	Words.Empty();
+}
@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Blocked states and connections of a grid as bit-planes in bricks of 8^3 nodes.
+ * Every brick has 7 planes (connection to +x, -x, +y, -y, +z, -z and blocked) of 512 bits each. Identical planes are
+ * stored once and every brick only keeps the index of its planes, so the long runs of free air (and solid geometry)
+ * cost 28 bytes per brick. Lookups stay constant time: brick index, plane index, one bit.
+ */
+class NAVIGATIONGRID_API FCompressedGrid
+{
+public:
+	static constexpr int32 BrickSize = 8;
+	static constexpr uint8 BlockedBit = 1 << 7;
+
+	//Flags in x, y, z order ((x * yNodes + y) * zNodes + z), bits 0 to 5 are the connections in the order of
+	//GetNeighbors and bit 7 is blocked, like AHeightNavigationVolume::GetNodeFlags
+	void Build(const FIntVector& NodeCount, TConstArrayView<uint8> Flags);
+	void Reset();
+
+	bool IsBuilt() const { return !BrickPlanes.IsEmpty(); }
+
+	FORCEINLINE bool IsBlocked(int32 X, int32 Y, int32 Z) const
+	{
+		return GetBit(X, Y, Z, PlaneCount - 1);
+	}
+
+	//Connections in the order of GetNeighbors, one bit per direction
+	FORCEINLINE uint8 GetConnections(int32 X, int32 Y, int32 Z) const
+	{
+		const int32 Brick = GetBrickIndex(X, Y, Z);
+		const int32 Local = GetLocalIndex(X, Y, Z);
+		const uint32* Planes = &BrickPlanes[Brick * PlaneCount];
+		uint8 Connections = 0;
+		for (int32 Plane = 0; Plane < 6; Plane++)
+		{
+			Connections |= uint8((Words[Planes[Plane] * WordsPerPlane + (Local >> 6)] >> (Local & 63)) & 1) << Plane;
+		}
+		return Connections;
+	}
+
+	int64 GetAllocatedSize() const { return BrickPlanes.GetAllocatedSize() + Words.GetAllocatedSize(); }
+	int32 GetUniquePlaneCount() const { return Words.Num() / WordsPerPlane; }
+
+private:
+	static constexpr int32 PlaneCount = 7;
+	static constexpr int32 WordsPerPlane = BrickSize * BrickSize * BrickSize / 64;
+
+	FORCEINLINE int32 GetBrickIndex(int32 X, int32 Y, int32 Z) const
+	{
+		return ((X / BrickSize) * BrickCount.Y + Y / BrickSize) * BrickCount.Z + Z / BrickSize;
+	}
+
+	FORCEINLINE static int32 GetLocalIndex(int32 X, int32 Y, int32 Z)
+	{
+		return ((X % BrickSize) * BrickSize + Y % BrickSize) * BrickSize + Z % BrickSize;
+	}
+
+	FORCEINLINE bool GetBit(int32 X, int32 Y, int32 Z, int32 Plane) const
+	{
+		const int32 Local = GetLocalIndex(X, Y, Z);
+		const uint32 PlaneIndex = BrickPlanes[GetBrickIndex(X, Y, Z) * PlaneCount + Plane];
+		return (Words[PlaneIndex * WordsPerPlane + (Local >> 6)] >> (Local & 63)) & 1;
+	}
+
+	FIntVector BrickCount = FIntVector::ZeroValue;
+	//PlaneCount plane indices per brick
+	TArray<uint32> BrickPlanes;
+	//WordsPerPlane words per unique plane, plane 0 is all zeros and plane 1 all ones
+	TArray<uint64> Words;
+};
@@ -0,0 +1,595 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GridVoxelizer.h"
+
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/OverlapResult.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "HeightNavigationVolume.h"
+#include "Interfaces/Interface_CollisionDataProvider.h"
+#include "PhysicsEngine/BodySetup.h"
+
+namespace
+{
+	//Akenine-Möller, triangle against an axis aligned box
+	bool TriangleOverlapsBox(const FVector& Center, double Extent, const FVector& A, const FVector& B, const FVector& C)
+	{
+		const FVector V[3] = { A - Center, B - Center, C - Center };
+		const FVector Edges[3] = { V[1] - V[0], V[2] - V[1], V[0] - V[2] };
+
+		//Box faces
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			if (FMath::Min3(V[0][Axis], V[1][Axis], V[2][Axis]) > Extent) return false;
+			if (FMath::Max3(V[0][Axis], V[1][Axis], V[2][Axis]) < -Extent) return false;
+		}
+
+		//Triangle plane
+		const FVector Normal = FVector::CrossProduct(Edges[0], Edges[1]);
+		const double Radius = Extent * (FMath::Abs(Normal.X) + FMath::Abs(Normal.Y) + FMath::Abs(Normal.Z));
+		if (FMath::Abs(FVector::DotProduct(Normal, V[0])) > Radius) return false;
+
+		//Edge cross box axis
+		for (const FVector& Edge : Edges)
+		{
+			for (int Axis = 0; Axis < 3; Axis++)
+			{
+				FVector Unit = FVector::ZeroVector;
+				Unit[Axis] = 1;
+				const FVector L = FVector::CrossProduct(Unit, Edge);
+				const double P0 = FVector::DotProduct(L, V[0]);
+				const double P1 = FVector::DotProduct(L, V[1]);
+				const double P2 = FVector::DotProduct(L, V[2]);
+				const double R = Extent * (FMath::Abs(L.X) + FMath::Abs(L.Y) + FMath::Abs(L.Z));
+				if (FMath::Min3(P0, P1, P2) > R || FMath::Max3(P0, P1, P2) < -R) return false;
+			}
+		}
+		return true;
+	}
+
+	//Separating axis test of an oriented box against an axis aligned one, 15 axes
+	bool OrientedBoxOverlapsBox(const FVector& Center, double Extent, const FVector& BoxCenter, const FVector BoxAxes[3], const FVector& BoxExtent)
+	{
+		const FVector T = BoxCenter - Center;
+		auto Separated = [&](const FVector& L)
+		{
+			if (L.SizeSquared() < UE_SMALL_NUMBER) return false;
+			const double Ra = Extent * (FMath::Abs(L.X) + FMath::Abs(L.Y) + FMath::Abs(L.Z));
+			const double Rb = BoxExtent.X * FMath::Abs(FVector::DotProduct(L, BoxAxes[0]))
+				+ BoxExtent.Y * FMath::Abs(FVector::DotProduct(L, BoxAxes[1]))
+				+ BoxExtent.Z * FMath::Abs(FVector::DotProduct(L, BoxAxes[2]));
+			return FMath::Abs(FVector::DotProduct(T, L)) > Ra + Rb;
+		};
+
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			FVector Unit = FVector::ZeroVector;
+			Unit[Axis] = 1;
+			if (Separated(Unit) || Separated(BoxAxes[Axis])) return false;
+			for (int Other = 0; Other < 3; Other++)
+			{
+				if (Separated(FVector::CrossProduct(Unit, BoxAxes[Other]))) return false;
+			}
+		}
+		return true;
+	}
+
+	double DistanceSquaredToBox(const FVector& Center, double Extent, const FVector& Point)
+	{
+		const FVector Delta = (Point - Center).GetAbs() - FVector(Extent);
+		return Delta.ComponentMax(FVector::ZeroVector).SizeSquared();
+	}
+}
+
+void FGridVoxelizer::Voxelize(AHeightNavigationVolume& Volume, float NodeExtent, TArray<uint8>& Occupancy)
+{
+	const FVector GridSize = Volume.GetGridSize();
+	Voxelize(Volume, FIntVector(GridSize.X, GridSize.Y, GridSize.Z), NodeExtent, Occupancy);
+}
+
+void FGridVoxelizer::Voxelize(AHeightNavigationVolume& Volume, const FIntVector& InNodeCount, float NodeExtent, TArray<uint8>& Occupancy)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	NodeCount = InNodeCount;
+	Occupancy.Init(0, NodeCount.X * NodeCount.Y * NodeCount.Z);
+	if (Occupancy.IsEmpty()) return;
+
+	NodeSpacing = Volume.distanceBetweenNodes;
+	CellExtent = NodeExtent / NodeSpacing;
+	GridOrigin = Volume.GetWorldPositionFromGridPosition(FVector::ZeroVector);
+	GridAxes[0] = Volume.GetActorForwardVector();
+	GridAxes[1] = Volume.GetActorRightVector();
+	GridAxes[2] = Volume.GetActorUpVector();
+	GridRotation = Volume.GetActorQuat();
+	ChunkCount = FIntVector::DivideAndRoundUp(NodeCount, ChunkSize);
+	ChunkShapes.SetNum(ChunkCount.X * ChunkCount.Y * ChunkCount.Z);
+
+	//One query for the whole volume, with the same object types the per node queries used
+	const FVector Extents = Volume.GetExtents() + FVector(NodeExtent);
+	FCollisionQueryParams QueryParams(FName(TEXT("Voxelize")), false, &Volume);
+	FCollisionObjectQueryParams ObjectParams;
+	ObjectParams.AddObjectTypesToQuery(ECC_WorldStatic);
+	ObjectParams.AddObjectTypesToQuery(ECC_WorldDynamic);
+	TArray<FOverlapResult> Overlaps;
+	Volume.GetWorld()->OverlapMultiByObjectType(Overlaps, Volume.GetActorLocation(), Volume.GetActorQuat(), ObjectParams, FCollisionShape::MakeBox(Extents), QueryParams);
+
+	//Instanced meshes show up once per overlapping instance
+	TSet<TPair<const UPrimitiveComponent*, int32>> Collected;
+	for (const FOverlapResult& Overlap : Overlaps)
+	{
+		UPrimitiveComponent* Component = Overlap.GetComponent();
+		if (!Component) continue;
+		if (Collected.Contains({ Component, Overlap.ItemIndex })) continue;
+		Collected.Add({ Component, Overlap.ItemIndex });
+
+		FTransform Transform = Component->GetComponentTransform();
+		if (const UInstancedStaticMeshComponent* Instanced = Cast<UInstancedStaticMeshComponent>(Component))
+		{
+			if (Overlap.ItemIndex != INDEX_NONE) Instanced->GetInstanceTransform(Overlap.ItemIndex, Transform, true);
+		}
+		CollectComponent(Volume, Component, Transform);
+	}
+
+	ParallelFor(ChunkShapes.Num(), [this, &Occupancy](int32 ChunkIndex)
+	{
+		VoxelizeChunk(ChunkIndex, Occupancy);
+	});
+
+	//Overlap queries stay on the game thread
+	const FCollisionShape NodeShape = FCollisionShape::MakeBox(FVector(NodeExtent));
+	const FQuat Rotation = Volume.GetActorQuat();
+	int64 FallbackQueries = 0;
+	for (const TPair<UPrimitiveComponent*, FBox>& Fallback : FallbackComponents)
+	{
+		const FIntVector Min(FMath::Max(0, FMath::FloorToInt(Fallback.Value.Min.X)), FMath::Max(0, FMath::FloorToInt(Fallback.Value.Min.Y)), FMath::Max(0, FMath::FloorToInt(Fallback.Value.Min.Z)));
+		const FIntVector Max(FMath::Min(NodeCount.X - 1, FMath::CeilToInt(Fallback.Value.Max.X)), FMath::Min(NodeCount.Y - 1, FMath::CeilToInt(Fallback.Value.Max.Y)), FMath::Min(NodeCount.Z - 1, FMath::CeilToInt(Fallback.Value.Max.Z)));
+		for (int x = Min.X; x <= Max.X; x++)
+		{
+			for (int y = Min.Y; y <= Max.Y; y++)
+			{
+				for (int z = Min.Z; z <= Max.Z; z++)
+				{
+					uint8& Blocked = Occupancy[(x * NodeCount.Y + y) * NodeCount.Z + z];
+					if (Blocked) continue;
+					FallbackQueries++;
+					Blocked = Fallback.Key->OverlapComponent(Volume.GetWorldPositionFromGridPosition(FVector(x, y, z)), Rotation, NodeShape);
+				}
+			}
+		}
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("%s - Voxelized %d components (%d boxes, %d spheres, %d capsules, %d convexes, %d triangles) in %.2f ms, %lld overlap queries for %d components without collision data"),
+		*Volume.GetName(), Collected.Num(), Boxes.Num(), Spheres.Num(), Capsules.Num(), Convexes.Num(), Triangles.Num() / 3,
+		(FPlatformTime::Seconds() - StartTime) * 1000.0, FallbackQueries, FallbackComponents.Num());
+}
+
+void FGridVoxelizer::CollectComponent(const AHeightNavigationVolume& Volume, UPrimitiveComponent* Component, const FTransform& Transform)
+{
+	const UBodySetup* BodySetup = Component->GetBodySetup();
+	const FBox ComponentBounds(ToGrid(Component->Bounds.Origin) - FVector(Component->Bounds.SphereRadius / NodeSpacing),
+		ToGrid(Component->Bounds.Origin) + FVector(Component->Bounds.SphereRadius / NodeSpacing));
+	if (!BodySetup)
+	{
+		FallbackComponents.Emplace(Component, ComponentBounds);
+		return;
+	}
+
+	//Overlap queries only use the triangles when they are the simple collision
+	if (BodySetup->GetCollisionTraceFlag() == CTF_UseComplexAsSimple)
+	{
+		UStaticMesh* Mesh = Cast<UStaticMesh>(BodySetup->GetOuter());
+		FTriMeshCollisionData TriangleData;
+		if (!Mesh || !Mesh->GetPhysicsTriMeshData(&TriangleData, true))
+		{
+			FallbackComponents.Emplace(Component, ComponentBounds);
+			return;
+		}
+
+		for (const FTriIndices& Indices : TriangleData.Indices)
+		{
+			const int32 Index = Triangles.Num();
+			FBox Bounds(ForceInit);
+			for (const int32 Vertex : { Indices.v0, Indices.v1, Indices.v2 })
+			{
+				Triangles.Add(ToGrid(Transform.TransformPosition(FVector(TriangleData.Vertices[Vertex]))));
+				Bounds += Triangles.Last();
+			}
+			AddShape(EShapeType::Triangle, Index, Bounds);
+		}
+		return;
+	}
+
+	const FKAggregateGeom& Geometry = BodySetup->AggGeom;
+	const FVector Scale = Transform.GetScale3D().GetAbs();
+
+	for (const FKBoxElem& Box : Geometry.BoxElems)
+	{
+		const FTransform BoxTransform = Box.GetTransform() * Transform;
+		FOrientedBox& Oriented = Boxes.AddDefaulted_GetRef();
+		Oriented.Center = ToGrid(BoxTransform.GetLocation());
+		Oriented.Extent = FVector(Box.X, Box.Y, Box.Z) * 0.5 * Scale / NodeSpacing;
+		FBox Bounds(Oriented.Center, Oriented.Center);
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			Oriented.Axes[Axis] = ToGridDirection(BoxTransform.GetUnitAxis(EAxis::Type(EAxis::X + Axis))).GetSafeNormal();
+			Bounds = Bounds.ExpandBy((Oriented.Axes[Axis] * Oriented.Extent[Axis]).GetAbs());
+		}
+		AddShape(EShapeType::Box, Boxes.Num() - 1, Bounds);
+	}
+
+	for (const FKSphereElem& Sphere : Geometry.SphereElems)
+	{
+		const double Radius = Sphere.Radius * Scale.GetMax() / NodeSpacing;
+		const FVector Center = ToGrid(Transform.TransformPosition(Sphere.Center));
+		Spheres.Add({ Center, Radius });
+		AddShape(EShapeType::Sphere, Spheres.Num() - 1, FBox(Center - FVector(Radius), Center + FVector(Radius)));
+	}
+
+	for (const FKSphylElem& Sphyl : Geometry.SphylElems)
+	{
+		const FTransform SphylTransform = Sphyl.GetTransform() * Transform;
+		const FVector HalfLength = SphylTransform.GetUnitAxis(EAxis::Z) * Sphyl.Length * 0.5 * Scale.Z;
+		const double Radius = Sphyl.Radius * FMath::Max(Scale.X, Scale.Y) / NodeSpacing;
+		const FVector A = ToGrid(SphylTransform.GetLocation() + HalfLength);
+		const FVector B = ToGrid(SphylTransform.GetLocation() - HalfLength);
+		Capsules.Add({ A, B, Radius });
+		AddShape(EShapeType::Capsule, Capsules.Num() - 1, FBox(A.ComponentMin(B) - FVector(Radius), A.ComponentMax(B) + FVector(Radius)));
+	}
+
+	for (const FKConvexElem& Convex : Geometry.ConvexElems)
+	{
+		if (Convex.VertexData.IsEmpty()) continue;
+
+		const FTransform ConvexTransform = Convex.GetTransform() * Transform;
+		TArray<FVector> Vertices;
+		Vertices.Reserve(Convex.VertexData.Num());
+		FBox Bounds(ForceInit);
+		for (const FVector& Vertex : Convex.VertexData)
+		{
+			Bounds += Vertices.Add_GetRef(ToGrid(ConvexTransform.TransformPosition(Vertex)));
+		}
+
+		//Faces as planes pointing outwards, without index data the bounds are the conservative answer
+		const FVector Centroid = Bounds.GetCenter();
+		FConvex& Shape = Convexes.AddDefaulted_GetRef();
+		Shape.FirstPlane = ConvexPlanes.Num();
+		Shape.Bounds = Bounds;
+		for (int32 i = 0; i + 2 < Convex.IndexData.Num(); i += 3)
+		{
+			const FVector& A = Vertices[Convex.IndexData[i]];
+			const FVector Normal = FVector::CrossProduct(Vertices[Convex.IndexData[i + 1]] - A, Vertices[Convex.IndexData[i + 2]] - A).GetSafeNormal();
+			if (Normal.IsZero()) continue;
+			FPlane Plane(A, Normal);
+			if (Plane.PlaneDot(Centroid) > 0) Plane = Plane.Flip();
+			ConvexPlanes.Add(Plane);
+		}
+		Shape.NumPlanes = ConvexPlanes.Num() - Shape.FirstPlane;
+		AddShape(EShapeType::Convex, Convexes.Num() - 1, Bounds);
+	}
+}
+
+void FGridVoxelizer::AddShape(EShapeType Type, int32 Index, const FBox& Bounds)
+{
+	//Node boxes reach CellExtent past the node positions
+	const FBox Reach = Bounds.ExpandBy(CellExtent);
+	const FIntVector Min(FMath::Max(0, FMath::FloorToInt(Reach.Min.X)), FMath::Max(0, FMath::FloorToInt(Reach.Min.Y)), FMath::Max(0, FMath::FloorToInt(Reach.Min.Z)));
+	const FIntVector Max(FMath::Min(NodeCount.X - 1, FMath::CeilToInt(Reach.Max.X)), FMath::Min(NodeCount.Y - 1, FMath::CeilToInt(Reach.Max.Y)), FMath::Min(NodeCount.Z - 1, FMath::CeilToInt(Reach.Max.Z)));
+	if (Min.X > Max.X || Min.Y > Max.Y || Min.Z > Max.Z) return;
+
+	const int32 ShapeIndex = Shapes.Emplace(FShapeRef{ Type, Index }, Reach);
+	for (int x = Min.X / ChunkSize; x <= Max.X / ChunkSize; x++)
+	{
+		for (int y = Min.Y / ChunkSize; y <= Max.Y / ChunkSize; y++)
+		{
+			for (int z = Min.Z / ChunkSize; z <= Max.Z / ChunkSize; z++)
+			{
+				ChunkShapes[(x * ChunkCount.Y + y) * ChunkCount.Z + z].Add(ShapeIndex);
+			}
+		}
+	}
+}
+
+void FGridVoxelizer::VoxelizeChunk(int32 ChunkIndex, TArray<uint8>& Occupancy) const
+{
+	if (ChunkShapes[ChunkIndex].IsEmpty()) return;
+
+	const FIntVector Chunk(ChunkIndex / (ChunkCount.Y * ChunkCount.Z), (ChunkIndex / ChunkCount.Z) % ChunkCount.Y, ChunkIndex % ChunkCount.Z);
+	const FIntVector ChunkMin = Chunk * ChunkSize;
+	const FIntVector ChunkMax(FMath::Min(ChunkMin.X + ChunkSize, NodeCount.X) - 1, FMath::Min(ChunkMin.Y + ChunkSize, NodeCount.Y) - 1, FMath::Min(ChunkMin.Z + ChunkSize, NodeCount.Z) - 1);
+
+	//Every chunk only writes its own nodes, so no synchronization is needed
+	for (const int32 ShapeIndex : ChunkShapes[ChunkIndex])
+	{
+		const FShapeRef& Shape = Shapes[ShapeIndex].Key;
+		const FBox& Reach = Shapes[ShapeIndex].Value;
+		const FIntVector Min(FMath::Max(ChunkMin.X, FMath::FloorToInt(Reach.Min.X)), FMath::Max(ChunkMin.Y, FMath::FloorToInt(Reach.Min.Y)), FMath::Max(ChunkMin.Z, FMath::FloorToInt(Reach.Min.Z)));
+		const FIntVector Max(FMath::Min(ChunkMax.X, FMath::CeilToInt(Reach.Max.X)), FMath::Min(ChunkMax.Y, FMath::CeilToInt(Reach.Max.Y)), FMath::Min(ChunkMax.Z, FMath::CeilToInt(Reach.Max.Z)));
+		for (int x = Min.X; x <= Max.X; x++)
+		{
+			for (int y = Min.Y; y <= Max.Y; y++)
+			{
+				for (int z = Min.Z; z <= Max.Z; z++)
+				{
+					uint8& Blocked = Occupancy[(x * NodeCount.Y + y) * NodeCount.Z + z];
+					if (!Blocked && Overlaps(Shape, FVector(x, y, z), CellExtent)) Blocked = 1;
+				}
+			}
+		}
+	}
+}
+
+bool FGridVoxelizer::Overlaps(const FShapeRef& Shape, const FVector& Center, double Extent) const
+{
+	switch (Shape.Type)
+	{
+	case EShapeType::Box:
+	{
+		const FOrientedBox& Box = Boxes[Shape.Index];
+		return OrientedBoxOverlapsBox(Center, Extent, Box.Center, Box.Axes, Box.Extent);
+	}
+	case EShapeType::Sphere:
+		return DistanceSquaredToBox(Center, Extent, Spheres[Shape.Index].Center) <= FMath::Square(Spheres[Shape.Index].Radius);
+	case EShapeType::Capsule:
+	{
+		//Spheres along the segment, grown by half their spacing so nothing between two of them is missed
+		const FCapsule& Capsule = Capsules[Shape.Index];
+		const double Length = FVector::Distance(Capsule.A, Capsule.B);
+		const double Spacing = FMath::Max(FMath::Min(Capsule.Radius, Extent), UE_KINDA_SMALL_NUMBER);
+		const int Steps = FMath::CeilToInt(Length / Spacing);
+		const double Radius = Capsule.Radius + Spacing * 0.5;
+		for (int Step = 0; Step <= Steps; Step++)
+		{
+			const FVector Point = FMath::Lerp(Capsule.A, Capsule.B, Steps > 0 ? double(Step) / Steps : 0.0);
+			if (DistanceSquaredToBox(Center, Extent, Point) <= FMath::Square(Radius)) return true;
+		}
+		return false;
+	}
+	case EShapeType::Convex:
+	{
+		//Only separated when the node box is completely outside of one face, conservative at edges and corners
+		const FConvex& Convex = Convexes[Shape.Index];
+		for (int32 i = Convex.FirstPlane; i < Convex.FirstPlane + Convex.NumPlanes; i++)
+		{
+			const FPlane& Plane = ConvexPlanes[i];
+			const double Radius = Extent * (FMath::Abs(Plane.X) + FMath::Abs(Plane.Y) + FMath::Abs(Plane.Z));
+			if (Plane.PlaneDot(Center) > Radius) return false;
+		}
+		return true;
+	}
+	case EShapeType::Triangle:
+	{
+		const FVector* Corners = &Triangles[Shape.Index];
+		return TriangleOverlapsBox(Center, Extent, Corners[0], Corners[1], Corners[2]);
+	}
+	default:
+		return false;
+	}
+}
+
+void FGridVoxelizer::ClassifyEdges(bool ThinWalls, TArray<EEdgeState>& EdgeStates) const
+{
+	EdgeStates.Init(EEdgeState::Free, NodeCount.X * NodeCount.Y * NodeCount.Z * 3);
+	ParallelFor(ChunkShapes.Num(), [this, ThinWalls, &EdgeStates](int32 ChunkIndex)
+	{
+		ClassifyChunkEdges(ChunkIndex, ThinWalls, EdgeStates);
+	});
+
+	//Anything close to components without collision data can only be answered by traces
+	for (const TPair<UPrimitiveComponent*, FBox>& Fallback : FallbackComponents)
+	{
+		const FIntVector Min(FMath::Max(0, FMath::FloorToInt(Fallback.Value.Min.X) - 1), FMath::Max(0, FMath::FloorToInt(Fallback.Value.Min.Y) - 1), FMath::Max(0, FMath::FloorToInt(Fallback.Value.Min.Z) - 1));
+		const FIntVector Max(FMath::Min(NodeCount.X - 1, FMath::CeilToInt(Fallback.Value.Max.X)), FMath::Min(NodeCount.Y - 1, FMath::CeilToInt(Fallback.Value.Max.Y)), FMath::Min(NodeCount.Z - 1, FMath::CeilToInt(Fallback.Value.Max.Z)));
+		for (int x = Min.X; x <= Max.X; x++)
+		{
+			for (int y = Min.Y; y <= Max.Y; y++)
+			{
+				for (int z = Min.Z; z <= Max.Z; z++)
+				{
+					const int32 Index = ((x * NodeCount.Y + y) * NodeCount.Z + z) * 3;
+					for (int Axis = 0; Axis < 3; Axis++)
+					{
+						if (EdgeStates[Index + Axis] == EEdgeState::Free) EdgeStates[Index + Axis] = EEdgeState::NeedsTrace;
+					}
+				}
+			}
+		}
+	}
+}
+
+void FGridVoxelizer::ClassifyChunkEdges(int32 ChunkIndex, bool ThinWalls, TArray<EEdgeState>& EdgeStates) const
+{
+	if (ChunkShapes[ChunkIndex].IsEmpty()) return;
+
+	const FIntVector Chunk(ChunkIndex / (ChunkCount.Y * ChunkCount.Z), (ChunkIndex / ChunkCount.Z) % ChunkCount.Y, ChunkIndex % ChunkCount.Z);
+	const FIntVector ChunkMin = Chunk * ChunkSize;
+	const FIntVector ChunkMax(FMath::Min(ChunkMin.X + ChunkSize, NodeCount.X) - 1, FMath::Min(ChunkMin.Y + ChunkSize, NodeCount.Y) - 1, FMath::Min(ChunkMin.Z + ChunkSize, NodeCount.Z) - 1);
+
+	//Every shape close to a segment is also binned into the chunk of the node the segment starts at
+	for (int x = ChunkMin.X; x <= ChunkMax.X; x++)
+	{
+		for (int y = ChunkMin.Y; y <= ChunkMax.Y; y++)
+		{
+			for (int z = ChunkMin.Z; z <= ChunkMax.Z; z++)
+			{
+				const FVector Start(x, y, z);
+				for (int Axis = 0; Axis < 3; Axis++)
+				{
+					FVector End = Start;
+					End[Axis] += 1;
+					if (End[Axis] >= NodeCount[Axis]) continue;
+
+					const FBox Segment(Start, End);
+					EEdgeState& State = EdgeStates[((x * NodeCount.Y + y) * NodeCount.Z + z) * 3 + Axis];
+					for (const int32 ShapeIndex : ChunkShapes[ChunkIndex])
+					{
+						//Reach includes the node boxes, the shape itself is CellExtent smaller
+						if (!Shapes[ShapeIndex].Value.ExpandBy(-CellExtent + UE_KINDA_SMALL_NUMBER).Intersect(Segment)) continue;
+						if (!ThinWalls)
+						{
+							State = EEdgeState::NeedsTrace;
+							break;
+						}
+						if (Intersects(Shapes[ShapeIndex].Key, Start, End))
+						{
+							State = EEdgeState::Blocked;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+bool FGridVoxelizer::Intersects(const FShapeRef& Shape, const FVector& Start, const FVector& End) const
+{
+	switch (Shape.Type)
+	{
+	case EShapeType::Box:
+	{
+		//Slabs in the space of the box
+		const FOrientedBox& Box = Boxes[Shape.Index];
+		double Enter = 0;
+		double Exit = 1;
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			const double Origin = FVector::DotProduct(Start - Box.Center, Box.Axes[Axis]);
+			const double Direction = FVector::DotProduct(End - Start, Box.Axes[Axis]);
+			if (FMath::Abs(Direction) < UE_SMALL_NUMBER)
+			{
+				if (FMath::Abs(Origin) > Box.Extent[Axis]) return false;
+				continue;
+			}
+			double Near = (-Box.Extent[Axis] - Origin) / Direction;
+			double Far = (Box.Extent[Axis] - Origin) / Direction;
+			if (Near > Far) Swap(Near, Far);
+			Enter = FMath::Max(Enter, Near);
+			Exit = FMath::Min(Exit, Far);
+			if (Enter > Exit) return false;
+		}
+		return true;
+	}
+	case EShapeType::Sphere:
+		return FMath::PointDistToSegmentSquared(Spheres[Shape.Index].Center, Start, End) <= FMath::Square(Spheres[Shape.Index].Radius);
+	case EShapeType::Capsule:
+	{
+		const FCapsule& Capsule = Capsules[Shape.Index];
+		FVector OnEdge, OnCapsule;
+		FMath::SegmentDistToSegmentSafe(Start, End, Capsule.A, Capsule.B, OnEdge, OnCapsule);
+		return FVector::DistSquared(OnEdge, OnCapsule) <= FMath::Square(Capsule.Radius);
+	}
+	case EShapeType::Convex:
+	{
+		//Clips the segment with every face
+		const FConvex& Convex = Convexes[Shape.Index];
+		const FVector Direction = End - Start;
+		double Enter = 0;
+		double Exit = 1;
+		for (int32 i = Convex.FirstPlane; i < Convex.FirstPlane + Convex.NumPlanes; i++)
+		{
+			const FPlane& Plane = ConvexPlanes[i];
+			const double Distance = Plane.PlaneDot(Start);
+			const double Denominator = FVector::DotProduct(FVector(Plane), Direction);
+			if (FMath::Abs(Denominator) < UE_SMALL_NUMBER)
+			{
+				if (Distance > 0) return false;
+				continue;
+			}
+			const double T = -Distance / Denominator;
+			if (Denominator < 0) Enter = FMath::Max(Enter, T);
+			else Exit = FMath::Min(Exit, T);
+			if (Enter > Exit) return false;
+		}
+		return Convex.NumPlanes > 0 || Convex.Bounds.Intersect(FBox(Start.ComponentMin(End), Start.ComponentMax(End)));
+	}
+	case EShapeType::Triangle:
+	{
+		const FVector* Corners = &Triangles[Shape.Index];
+		FVector Point, Normal;
+		return FMath::SegmentTriangleIntersection(Start, End, Corners[0], Corners[1], Corners[2], Point, Normal);
+	}
+	default:
+		return false;
+	}
+}
+
+bool FGridVoxelizer::OverlapsBox(const FVector& WorldCenter, double WorldExtent) const
+{
+	const FVector Center = ToGrid(WorldCenter);
+	const double Extent = WorldExtent / NodeSpacing;
+	const FBox Box(Center - FVector(Extent), Center + FVector(Extent));
+
+	TArray<int32> ShapeIndices;
+	GatherShapes(Box, ShapeIndices);
+	for (const int32 ShapeIndex : ShapeIndices)
+	{
+		if (Overlaps(Shapes[ShapeIndex].Key, Center, Extent)) return true;
+	}
+
+	const FCollisionShape BoxShape = FCollisionShape::MakeBox(FVector(WorldExtent));
+	for (const TPair<UPrimitiveComponent*, FBox>& Fallback : FallbackComponents)
+	{
+		if (Fallback.Value.Intersect(Box) && Fallback.Key->OverlapComponent(WorldCenter, GridRotation, BoxShape)) return true;
+	}
+	return false;
+}
+
+FGridVoxelizer::EEdgeState FGridVoxelizer::ClassifySegment(const FVector& WorldStart, const FVector& WorldEnd) const
+{
+	const FVector Start = ToGrid(WorldStart);
+	const FVector End = ToGrid(WorldEnd);
+	const FBox Segment(Start.ComponentMin(End), Start.ComponentMax(End));
+
+	TArray<int32> ShapeIndices;
+	GatherShapes(Segment, ShapeIndices);
+	for (const int32 ShapeIndex : ShapeIndices)
+	{
+		if (Intersects(Shapes[ShapeIndex].Key, Start, End)) return EEdgeState::Blocked;
+	}
+
+	for (const TPair<UPrimitiveComponent*, FBox>& Fallback : FallbackComponents)
+	{
+		if (Fallback.Value.Intersect(Segment)) return EEdgeState::NeedsTrace;
+	}
+	return EEdgeState::Free;
+}
+
+void FGridVoxelizer::GatherShapes(const FBox& Box, TArray<int32>& ShapeIndices) const
+{
+	if (ChunkShapes.IsEmpty()) return;
+
+	//Shapes are binned by the nodes their reach covers, clamped to the grid like the box here
+	const FIntVector Min(FMath::Clamp(FMath::FloorToInt(Box.Min.X), 0, NodeCount.X - 1), FMath::Clamp(FMath::FloorToInt(Box.Min.Y), 0, NodeCount.Y - 1), FMath::Clamp(FMath::FloorToInt(Box.Min.Z), 0, NodeCount.Z - 1));
+	const FIntVector Max(FMath::Clamp(FMath::CeilToInt(Box.Max.X), 0, NodeCount.X - 1), FMath::Clamp(FMath::CeilToInt(Box.Max.Y), 0, NodeCount.Y - 1), FMath::Clamp(FMath::CeilToInt(Box.Max.Z), 0, NodeCount.Z - 1));
+	for (int x = Min.X / ChunkSize; x <= Max.X / ChunkSize; x++)
+	{
+		for (int y = Min.Y / ChunkSize; y <= Max.Y / ChunkSize; y++)
+		{
+			for (int z = Min.Z / ChunkSize; z <= Max.Z / ChunkSize; z++)
+			{
+				for (const int32 ShapeIndex : ChunkShapes[(x * ChunkCount.Y + y) * ChunkCount.Z + z])
+				{
+					//Reach includes the node boxes, the shape itself is CellExtent smaller
+					if (!Shapes[ShapeIndex].Value.ExpandBy(-CellExtent + UE_KINDA_SMALL_NUMBER).Intersect(Box)) continue;
+					ShapeIndices.AddUnique(ShapeIndex);
+				}
+			}
+		}
+	}
+}
+
+FVector FGridVoxelizer::ToGrid(const FVector& WorldPosition) const
+{
+	return ToGridDirection(WorldPosition - GridOrigin);
+}
+
+FVector FGridVoxelizer::ToGridDirection(const FVector& WorldDirection) const
+{
+	return FVector(FVector::DotProduct(WorldDirection, GridAxes[0]),
+		FVector::DotProduct(WorldDirection, GridAxes[1]),
+		FVector::DotProduct(WorldDirection, GridAxes[2])) / NodeSpacing;
+}
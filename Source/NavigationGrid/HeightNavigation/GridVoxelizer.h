@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AHeightNavigationVolume;
+class UPrimitiveComponent;
+
+/**
+ * Finds the blocked nodes of a volume without one overlap query per node.
+ * All collision geometry that overlaps the volume is collected with a single query and converted into grid space
+ * (simple shapes of the body setups, triangles for meshes that use complex collision as simple). Every node is a box
+ * around the node position, the shapes are binned into chunks of nodes and every chunk tests its nodes against its
+ * shapes in parallel. All tests are separating axis tests or conservative, so a node is rather blocked than not.
+ * Components without usable collision data fall back to overlap queries, but only for the nodes inside their bounds.
+ * The collected shapes are kept, so ClassifyEdges can tell which connections between nodes need traces at all.
+ */
+class NAVIGATIONGRID_API FGridVoxelizer
+{
+public:
+	//Occupancy is ordered x, y, z like the nested grid ((x * yNodes + y) * zNodes + z), 1 for every node whose box
+	//overlaps geometry. NodeExtent is the half size of the box around every node in world units
+	void Voxelize(AHeightNavigationVolume& Volume, float NodeExtent, TArray<uint8>& Occupancy);
+	//For a grid that is not the current one of the volume yet, the spacing and the transform are still read from it
+	void Voxelize(AHeightNavigationVolume& Volume, const FIntVector& InNodeCount, float NodeExtent, TArray<uint8>& Occupancy);
+
+	enum class EEdgeState : uint8
+	{
+		Free,
+		Blocked,
+		//Borders geometry that could not be tested here
+		NeedsTrace,
+	};
+
+	//Three entries per node in the same order as the occupancy, the edges to the next node along x, y and z.
+	//Edges that do not come close to any shape are free. Edges close to shapes need a trace, unless ThinWalls is set,
+	//then the edge segment itself is tested against the shapes, which also finds walls thinner than the node boxes.
+	//Only components without collision data still need traces then
+	void ClassifyEdges(bool ThinWalls, TArray<EEdgeState>& EdgeStates) const;
+
+	//Queries for boxes and segments that are not on the node grid, like the cells of the multi resolution grid.
+	//World space, need Voxelize first. Components without collision data use an overlap query for boxes and
+	//return NeedsTrace for segments
+	bool OverlapsBox(const FVector& WorldCenter, double WorldExtent) const;
+	EEdgeState ClassifySegment(const FVector& WorldStart, const FVector& WorldEnd) const;
+
+private:
+	enum class EShapeType : uint8
+	{
+		Box,
+		Sphere,
+		Capsule,
+		Convex,
+		Triangle,
+	};
+
+	struct FShapeRef
+	{
+		EShapeType Type;
+		int32 Index;
+	};
+
+	//Everything below is in grid space, one unit is distanceBetweenNodes and nodes sit on whole numbers
+	struct FOrientedBox
+	{
+		FVector Center;
+		FVector Axes[3];
+		FVector Extent;
+	};
+
+	struct FSphere
+	{
+		FVector Center;
+		double Radius;
+	};
+
+	struct FCapsule
+	{
+		FVector A;
+		FVector B;
+		double Radius;
+	};
+
+	struct FConvex
+	{
+		int32 FirstPlane;
+		int32 NumPlanes;
+		FBox Bounds;
+	};
+
+	void CollectComponent(const AHeightNavigationVolume& Volume, UPrimitiveComponent* Component, const FTransform& Transform);
+	void AddShape(EShapeType Type, int32 Index, const FBox& Bounds);
+	void VoxelizeChunk(int32 ChunkIndex, TArray<uint8>& Occupancy) const;
+	//Extent is the half size of the box around Center
+	bool Overlaps(const FShapeRef& Shape, const FVector& Center, double Extent) const;
+	//Every shape whose bounds intersect the grid space box, each one once
+	void GatherShapes(const FBox& Box, TArray<int32>& ShapeIndices) const;
+	void ClassifyChunkEdges(int32 ChunkIndex, bool ThinWalls, TArray<EEdgeState>& EdgeStates) const;
+	bool Intersects(const FShapeRef& Shape, const FVector& Start, const FVector& End) const;
+
+	//World to grid space
+	FVector ToGrid(const FVector& WorldPosition) const;
+	FVector ToGridDirection(const FVector& WorldDirection) const;
+
+	TArray<FOrientedBox> Boxes;
+	TArray<FSphere> Spheres;
+	TArray<FCapsule> Capsules;
+	TArray<FConvex> Convexes;
+	TArray<FPlane> ConvexPlanes;
+	//Three corners per triangle
+	TArray<FVector> Triangles;
+	//Every shape with the grid space bounds of the nodes it can reach
+	TArray<TPair<FShapeRef, FBox>> Shapes;
+	//Indices into Shapes for every chunk
+	TArray<TArray<int32>> ChunkShapes;
+	//Components the query found that have no collision data this can use
+	TArray<TPair<UPrimitiveComponent*, FBox>> FallbackComponents;
+
+	FVector GridOrigin;
+	FVector GridAxes[3];
+	FQuat GridRotation = FQuat::Identity;
+	double NodeSpacing = 1;
+	//Half size of the node box in grid units
+	double CellExtent = 0.25;
+	FIntVector NodeCount;
+	FIntVector ChunkCount;
+	static constexpr int32 ChunkSize = 16;
+};
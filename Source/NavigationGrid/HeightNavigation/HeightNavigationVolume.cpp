@@ -10,33 +10,116 @@
 #include <queue>
 
 #include "VectorTypes.h"
+#include "Algo/BinarySearch.h"
+#include "Algo/Reverse.h"
+#include "Async/ParallelFor.h"
+#include "Misc/ScopeExit.h"
+#include "Misc/ScopeRWLock.h"
+#include "Engine/Engine.h"
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "GridVoxelizer.h"
+#include "NavCostVolume.h"
+#include "NavDebugDraw.h"
 
+namespace
+{
+    //Same order as GetNeighbors
+    const FIntVector neighborOffsets[6] = {
+        FIntVector(1, 0, 0), FIntVector(-1, 0, 0),
+        FIntVector(0, 1, 0), FIntVector(0, -1, 0),
+        FIntVector(0, 0, 1), FIntVector(0, 0, -1),
+    };
+
+    //Bricked node layout: 4x4x4 nodes per brick, inside of a brick the bits of x, y and z are interleaved (x y z x y z)
+    constexpr int brickShift = 2;
+    constexpr int brickSize = 1 << brickShift;
+    constexpr int brickNodeShift = 3 * brickShift;
+    //Local coordinate 0-3 spread to every third bit
+    constexpr int mortonSpread[brickSize] = { 0, 1, 8, 9 };
+    //Bits of the local index that belong to x, y and z
+    constexpr int mortonAxisMasks[3] = { 0b100100, 0b010010, 0b001001 };
+
+    //Moves a table with one or more blocks of per node values into another node order, padding fills the indices outside of the grid
+    template<typename T>
+    void RemapNodeTable(TArray<T>& table, TConstArrayView<int> oldIndices, int oldCount, TConstArrayView<int> newIndices, int newCount, T padding)
+    {
+        if (table.IsEmpty() || oldCount == 0) return;
+
+        const int blocks = table.Num() / oldCount;
+        TArray<T> remapped;
+        remapped.Init(padding, blocks * newCount);
+        for (int block = 0; block < blocks; block++)
+        {
+            for (int i = 0; i < oldIndices.Num(); i++)
+            {
+                remapped[block * newCount + newIndices[i]] = table[block * oldCount + oldIndices[i]];
+            }
+        }
+        table = MoveTemp(remapped);
+    }
+
+    int GetBrickCount(int nodes)
+    {
+        return (nodes + brickSize - 1) >> brickShift;
+    }
+
+    int CompactMortonBits(int bits)
+    {
+        return (bits & 1) | ((bits >> 2) & 2);
+    }
+
+    //Cost bytes get written on the game thread while searches read them, a stale byte only changes the cost of one step
+    void StoreCost(uint8* costs, int index, uint8 cost)
+    {
+        FPlatformAtomics::AtomicStore_Relaxed(reinterpret_cast<volatile int8*>(costs + index), int8(cost));
+    }
+
+    uint8 LoadCost(const uint8* costs, int index)
+    {
+        return uint8(FPlatformAtomics::AtomicRead_Relaxed(reinterpret_cast<const volatile int8*>(costs + index)));
+    }
+}
+
+AHeightNavigationVolume::AHeightNavigationVolume()
+{
+    gridVisualizer = CreateDefaultSubobject<UNavGridVisualizerComponent>(TEXT("GridVisualizer"));
+    gridVisualizer->SetupAttachment(RootComponent);
+}
 
 void AHeightNavigationVolume::DrawBox(FVector pos, FColor color) const
 {
-    DrawDebugBox(GetWorld(), pos, FVector(25, 25, 25), color, false, 4, 0, 15);
+    FNavDebugDraw(GetWorld()).Box(pos, FVector(25, 25, 25), color, 4, 15);
 }
 
 void AHeightNavigationVolume::GenerateNavNodeGrid()
 {
-    ClearGrid();
+    gridStreaming.Stop();
 
-    InitializeNodeCount();
+    //Searches on worker threads keep using the current tables while the new grid gets built,
+    //everything they read is swapped in with the write lock held
+    const FIntVector nodeCount = CalculateNodeCount();
+    FNavDebugDraw debugDraw(GetWorld(), ENavDebugLevel::Grid);
+
+    //Same order as the loops below
+    TArray<uint8> occupancy;
+    FGridVoxelizer voxelizer;
+    if (voxelizeGeometry) voxelizer.Voxelize(*this, nodeCount, distanceBetweenNodes / 4, occupancy);
+    int occupancyIndex = 0;
 
     //Reserving space for less resizing, since we already know the size of all 3 arrays
-    navNodeGrid.Reserve(xNodes);
-    for (int x = 0; x < xNodes; x++)
+    TArray<F_YLayer> grid;
+    grid.Reserve(nodeCount.X);
+    for (int x = 0; x < nodeCount.X; x++)
     {
-        navNodeGrid.Add(F_YLayer());
-        navNodeGrid[x].yLayer.Reserve(yNodes);
-        for (int y = 0; y < yNodes; y++)
+        grid.Add(F_YLayer());
+        grid[x].yLayer.Reserve(nodeCount.Y);
+        for (int y = 0; y < nodeCount.Y; y++)
         {
-            navNodeGrid[x].yLayer.Add(F_ZLayer());
-            navNodeGrid[x][y].zLayer.Reserve(zNodes);
-            for (int z = 0; z < zNodes; z++)
+            grid[x].yLayer.Add(F_ZLayer());
+            grid[x][y].zLayer.Reserve(nodeCount.Z);
+            for (int z = 0; z < nodeCount.Z; z++)
             {
                 FNavNode node;
                 node.X = x;
@@ -44,47 +127,135 @@ void AHeightNavigationVolume::GenerateNavNodeGrid()
                 node.Z = z;
 
                 TArray<AActor*> CollidingActors;
-                if (UKismetSystemLibrary::BoxOverlapActors(this, GetWorldPositionFromNode(node), FVector(distanceBetweenNodes / 4), { ObjectTypeQuery1, ObjectTypeQuery2 }, nullptr, { this }, CollidingActors))
+                const bool overlapping = voxelizeGeometry ? occupancy[occupancyIndex++] != 0
+                    : UKismetSystemLibrary::BoxOverlapActors(this, GetWorldPositionFromNode(node), FVector(distanceBetweenNodes / 4), { ObjectTypeQuery1, ObjectTypeQuery2 }, nullptr, { this }, CollidingActors);
+                if (overlapping)
                 {
                     node.blocked = true;
-#if WITH_EDITOR
-                    DrawDebugBox(GetWorld(), GetWorldPositionFromNode(node), FVector(distanceBetweenNodes / 4), FColor::Red, false, 5);
-#endif
+                    debugDraw.Box(GetWorldPositionFromNode(node), FVector(distanceBetweenNodes / 4), FColor::Red, 5);
                 }
 
-                navNodeGrid[x][y].zLayer.Add(node);
+                grid[x][y].zLayer.Add(node);
 
             }
         }
     }
-    if (navNodeGrid.IsEmpty()) return;
-    startPosition = GetWorldPositionFromNode(navNodeGrid[0][0][0]);
-    endPosition = GetActorForwardVector() * GetExtents().X + GetActorRightVector() * GetExtents().Y + GetActorUpVector() * GetExtents().Z + GetActorLocation();
+    debugDraw.Flush();
+    if (grid.IsEmpty()) return;
+
+    SetupNeighbors(grid, voxelizeGeometry ? &voxelizer : nullptr);
 
-    SetupNeighbors();
-    //ShowGrid();
+    //The node table and the clearance field only make sense together, so both are built in the same lock.
+    //Landmarks, the multi resolution grid and the compressed grid only speed searches up and follow one by one
+    bool pathDatabaseBound = false;
+    {
+        FWriteScopeLock writeLock(gridLock);
+        ClearGridTables();
+        InitializeNodeCount();
+        startPosition = GetWorldPositionFromNode(grid[0][0][0]);
+        endPosition = GetActorForwardVector() * GetExtents().X + GetActorRightVector() * GetExtents().Y + GetActorUpVector() * GetExtents().Z + GetActorLocation();
+
+        BuildNodeFlags(grid);
+        GenerateClearanceField();
+
+        //Saved landmark tables that still fit the grid are kept, GenerateLandmarks reuses them
+        if (!useLandmarkHeuristic || landmarkGridHash != HashCombine(CalculateGridHash(), uint32(tableLayout)))
+        {
+            landmarks.Empty();
+            landmarkDistances.Empty();
+            landmarkGridHash = 0;
+        }
+
+        if (usePathDatabase && pathDatabase.IsBaked()) pathDatabaseBound = pathDatabase.Bind(*this);
+    }
+
+    if (useLandmarkHeuristic) GenerateLandmarks();
+
+    if (usePathDatabase)
+    {
+        if (!pathDatabase.IsBaked())
+        {
+            UE_LOG(LogTemp, Warning, TEXT("%s - No path database baked, GetPath searches instead"), *GetName());
+        }
+        else if (!pathDatabaseBound)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("%s - The path database was baked for another grid, bake it again"), *GetName());
+        }
+    }
+
+    if (resolutionLevels > 1)
+    {
+        FMultiResolutionGrid newMultiResolutionGrid;
+        newMultiResolutionGrid.Build(this, resolutionLevels, voxelizeGeometry ? &voxelizer : nullptr);
+        if (useLandmarkHeuristic || smoothPaths)
+        {
+            UE_LOG(LogTemp, Log, TEXT("%s - Searches on the multi resolution grid use neither landmarks nor smoothing, only agents wider than %.0f cm and weighted queries search the regular grid"),
+                *GetName(), newMultiResolutionGrid.GetFinestCellSize(*this));
+        }
+
+        FWriteScopeLock writeLock(gridLock);
+        multiResolutionGrid = MoveTemp(newMultiResolutionGrid);
+    }
+
+    if (compressGrid) CompressGrid();
+
+    ApplyCostVolumes();
+    ResetSearchHeat();
+    if (gridVisualizer && gridVisualizer->IsShown()) gridVisualizer->Refresh();
 }
 
-void AHeightNavigationVolume::SetupNeighbors()
+void AHeightNavigationVolume::SetupNeighbors(TArray<F_YLayer>& grid, const FGridVoxelizer* voxelizer)
 {
-    if (IsGridEmpty()) return;
+    if (grid.IsEmpty() || grid[0].yLayer.IsEmpty()) return;
+    const int sizeX = grid.Num();
+    const int sizeY = grid[0].yLayer.Num();
+    const int sizeZ = grid[0][0].zLayer.Num();
 
     TArray<FNavNode> neighbors = TArray<FNavNode>();
-    
+    FNavDebugDraw debugDraw(GetWorld(), ENavDebugLevel::Grid);
 
-    for (int x = 0; x < xNodes; x++)
+    //Three edges per node towards +x, +y and +z, in the order of the loops below
+    TArray<FGridVoxelizer::EEdgeState> edgeStates;
+    if (voxelizer && edgeValidation != EEdgeValidation::Traces)
     {
-        for (int y = 0; y < yNodes; y++)
+        voxelizer->ClassifyEdges(edgeValidation == EEdgeValidation::ThinWalls, edgeStates);
+    }
+    int64 traces = 0;
+    int64 tracesWithoutVoxelizer = 0;
+
+    for (int x = 0; x < sizeX; x++)
+    {
+        for (int y = 0; y < sizeY; y++)
         {
-            for (int z = 0; z < zNodes; z++)
+            for (int z = 0; z < sizeZ; z++)
             {
                 neighbors.Empty();
-                GetNeighbors(navNodeGrid[x][y][z], navNodeGrid, neighbors);
+                GetNeighbors(grid[x][y][z], grid, neighbors);
 
-                FVector start = GetWorldPositionFromNode(navNodeGrid[x][y][z]);
-                for(FNavNode neighbor : neighbors)
+                FVector start = GetWorldPositionFromNode(grid[x][y][z]);
+                for(const FNavNode& neighbor : neighbors)
                 {
+                    tracesWithoutVoxelizer += 2;
+                    if (neighbor.blocked) continue;
+
+                    //The edge between both nodes is stored with the one that has the lower coordinate
+                    if (!edgeStates.IsEmpty())
+                    {
+                        const int axis = neighbor.X != x ? 0 : (neighbor.Y != y ? 1 : 2);
+                        const int lowX = FMath::Min(x, neighbor.X);
+                        const int lowY = FMath::Min(y, neighbor.Y);
+                        const int lowZ = FMath::Min(z, neighbor.Z);
+                        const FGridVoxelizer::EEdgeState edgeState = edgeStates[((lowX * sizeY + lowY) * sizeZ + lowZ) * 3 + axis];
+                        if (edgeState == FGridVoxelizer::EEdgeState::Free)
+                        {
+                            grid[x][y][z].neighbors.Add(FVector(neighbor.X, neighbor.Y, neighbor.Z));
+                            continue;
+                        }
+                        if (edgeState == FGridVoxelizer::EEdgeState::Blocked) continue;
+                    }
+
                     FVector end = GetWorldPositionFromNode(neighbor);
+                    traces += 2;
 
                     FCollisionQueryParams traceParams = FCollisionQueryParams(FName(TEXT("trace")), true, this);
                     traceParams.bTraceComplex = true;
@@ -96,25 +267,36 @@ void AHeightNavigationVolume::SetupNeighbors()
                     GetWorld()->LineTraceSingleByChannel(result, start, end, ECC_WorldStatic, traceParams);
                     GetWorld()->LineTraceSingleByChannel(resultReversed, end, start, ECC_WorldStatic, traceParams);
 
-#if WITH_EDITOR
-                    DrawDebugLine(GetWorld(), start, end, result.bBlockingHit || resultReversed.bBlockingHit ? FColor::Red : FColor::Green, false, 5);
-#endif
+                    debugDraw.Line(start, end, result.bBlockingHit || resultReversed.bBlockingHit ? FColor::Red : FColor::Green, 5);
 
-                    if(!result.bBlockingHit && !resultReversed.bBlockingHit && !neighbor.blocked)
+                    if(!result.bBlockingHit && !resultReversed.bBlockingHit)
                     {
-                        navNodeGrid[x][y][z].neighbors.Add(FVector(neighbor.X, neighbor.Y, neighbor.Z));
+                        grid[x][y][z].neighbors.Add(FVector(neighbor.X, neighbor.Y, neighbor.Z));
                     }
                 }
 
-                if (navNodeGrid[x][y][z].neighbors.IsEmpty()) navNodeGrid[x][y][z].blocked = true;
+                if (grid[x][y][z].neighbors.IsEmpty()) grid[x][y][z].blocked = true;
 
             }
         }
     }
+
+    UE_LOG(LogTemp, Log, TEXT("%s - Setup neighbors: %lld traces instead of %lld"), *GetName(), traces, tracesWithoutVoxelizer);
 }
 
 void AHeightNavigationVolume::ClearGrid()
 {
+    FWriteScopeLock writeLock(gridLock);
+    ClearGridTables();
+}
+
+void AHeightNavigationVolume::ClearGridTables()
+{
+    multiResolutionGrid.Reset();
+    compressedGrid.Reset();
+    pathDatabase.Unbind();
+    nodeFlags.Empty();
+
     if (navNodeGrid.IsEmpty()) return;
     if (navNodeGrid[0].yLayer.IsEmpty()) return;
     if (navNodeGrid[0].yLayer[0].zLayer.IsEmpty()) return;
@@ -132,36 +314,70 @@ void AHeightNavigationVolume::ClearGrid()
 
 void AHeightNavigationVolume::ShowGrid()
 {
-    if (navNodeGrid.IsEmpty()) return;
-    for(int x = 0; x < xNodes; x++)
+    if (gridVisualizer) gridVisualizer->Refresh();
+}
+
+void AHeightNavigationVolume::HideGrid()
+{
+    if (gridVisualizer) gridVisualizer->Clear();
+}
+
+bool AHeightNavigationVolume::IsNodeBlocked(int x, int y, int z) const
+{
+    if (!nodeFlags.IsEmpty()) return (nodeFlags[GetNodeIndex(x, y, z)] & FCompressedGrid::BlockedBit) != 0;
+    if (compressedGrid.IsBuilt()) return compressedGrid.IsBlocked(x, y, z);
+    if (gridStreaming.IsActive()) return (gridStreaming.GetNodeFlags(x, y, z) & FCompressedGrid::BlockedBit) != 0;
+    return navNodeGrid[x][y][z].blocked;
+}
+
+uint8 AHeightNavigationVolume::GetConnectionMask(int x, int y, int z) const
+{
+    if (!nodeFlags.IsEmpty()) return nodeFlags[GetNodeIndex(x, y, z)] & 0x3F;
+    if (compressedGrid.IsBuilt()) return compressedGrid.GetConnections(x, y, z);
+    if (gridStreaming.IsActive()) return gridStreaming.GetNodeFlags(x, y, z) & 0x3F;
+    return GetConnectionMask(navNodeGrid[x][y][z]);
+}
+
+uint8 AHeightNavigationVolume::GetConnectionMask(const FNavNode& node)
+{
+    uint8 mask = 0;
+    for (const FVector& neighbor : node.neighbors)
     {
-        for(int y = 0; y < yNodes; y++)
-        {
-            for(int z = 0; z < zNodes; z++)
-            {
-                FNavNode currentNode = navNodeGrid[x][y][z];
-                FVector worldPosition = GetWorldPositionFromNode(currentNode);
-#if WITH_EDITOR
-                DrawBox(worldPosition, navNodeGrid[x][y][z].blocked == true ? FColor::Red : FColor::Green);
-#endif
-            }
-        }
+        const int offsetX = int(neighbor.X) - node.X;
+        const int offsetY = int(neighbor.Y) - node.Y;
+        const int offsetZ = int(neighbor.Z) - node.Z;
+        const int axis = offsetX != 0 ? 0 : (offsetY != 0 ? 1 : 2);
+        const int offset = axis == 0 ? offsetX : (axis == 1 ? offsetY : offsetZ);
+        mask |= 1 << (axis * 2 + (offset < 0 ? 1 : 0));
     }
+    return mask;
+}
+
+uint8 AHeightNavigationVolume::GetNodeFlags(int x, int y, int z) const
+{
+    if (!nodeFlags.IsEmpty()) return nodeFlags[GetNodeIndex(x, y, z)];
+    return GetConnectionMask(x, y, z) | (IsNodeBlocked(x, y, z) ? FCompressedGrid::BlockedBit : 0);
+}
+
+const FIntVector& AHeightNavigationVolume::GetNeighborOffset(int direction)
+{
+    return neighborOffsets[direction];
 }
 
 
 void AHeightNavigationVolume::GetNeighbors(FNavNode node, TArray<F_YLayer>& grid, TArray<FNavNode>& neighbors)
 {
-    if (IsGridEmpty()) return;
+    if (grid.IsEmpty() || grid[0].yLayer.IsEmpty()) return;
 
     neighbors.Empty();
     neighbors.Reserve(6);
 
-    const bool forward = node.X + 1 < xNodes;
+    //The size of the given grid, it can be one that is not swapped in yet
+    const bool forward = node.X + 1 < grid.Num();
     const bool back = node.X - 1 >= 0;
-    const bool right = node.Y + 1 < yNodes;
+    const bool right = node.Y + 1 < grid[0].yLayer.Num();
     const bool left = node.Y - 1 >= 0;
-    const bool up = node.Z + 1 < zNodes;
+    const bool up = node.Z + 1 < grid[0][0].zLayer.Num();
     const bool down = node.Z - 1 >= 0;
 
     if (forward) neighbors.Add(grid[node.X + 1][node.Y][node.Z]);
@@ -186,16 +402,15 @@ bool AHeightNavigationVolume::IsValid(int x, int y, int z) const
         x < xNodes && y < yNodes && z < zNodes);
 }
 
-bool AHeightNavigationVolume::IsUnblocked(FNavNode node)
+bool AHeightNavigationVolume::IsUnblocked(FNavNode node) const
 {
-    if (node.X < 0 && node.Y < 0 && node.Z < 0 && node.X >= xNodes && node.Y >= yNodes && node.Z >= zNodes) return false;
-    return !navNodeGrid[node.X][node.Y][node.Z].blocked;
+    return IsUnblocked(node.X, node.Y, node.Z);
 }
 
-bool AHeightNavigationVolume::IsUnblocked(int x, int y, int z)
+bool AHeightNavigationVolume::IsUnblocked(int x, int y, int z) const
 {
     if (x < 0 || y < 0 || z < 0 || x >= xNodes || y >= yNodes || z >= zNodes) return false;
-    return !navNodeGrid[x][y][z].blocked;
+    return !IsNodeBlocked(x, y, z);
 }
 
 bool AHeightNavigationVolume::IsDestination(FNavNode node, FNavNode goal) const
@@ -208,8 +423,19 @@ bool AHeightNavigationVolume::IsDestination(int x, int y, int z, FNavNode goal)
     return (x == goal.X && y == goal.Y && z == goal.Z);
 }
 
-FNavNode AHeightNavigationVolume::GetNodeFromPosition(FVector position, TArray<F_YLayer> grid)
+FNavNode AHeightNavigationVolume::GetNodeFromPosition(FVector position) const
 {
+    //Only the position and the blocked state are needed, so the nodes get assembled from the grid accessors
+    auto nodeAt = [this](int nodeX, int nodeY, int nodeZ)
+    {
+        FNavNode node;
+        node.X = nodeX;
+        node.Y = nodeY;
+        node.Z = nodeZ;
+        node.blocked = IsNodeBlocked(nodeX, nodeY, nodeZ);
+        return node;
+    };
+
     FNavNode badNode = FNavNode();
     badNode.X = -1;
     badNode.Y = -1;
@@ -257,9 +483,9 @@ FNavNode AHeightNavigationVolume::GetNodeFromPosition(FVector position, TArray<F
     }
 
     FVector tempPos = position;
-    FVector nodePos = GetWorldPositionFromNode(grid[x][y][z]);
+    FVector nodePos = GetWorldPositionFromNode(nodeAt(x, y, z));
     float closestDistance = FVector::Distance(nodePos, position);
-    if (closestDistance < distanceBetweenNodes / 2) return grid[x][y][z];
+    if (closestDistance < distanceBetweenNodes / 2) return nodeAt(x, y, z);
 
     int tempX = x;
     int tempY = y;
@@ -269,181 +495,154 @@ FNavNode AHeightNavigationVolume::GetNodeFromPosition(FVector position, TArray<F
     float temp = 0.0f;
     if (x + 1 < xNodes && y + 1 < yNodes && z + 1 < zNodes)
     {
-        temp = FVector::Distance(position, GetWorldPositionFromNode(grid[x + 1][y + 1][z + 1]));
+        temp = FVector::Distance(position, GetWorldPositionFromNode(nodeAt(x + 1, y + 1, z + 1)));
         if(closestDistance > temp)
         {
             closestDistance = temp;
             tempX = x + 1;
             tempY = y + 1;
             tempZ = z + 1;
-            if (closestDistance < distanceBetweenNodes / 2) return grid[tempX][tempY][tempZ];
+            if (closestDistance < distanceBetweenNodes / 2) return nodeAt(tempX, tempY, tempZ);
         }
     }
 
     if (x + 1 < xNodes)
     {
-        temp = FVector::Distance(position, GetWorldPositionFromNode(grid[x + 1][y][z]));
+        temp = FVector::Distance(position, GetWorldPositionFromNode(nodeAt(x + 1, y, z)));
         if (closestDistance > temp)
         {
             closestDistance = temp;
             tempX = x + 1;
             tempY = y;
             tempZ = z;
-            if (closestDistance < distanceBetweenNodes / 2) return grid[tempX][tempY][tempZ];
+            if (closestDistance < distanceBetweenNodes / 2) return nodeAt(tempX, tempY, tempZ);
         }
     }
 
     if (y + 1 < yNodes)
     {
-        temp = FVector::Distance(position, GetWorldPositionFromNode(grid[x][y+1][z]));
+        temp = FVector::Distance(position, GetWorldPositionFromNode(nodeAt(x, y+1, z)));
         if (closestDistance > temp)
         {
             closestDistance = temp;
             tempX = x;
             tempY = y+1;
             tempZ = z;
-            if (closestDistance < distanceBetweenNodes / 2) return grid[tempX][tempY][tempZ];
+            if (closestDistance < distanceBetweenNodes / 2) return nodeAt(tempX, tempY, tempZ);
         }
     }
 
     if (z + 1 < zNodes)
     {
-        temp = FVector::Distance(position, GetWorldPositionFromNode(grid[x][y][z + 1]));
+        temp = FVector::Distance(position, GetWorldPositionFromNode(nodeAt(x, y, z + 1)));
         if (closestDistance > temp)
         {
             closestDistance = temp;
             tempX = x;
             tempY = y;
             tempZ = z + 1;
-            if (closestDistance < distanceBetweenNodes / 2) return grid[tempX][tempY][tempZ];
+            if (closestDistance < distanceBetweenNodes / 2) return nodeAt(tempX, tempY, tempZ);
         }
     }
 
     if (x + 1 < xNodes && y + 1 < yNodes)
     {
-        temp = FVector::Distance(position, GetWorldPositionFromNode(grid[x + 1][y + 1][z]));
+        temp = FVector::Distance(position, GetWorldPositionFromNode(nodeAt(x + 1, y + 1, z)));
         if (closestDistance > temp)
         {
             closestDistance = temp;
             tempX = x + 1;
             tempY = y + 1;
             tempZ = z;
-            if (closestDistance < distanceBetweenNodes / 2) return grid[tempX][tempY][tempZ];
+            if (closestDistance < distanceBetweenNodes / 2) return nodeAt(tempX, tempY, tempZ);
         }
     }
 
     if (x + 1 < xNodes && z + 1 < zNodes)
     {
-        temp = FVector::Distance(position, GetWorldPositionFromNode(grid[x+1][y][z+1]));
+        temp = FVector::Distance(position, GetWorldPositionFromNode(nodeAt(x+1, y, z+1)));
         if (closestDistance > temp)
         {
             closestDistance = temp;
             tempX = x+1;
             tempY = y;
             tempZ = z+1;
-            if (closestDistance < distanceBetweenNodes / 2) return grid[tempX][tempY][tempZ];
+            if (closestDistance < distanceBetweenNodes / 2) return nodeAt(tempX, tempY, tempZ);
         }
     }
 
     if (y + 1 < yNodes && z + 1 < zNodes)
     {
-        temp = FVector::Distance(position, GetWorldPositionFromNode(grid[x][y+1][z+1]));
+        temp = FVector::Distance(position, GetWorldPositionFromNode(nodeAt(x, y+1, z+1)));
         if (closestDistance > temp)
         {
             closestDistance = temp;
             tempX = x;
             tempY = y + 1;
             tempZ = z + 1;
-            if (closestDistance < distanceBetweenNodes / 2) return grid[tempX][tempY][tempZ];
+            if (closestDistance < distanceBetweenNodes / 2) return nodeAt(tempX, tempY, tempZ);
         }
     }
 
-	if (!grid[tempX][tempY][tempZ].blocked) return grid[tempX][tempY][tempZ];
+	if (!nodeAt(tempX, tempY, tempZ).blocked) return nodeAt(tempX, tempY, tempZ);
 
 #if WITH_EDITOR
-    GEditor->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
-        TEXT("NavGrid GetNodeFromPosition - Nearest node is not actually valid!"));
+    if (IsInGameThread())
+        GEngine->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
+            TEXT("NavGrid GetNodeFromPosition - Nearest node is not actually valid!"));
 #endif
     UE_LOG(LogTemp, Error, TEXT("NavGrid GetNodeFromPosition - Nearest node is not actually valid!"));
 
     //This shouldn't happen too often, usually the target should be on a valid position
     //This just confirms, that we receive a valid position
-    int index = 0;
-    TArray<FNavNode> CheckedNodes;
-    TArray<FNavNode> NodesToCheck;
-    NodesToCheck.Add(grid[tempX][tempY][tempZ]);
+    //Grows a cube around the node ring by ring, until a ring contains a free node
+    TBitArray<> checkedNodes(false, GetNodeCount());
+    TArray<FIntVector> nodesToCheck = { FIntVector(tempX, tempY, tempZ) };
+    TArray<FIntVector> nextNodes;
+    checkedNodes[GetNodeIndex(tempX, tempY, tempZ)] = true;
     FNavNode ClosestNode;
     float ClosestDistance = FLT_MAX;
 
-    while (CheckedNodes.Num() < (xNodes*yNodes*zNodes) && ClosestDistance == FLT_MAX)
-    {
-        const FVector CheckingValues[26] = { //To check all possible neighboring positions
-            //top
-            FVector(0,0,1),
-            FVector(1,0,1),
-            FVector(0,1,1),
-            FVector(1,1,1),
-            FVector(-1,0,1),
-            FVector(0,-1,1),
-            FVector(-1,-1,1),
-            FVector(1,-1,1),
-            FVector(-1,1,1),
-            //mid
-            FVector(1,0,0),
-            FVector(0,1,0),
-            FVector(1,1,0),
-            FVector(-1,0,0),
-            FVector(0,-1,0),
-            FVector(-1,-1,0),
-            FVector(1,-1,0),
-            FVector(-1,1,0),
-            //bot
-            FVector(0,0,-1),
-            FVector(1,0,-1),
-            FVector(0,1,-1),
-            FVector(1,1,-1),
-            FVector(-1,0,-1),
-            FVector(0,-1,-1),
-            FVector(-1,-1,-1),
-            FVector(1,-1,-1),
-            FVector(-1,1,-1),
-        };
-
-        for(int i = NodesToCheck.Num() - 1; i >= 0; i--)
-        {
-            if(!NodesToCheck[i].blocked)
-            {
-                float distance = FVector::Distance(GetWorldPositionFromNode(NodesToCheck[i]), position);
-                if(distance < ClosestDistance)
+    while (!nodesToCheck.IsEmpty() && ClosestDistance == FLT_MAX)
+    {
+        nextNodes.Reset();
+        for (const FIntVector& checking : nodesToCheck)
+        {
+            const FNavNode node = nodeAt(checking.X, checking.Y, checking.Z);
+            if (!node.blocked)
+            {
+                const float distance = FVector::Distance(GetWorldPositionFromNode(node), position);
+                if (distance < ClosestDistance)
                 {
                     ClosestDistance = distance;
-                    ClosestNode = NodesToCheck[i];
+                    ClosestNode = node;
                 }
             }
-	        for(int j = 0; j < CheckingValues->Length(); j++)
-	        {
-                int CheckX = NodesToCheck[i].X + CheckingValues[j].X;
-                int CheckY = NodesToCheck[i].Y + CheckingValues[j].Y;
-                int CheckZ = NodesToCheck[i].Z + CheckingValues[j].Z;
-
 
-		        if(CheckX < xNodes && CheckX >= 0 &&
-                    CheckY < yNodes && CheckY >= 0 &&
-                    CheckZ < zNodes && CheckZ >= 0)
-		        {
-                    if(!CheckedNodes.Contains(grid[CheckX][CheckY][CheckZ]))
-                        NodesToCheck.Add(grid[CheckX][CheckY][CheckZ]);
-		        }
-	        }
+            //All 26 neighboring positions
+            for (int offsetX = -1; offsetX <= 1; offsetX++)
+            {
+                for (int offsetY = -1; offsetY <= 1; offsetY++)
+                {
+                    for (int offsetZ = -1; offsetZ <= 1; offsetZ++)
+                    {
+                        const FIntVector next = checking + FIntVector(offsetX, offsetY, offsetZ);
+                        if (!IsValid(next.X, next.Y, next.Z)) continue;
 
-            CheckedNodes.Add(NodesToCheck[i]);
-            NodesToCheck.RemoveAt(i);
+                        const int nextIndex = GetNodeIndex(next.X, next.Y, next.Z);
+                        if (checkedNodes[nextIndex]) continue;
+                        checkedNodes[nextIndex] = true;
+                        nextNodes.Add(next);
+                    }
+                }
+            }
         }
+        Swap(nodesToCheck, nextNodes);
     }
 
 #if WITH_EDITOR
-    if(ClosestNode.blocked)
-		GEditor->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
+    if(ClosestNode.blocked && IsInGameThread())
+		GEngine->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
         TEXT("NavGrid GetNodeFromPosition - Node is still blocked"));
 #endif
     if (ClosestNode.blocked)
@@ -470,6 +669,45 @@ FVector AHeightNavigationVolume::GetWorldPositionFromNode(FNavNode node) const
     return startPos + x + y + z + GetActorLocation();
 }
 
+FVector AHeightNavigationVolume::GetGridPositionFromWorld(const FVector& position) const
+{
+    const FVector delta = position - GetWorldPositionFromGridPosition(FVector::ZeroVector);
+    return FVector(FVector::DotProduct(delta, GetActorForwardVector()),
+        FVector::DotProduct(delta, GetActorRightVector()),
+        FVector::DotProduct(delta, GetActorUpVector())) / distanceBetweenNodes;
+}
+
+FVector AHeightNavigationVolume::GetWorldPositionFromGridPosition(const FVector& gridPosition) const
+{
+    const FVector extents = GetExtents();
+    const FVector startPos = -(GetActorForwardVector() * extents.X + GetActorRightVector() * extents.Y + GetActorUpVector() * extents.Z);
+
+    return startPos + GetActorLocation() + (GetActorForwardVector() * gridPosition.X
+        + GetActorRightVector() * gridPosition.Y
+        + GetActorUpVector() * gridPosition.Z) * distanceBetweenNodes;
+}
+
+bool AHeightNavigationVolume::IsOverlappingGeometry(const FVector& center, const FVector& extent)
+{
+    TArray<AActor*> CollidingActors;
+    return UKismetSystemLibrary::BoxOverlapActors(this, center, extent, { ObjectTypeQuery1, ObjectTypeQuery2 }, nullptr, { this }, CollidingActors);
+}
+
+bool AHeightNavigationVolume::IsConnectionFree(const FVector& start, const FVector& end) const
+{
+    FCollisionQueryParams traceParams = FCollisionQueryParams(FName(TEXT("trace")), true, this);
+    traceParams.bTraceComplex = true;
+    traceParams.bReturnPhysicalMaterial = false;
+    traceParams.bFindInitialOverlaps = false;
+    FHitResult result(ForceInit);
+    FHitResult resultReversed(ForceInit);
+
+    GetWorld()->LineTraceSingleByChannel(result, start, end, ECC_WorldStatic, traceParams);
+    GetWorld()->LineTraceSingleByChannel(resultReversed, end, start, ECC_WorldStatic, traceParams);
+
+    return !result.bBlockingHit && !resultReversed.bBlockingHit;
+}
+
 FVector AHeightNavigationVolume::GetGridSize() const
 {
     return FVector(xNodes, yNodes, zNodes);
@@ -478,7 +716,53 @@ FVector AHeightNavigationVolume::GetGridSize() const
 void AHeightNavigationVolume::BeginPlay()
 {
     Super::BeginPlay();
+
+    if (streamNavigationData)
+    {
+        {
+            FWriteScopeLock writeLock(gridLock);
+            InitializeNodeCount();
+        }
+        if (gridStreaming.Start(*this, coarseLayer, streamingBudgetMB))
+        {
+            ApplyCostVolumes();
+            return;
+        }
+        UE_LOG(LogTemp, Warning, TEXT("%s - No navigation chunks baked for the current size, generating the grid instead"), *GetName());
+    }
+    GenerateNavNodeGrid();
+}
+
+void AHeightNavigationVolume::EndPlay(const EEndPlayReason::Type endPlayReason)
+{
+    gridStreaming.Stop();
+    Super::EndPlay(endPlayReason);
+}
+
+void AHeightNavigationVolume::BakeNavigationChunks()
+{
     GenerateNavNodeGrid();
+
+    FNavGridCoarseLayer layer;
+    if (!FNavGridStreaming::Bake(*this, layer))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s - Baking the navigation chunks failed"), *GetName());
+        return;
+    }
+    Modify();
+    coarseLayer = MoveTemp(layer);
+}
+
+void AHeightNavigationVolume::InitializeStreamedGrid()
+{
+    FWriteScopeLock writeLock(gridLock);
+    ClearGridTables();
+    clearanceField.Empty();
+
+    //Saved tables belong to the full grid
+    landmarks.Empty();
+    landmarkDistances.Empty();
+    startPosition = GetWorldPositionFromGridPosition(FVector::ZeroVector);
 }
 
 AHeightNavigationVolume* AHeightNavigationVolume::EvaluateNavGrid(UObject* WorldContext, FVector StartPosition, FVector EndPosition)
@@ -507,17 +791,40 @@ FVector AHeightNavigationVolume::GetExtents() const
 
 bool AHeightNavigationVolume::IsGridEmpty() const
 {
+    if (!nodeFlags.IsEmpty() || compressedGrid.IsBuilt() || gridStreaming.IsActive()) return false;
     if (navNodeGrid.IsEmpty()) return true;
     if (navNodeGrid[0].yLayer.IsEmpty()) return true;
     if (navNodeGrid[0].yLayer[0].zLayer.IsEmpty()) return true;
     return false;
 }
 
+FIntVector AHeightNavigationVolume::CalculateNodeCount() const
+{
+    return FIntVector(int((GetExtents().X * 2) / distanceBetweenNodes) + 1,
+        int((GetExtents().Y * 2) / distanceBetweenNodes) + 1,
+        int((GetExtents().Z * 2) / distanceBetweenNodes) + 1);
+}
+
 void AHeightNavigationVolume::InitializeNodeCount()
 {
-    xNodes = int((GetExtents().X * 2) / distanceBetweenNodes) + 1;
-    yNodes = int((GetExtents().Y * 2) / distanceBetweenNodes) + 1;
-    zNodes = int((GetExtents().Z * 2) / distanceBetweenNodes) + 1;
+    const FIntVector oldCount(xNodes, yNodes, zNodes);
+    const ENodeLayout oldLayout = tableLayout;
+
+    const FIntVector nodeCount = CalculateNodeCount();
+    xNodes = nodeCount.X;
+    yNodes = nodeCount.Y;
+    zNodes = nodeCount.Z;
+    tableLayout = nodeLayout;
+
+    //Painted costs belong to the cells and survive regeneration, unless the cells are different ones now
+    if (oldCount == FIntVector(xNodes, yNodes, zNodes) && oldLayout == tableLayout) return;
+    bool painted = false;
+    for (TArray<uint8>& costs : costLayers)
+    {
+        painted |= !costs.IsEmpty();
+        costs.Empty();
+    }
+    if (painted) UE_LOG(LogTemp, Warning, TEXT("%s - The node count or layout changed, the painted costs got cleared"), *GetName());
 }
 
 FVector AHeightNavigationVolume::GetRandomMovablePosition() const
@@ -531,9 +838,9 @@ FVector AHeightNavigationVolume::GetRandomMovablePosition() const
         {
             for(int z = 0; z < zNodes; z++)
             {
-                if(!navNodeGrid[x][y][z].blocked)
+                if(!IsNodeBlocked(x, y, z))
                 {
-                    possibleSpots.Add(GetWorldPositionFromNode(navNodeGrid[x][y][z]));
+                    possibleSpots.Add(GetWorldPositionFromGridPosition(FVector(x, y, z)));
                 }
             }
         }
@@ -543,193 +850,966 @@ FVector AHeightNavigationVolume::GetRandomMovablePosition() const
     return possibleSpots[i];
 }
 
-float AHeightNavigationVolume::CalculateH(float x, float y, float z, FNavNode goal)
+float AHeightNavigationVolume::CalculateH(float x, float y, float z, FNavNode goal) const
 {
     float h = float(abs(x - goal.X) + abs(y - goal.Y) + abs(z - goal.Z));
     //float h = sqrt(pow(x - goal.X, 2) + pow(y - goal.Y, 2) + pow(z - goal.Z, 2));
+
+    if (!useLandmarkHeuristic || landmarkDistances.IsEmpty()) return h;
+
+    //Triangle inequality: the path from node to goal can't be shorter than the difference of their distances to a landmark.
+    //Connections are only made when the traces in both directions are free, so the distances are symmetric
+    const int nodeCount = GetNodeCount();
+    const int nodeIndex = GetNodeIndex(int(x), int(y), int(z));
+    const int goalIndex = GetNodeIndex(goal.X, goal.Y, goal.Z);
+    for (int i = 0; i < landmarks.Num(); i++)
+    {
+        const uint16 nodeDistance = landmarkDistances[i * nodeCount + nodeIndex];
+        const uint16 goalDistance = landmarkDistances[i * nodeCount + goalIndex];
+        if (nodeDistance == MAX_uint16 || goalDistance == MAX_uint16) continue;
+
+        h = FMath::Max(h, float(FMath::Abs(int(nodeDistance) - int(goalDistance))));
+    }
     return h;
 }
 
-bool AHeightNavigationVolume::IsInsideVolume(FVector position) const
+int AHeightNavigationVolume::GetNodeIndex(int x, int y, int z) const
 {
-    TArray<float> angles = TArray<float>();
+    if (tableLayout == ENodeLayout::Linear) return (x * yNodes + y) * zNodes + z;
 
-    FVector directionTarget = position - endPosition;
-    directionTarget.Normalize();
-
-    float angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(-GetActorForwardVector(), directionTarget)));
-    angles.Add(angle);
-    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(-GetActorRightVector(), directionTarget)));
-    angles.Add(angle);
-    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(-GetActorUpVector(), directionTarget)));
-    angles.Add(angle);
+    const int brick = ((x >> brickShift) * GetBrickCount(yNodes) + (y >> brickShift)) * GetBrickCount(zNodes) + (z >> brickShift);
+    const int local = mortonSpread[x & (brickSize - 1)] << 2 | mortonSpread[y & (brickSize - 1)] << 1 | mortonSpread[z & (brickSize - 1)];
+    return brick << brickNodeShift | local;
+}
 
-    //Bottom most corner
-    directionTarget = position - startPosition;
-    directionTarget.Normalize();
+int AHeightNavigationVolume::GetNodeCount() const
+{
+    if (tableLayout == ENodeLayout::Linear) return xNodes * yNodes * zNodes;
+    return (GetBrickCount(xNodes) * GetBrickCount(yNodes) * GetBrickCount(zNodes)) << brickNodeShift;
+}
 
-    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(GetActorForwardVector(), directionTarget)));
-    angles.Add(angle);
-    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(GetActorRightVector(), directionTarget)));
-    angles.Add(angle);
-    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(GetActorUpVector(), directionTarget)));
-    angles.Add(angle);
+int AHeightNavigationVolume::GetNeighborIndex(int index, const FIntVector& position, int direction) const
+{
+    const int axis = direction >> 1;
+    const bool negative = (direction & 1) != 0;
+    if (tableLayout == ENodeLayout::Linear)
+    {
+        const int strides[3] = { yNodes * zNodes, zNodes, 1 };
+        return negative ? index - strides[axis] : index + strides[axis];
+    }
 
-    for (auto it : angles)
+    //Leaving the brick, the neighbor is in another brick
+    const int local = position[axis] & (brickSize - 1);
+    if (negative ? local == 0 : local == brickSize - 1)
     {
-        if (it > 90 || it < 0) return false;
+        const FIntVector neighbor = position + neighborOffsets[direction];
+        return GetNodeIndex(neighbor.X, neighbor.Y, neighbor.Z);
     }
-    return true;
-}
 
+    //Counts up or down in the bits of one axis, the carry skips over the bits of the other axes
+    const int mask = mortonAxisMasks[axis];
+    const int bits = negative ? ((index & mask) - 1) & mask : ((index | ~mask) + 1) & mask;
+    return (index & ~mask) | bits;
+}
 
-//The Algorithm
-void AHeightNavigationVolume::GetPath(FVector startPos, AActor* startActor, FVector goalPos, AActor* goalActor, Get_Success& ReturnValue, TArray<FVector>& path)
+void AHeightNavigationVolume::GenerateLandmarks()
 {
-    ReturnValue = Get_Success::Failed;
-    path.Empty();
     if (IsGridEmpty()) return;
 
-    FNavNode startNode = FNavNode();
-    FNavNode goalNode = FNavNode();
+    const int nodeCount = GetNodeCount();
+    //The tables are in GetNodeIndex order, so they only fit the layout they were generated with
+    const uint32 gridHash = HashCombine(CalculateGridHash(), uint32(tableLayout));
+
+    //Tables that were generated in the editor and saved with the volume are still valid
+    if (gridHash == landmarkGridHash && landmarks.Num() == landmarkCount && landmarkDistances.Num() == landmarkCount * nodeCount)
+    {
+        UE_LOG(LogTemp, Log, TEXT("%s - Reusing saved landmark tables (%d landmarks, %.2f MB)"),
+            *GetName(), landmarks.Num(), landmarkDistances.GetAllocatedSize() / (1024.f * 1024.f));
+        return;
+    }
 
-    TArray<F_YLayer> grid = navNodeGrid;
+    //Built aside, searches keep using the current tables (or none) until the new ones are complete
+    TArray<FIntVector> newLandmarks;
+    TArray<uint16> newLandmarkDistances;
 
-    //Setup Start Node
+    FIntVector seed = FIntVector(-1);
+    for (int x = 0; x < xNodes && seed.X < 0; x++)
     {
-        if (startActor != nullptr)
+        for (int y = 0; y < yNodes && seed.X < 0; y++)
         {
-            startNode = GetNodeFromPosition(startActor->GetActorLocation(), grid);
+            for (int z = 0; z < zNodes; z++)
+            {
+                if (!IsNodeBlocked(x, y, z))
+                {
+                    seed = FIntVector(x, y, z);
+                    break;
+                }
+            }
         }
-        else if (!startPos.IsZero())
+    }
+    if (seed.X < 0) return;
+
+    //Farthest point sampling, every landmark is the node with the greatest distance to all previous ones.
+    //The first one is picked as the farthest node from an arbitrary free node
+    TArray<uint16> distances;
+    TArray<uint16> closestLandmarkDistance;
+    CalculateDistancesFromNode(seed.X, seed.Y, seed.Z, closestLandmarkDistance);
+
+    newLandmarkDistances.Reserve(landmarkCount * nodeCount);
+    for (int i = 0; i < landmarkCount; i++)
+    {
+        int bestIndex = INDEX_NONE;
+        uint16 bestDistance = 0;
+        for (int j = 0; j < nodeCount; j++)
         {
-            startNode = GetNodeFromPosition(startPos, grid);
+            if (closestLandmarkDistance[j] == MAX_uint16) continue;
+            if (bestIndex == INDEX_NONE || closestLandmarkDistance[j] > bestDistance)
+            {
+                bestIndex = j;
+                bestDistance = closestLandmarkDistance[j];
+            }
         }
-        else
+        //Every reachable node is already a landmark
+        if (bestIndex == INDEX_NONE || (i > 0 && bestDistance == 0)) break;
+
+        const FIntVector landmark = GetNodeCoordinates(bestIndex);
+        CalculateDistancesFromNode(landmark.X, landmark.Y, landmark.Z, distances);
+        newLandmarks.Add(landmark);
+        newLandmarkDistances.Append(distances);
+
+        for (int j = 0; j < nodeCount; j++)
         {
-            return;
+            closestLandmarkDistance[j] = i == 0 ? distances[j] : FMath::Min(closestLandmarkDistance[j], distances[j]);
         }
     }
-    if (!IsValid(startNode)) return;
-    if (!IsUnblocked(startNode)) return;
 
-    //Setup Goal Node
+    FWriteScopeLock writeLock(gridLock);
+    landmarks = MoveTemp(newLandmarks);
+    landmarkDistances = MoveTemp(newLandmarkDistances);
+    landmarkGridHash = gridHash;
+
+    UE_LOG(LogTemp, Log, TEXT("%s - Generated %d landmarks for %d nodes, tables use %.2f MB"),
+        *GetName(), landmarks.Num(), nodeCount, landmarkDistances.GetAllocatedSize() / (1024.f * 1024.f));
+}
+
+void AHeightNavigationVolume::CalculateDistancesFromNode(int x, int y, int z, TArray<uint16>& distances)
+{
+    distances.Init(MAX_uint16, GetNodeCount());
+    if (!IsValid(x, y, z)) return;
+
+    TArray<int> queue;
+    queue.Reserve(GetNodeCount());
+    queue.Add(GetNodeIndex(x, y, z));
+    distances[queue[0]] = 0;
+
+    for (int head = 0; head < queue.Num(); head++)
     {
-        if (goalActor != nullptr)
-        {
-            goalNode = GetNodeFromPosition(goalActor->GetActorLocation(), grid);
-        }
-        else if (!goalPos.IsZero())
+        const int index = queue[head];
+        const FIntVector position = GetNodeCoordinates(index);
+        const uint8 connections = GetConnectionMask(position.X, position.Y, position.Z);
+        //Clamped below MAX_uint16, a smaller distance still keeps the heuristic admissible
+        const uint16 nextDistance = uint16(FMath::Min(int(distances[index]) + 1, MAX_uint16 - 1));
+
+        for (int direction = 0; direction < 6; direction++)
         {
-            goalNode = GetNodeFromPosition(goalPos, grid);
+            if (!(connections & (1 << direction))) continue;
+            const int neighborIndex = GetNeighborIndex(index, position, direction);
+            if (distances[neighborIndex] != MAX_uint16) continue;
+            distances[neighborIndex] = nextDistance;
+            queue.Add(neighborIndex);
         }
-        else
+    }
+}
+
+uint32 AHeightNavigationVolume::CalculateGridHash() const
+{
+    uint32 hash = FCrc::MemCrc32(&xNodes, sizeof(xNodes));
+    hash = FCrc::MemCrc32(&yNodes, sizeof(yNodes), hash);
+    hash = FCrc::MemCrc32(&zNodes, sizeof(zNodes), hash);
+
+    for (int x = 0; x < xNodes; x++)
+    {
+        for (int y = 0; y < yNodes; y++)
         {
-            return;
+            for (int z = 0; z < zNodes; z++)
+            {
+                //The whole mask, moving an edge without changing the edge count has to change the hash too
+                const uint8 flags = GetNodeFlags(x, y, z);
+                hash = FCrc::MemCrc32(&flags, sizeof(flags), hash);
+            }
         }
     }
-    if (!IsValid(goalNode)) return;
-    if (!IsUnblocked(goalNode)) return;
-    if (IsDestination(startNode, goalNode))
+    return hash;
+}
+
+void AHeightNavigationVolume::ReportLandmarkSavings()
+{
+    if (IsGridEmpty() || landmarkDistances.IsEmpty())
     {
-        path.Add(goalPos);
-        ReturnValue = Get_Success::Success;
+        UE_LOG(LogTemp, Warning, TEXT("%s - Generate the grid with useLandmarkHeuristic enabled first"), *GetName());
         return;
     }
 
-    //Setting up three-dimensional vectors with non constant size
-    std::vector<std::vector<std::vector<bool>>> closedListBool = std::vector<std::vector<std::vector<bool>>>();
+    const bool usedLandmarks = useLandmarkHeuristic;
+    const int queries = 32;
+    int64 expansionsManhattan = 0;
+    int64 expansionsLandmarks = 0;
+    int foundPaths = 0;
 
-    closedListBool.reserve(xNodes);
+    FRandomStream random(1337);
+    TArray<FVector> freePositions;
     for (int x = 0; x < xNodes; x++)
     {
-        closedListBool.push_back(std::vector<std::vector<bool>>());
-        closedListBool[x].reserve(yNodes);
         for (int y = 0; y < yNodes; y++)
         {
-            closedListBool[x].push_back(std::vector<bool>());
-            closedListBool[x][y].reserve(zNodes);
             for (int z = 0; z < zNodes; z++)
             {
-                closedListBool[x][y].push_back(bool());
-                closedListBool[x][y][z] = false;
+                if (!IsNodeBlocked(x, y, z)) freePositions.Add(GetWorldPositionFromGridPosition(FVector(x, y, z)));
             }
         }
     }
+    if (freePositions.Num() < 2) return;
 
-    std::priority_queue<FNavNode> openQueue = std::priority_queue<FNavNode>();
+    for (int i = 0; i < queries; i++)
+    {
+        const FVector start = freePositions[random.RandHelper(freePositions.Num())];
+        const FVector goal = freePositions[random.RandHelper(freePositions.Num())];
+        Get_Success success = Get_Success::Failed;
+        TArray<FVector> path;
+
+        useLandmarkHeuristic = false;
+        GetPath(start, nullptr, goal, nullptr, success, path);
+        if (success != Get_Success::Success) continue;
+        const int manhattan = lastSearchExpansions;
+
+        useLandmarkHeuristic = true;
+        GetPath(start, nullptr, goal, nullptr, success, path);
+        if (success != Get_Success::Success) continue;
+
+        expansionsManhattan += manhattan;
+        expansionsLandmarks += lastSearchExpansions;
+        foundPaths++;
+    }
+    useLandmarkHeuristic = usedLandmarks;
 
-    int x = startNode.X;
-    int y = startNode.Y;
-    int z = startNode.Z;
+    if (foundPaths == 0) return;
+    UE_LOG(LogTemp, Log, TEXT("%s - Landmarks: %d, table memory %.2f MB. Average expansions over %d paths: manhattan %.1f, landmarks %.1f (%.1f%% saved)"),
+        *GetName(), landmarks.Num(), landmarkDistances.GetAllocatedSize() / (1024.f * 1024.f), foundPaths,
+        double(expansionsManhattan) / foundPaths, double(expansionsLandmarks) / foundPaths,
+        expansionsManhattan > 0 ? 100.0 * (1.0 - double(expansionsLandmarks) / expansionsManhattan) : 0.0);
+}
 
-    grid[x][y][z].fCost = 0;
-    grid[x][y][z].gCost = 0;
-    grid[x][y][z].hCost = 0;
-    grid[x][y][z].parentX = x;
-    grid[x][y][z].parentY = y;
-    grid[x][y][z].parentZ = z;
+bool AHeightNavigationVolume::IsInsideVolume(FVector position) const
+{
+    TArray<float> angles = TArray<float>();
 
-    openQueue.push(grid[x][y][z]);
+    FVector directionTarget = position - endPosition;
+    directionTarget.Normalize();
 
+    float angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(-GetActorForwardVector(), directionTarget)));
+    angles.Add(angle);
+    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(-GetActorRightVector(), directionTarget)));
+    angles.Add(angle);
+    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(-GetActorUpVector(), directionTarget)));
+    angles.Add(angle);
 
-    //steps = 0;
-    while (!openQueue.empty())
-    {
-        //steps++;
-        FNavNode currentNode = openQueue.top();
-        openQueue.pop();
+    //Bottom most corner
+    directionTarget = position - startPosition;
+    directionTarget.Normalize();
 
-        x = currentNode.X;
-        y = currentNode.Y;
-        z = currentNode.Z;
+    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(GetActorForwardVector(), directionTarget)));
+    angles.Add(angle);
+    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(GetActorRightVector(), directionTarget)));
+    angles.Add(angle);
+    angle = UKismetMathLibrary::RadiansToDegrees(acos(UE::Geometry::Dot(GetActorUpVector(), directionTarget)));
+    angles.Add(angle);
+
+    for (auto it : angles)
+    {
+        if (it > 90 || it < 0) return false;
+    }
+    return true;
+}
+
+
+//The Algorithm
+void AHeightNavigationVolume::GetPath(FVector startPos, AActor* startActor, FVector goalPos, AActor* goalActor, Get_Success& ReturnValue, TArray<FVector>& path, float agentRadius)
+{
+    GetPathWithCosts(startPos, startActor, goalPos, goalActor, FNavCostProfile(), ReturnValue, path, agentRadius);
+}
+
+void AHeightNavigationVolume::GetPathWithCosts(FVector startPos, AActor* startActor, FVector goalPos, AActor* goalActor, const FNavCostProfile& costProfile, Get_Success& ReturnValue, TArray<FVector>& path, float agentRadius)
+{
+    ReturnValue = Get_Success::Failed;
+    path.Empty();
+
+    //A zero position only counts when there is no actor
+    if (startActor == nullptr && startPos.IsZero()) return;
+    if (goalActor == nullptr && goalPos.IsZero()) return;
+    const FVector start = startActor != nullptr ? startActor->GetActorLocation() : startPos;
+    const FVector goal = goalActor != nullptr ? goalActor->GetActorLocation() : goalPos;
+
+    FReadScopeLock readLock(gridLock);
+    if (IsGridEmpty()) return;
+
+    //Paths can be requested from worker threads, the debug stats are only written back on the game thread
+    int expansions = 0;
+    int lineOfSightChecks = 0;
+    TArray<int> expandedNodes;
+    TArray<int>* heatNodes = recordSearchHeat ? &expandedNodes : nullptr;
+    ON_SCOPE_EXIT
+    {
+        if (heatNodes) RecordSearchHeat(expandedNodes);
+        if (!IsInGameThread()) return;
+        lastSearchExpansions = expansions;
+        lastSearchLineOfSightChecks = lineOfSightChecks;
+    };
+
+    TUniquePtr<FPathSearchScratch> scratch = AcquireSearchScratch();
+    ReturnValue = FindPath(start, goal, agentRadius, *scratch, path, expansions, lineOfSightChecks, heatNodes, &costProfile);
+    ReleaseSearchScratch(MoveTemp(scratch));
+}
+
+void AHeightNavigationVolume::GetPaths(TConstArrayView<FNavPathQuery> queries, TArray<FNavPathQueryResult>& results)
+{
+    results.Reset();
+    results.SetNum(queries.Num());
+    if (queries.IsEmpty()) return;
+
+    FReadScopeLock readLock(gridLock);
+    if (IsGridEmpty()) return;
 
-        closedListBool[currentNode.X][currentNode.Y][currentNode.Z] = true;
+    //One search state per worker, allocated once for the whole batch
+    TArray<FPathSearchScratch> scratches;
+    ParallelForWithTaskContext(scratches, queries.Num(), [this, queries, &results](FPathSearchScratch& scratch, int32 i)
+    {
+        int expansions = 0;
+        int lineOfSightChecks = 0;
+        TArray<int> expandedNodes;
+        TArray<int>* heatNodes = recordSearchHeat ? &expandedNodes : nullptr;
+
+        const FNavPathQuery& query = queries[i];
+        results[i].result = FindPath(query.start, query.goal, query.agentRadius, scratch, results[i].path, expansions, lineOfSightChecks, heatNodes, &query.costProfile);
+        if (heatNodes) RecordSearchHeat(expandedNodes);
+    });
+}
+
+void AHeightNavigationVolume::GetPathsBatch(UObject* WorldContext, const TArray<FNavPathQuery>& queries, TArray<FNavPathQueryResult>& results)
+{
+    results.Reset();
+    results.SetNum(queries.Num());
 
-        float gNew, hNew, fNew;
+    TArray<AActor*> possibleVolumes;
+    UGameplayStatics::GetAllActorsOfClass(WorldContext, StaticClass(), possibleVolumes);
 
-        for(auto neighbor : currentNode.neighbors)
+    //Query indices of every volume, in the order EvaluateNavGrid would pick them
+    TMap<AHeightNavigationVolume*, TArray<int>> groups;
+    for (int i = 0; i < queries.Num(); i++)
+    {
+        for (AActor* actor : possibleVolumes)
         {
-            if(IsValid(neighbor.X, neighbor.Y, neighbor.Z))
+            AHeightNavigationVolume* volume = Cast<AHeightNavigationVolume>(actor);
+            if (volume->IsInsideVolume(queries[i].start) && volume->IsInsideVolume(queries[i].goal))
             {
-                if (IsDestination(neighbor.X, neighbor.Y, neighbor.Z, goalNode))
-                {
-                    grid[neighbor.X][neighbor.Y][neighbor.Z].parentX = currentNode.X;
-                    grid[neighbor.X][neighbor.Y][neighbor.Z].parentY = currentNode.Y;
-                    grid[neighbor.X][neighbor.Y][neighbor.Z].parentZ = currentNode.Z;
-                    path = TracePath(grid, goalNode);
-                    if (goalActor != nullptr)
-                    {
-                        path.Emplace(goalActor->GetActorLocation());
-                    }
-                    else if (&goalPos != nullptr)
-                    {
-                        path.Emplace(goalPos);
-                    }
-                    ReturnValue = Get_Success::Success;
-                    return;
-                }
-                if (closedListBool[neighbor.X][neighbor.Y][neighbor.Z] == false)
-                {
-                    gNew = grid[currentNode.X][currentNode.Y][currentNode.Z].gCost + 1.0f;
-                    hNew = CalculateH(neighbor.X, neighbor.Y, neighbor.Z, goalNode);
-                    fNew = gNew + hNew;
-                    if (grid[neighbor.X][neighbor.Y][neighbor.Z].fCost == FLT_MAX || grid[neighbor.X][neighbor.Y][neighbor.Z].fCost > fNew)
-                    {
-                        grid[neighbor.X][neighbor.Y][neighbor.Z].fCost = fNew;
-                        grid[neighbor.X][neighbor.Y][neighbor.Z].gCost = gNew;
-                        grid[neighbor.X][neighbor.Y][neighbor.Z].hCost = hNew;
-                        grid[neighbor.X][neighbor.Y][neighbor.Z].parentX = currentNode.X;
-                        grid[neighbor.X][neighbor.Y][neighbor.Z].parentY = currentNode.Y;
-                        grid[neighbor.X][neighbor.Y][neighbor.Z].parentZ = currentNode.Z;
-
-                        openQueue.push(grid[neighbor.X][neighbor.Y][neighbor.Z]);
-                    }
-                }
+                groups.FindOrAdd(volume).Add(i);
+                break;
+            }
+        }
+    }
+
+    TArray<FNavPathQuery> groupQueries;
+    TArray<FNavPathQueryResult> groupResults;
+    for (const TPair<AHeightNavigationVolume*, TArray<int>>& group : groups)
+    {
+        groupQueries.Reset();
+        for (const int i : group.Value) groupQueries.Add(queries[i]);
+
+        group.Key->GetPaths(groupQueries, groupResults);
+        for (int j = 0; j < group.Value.Num(); j++)
+        {
+            results[group.Value[j]] = MoveTemp(groupResults[j]);
+        }
+    }
+}
+
+Get_Success AHeightNavigationVolume::FindLocalPath(const FVector& start, const FVector& goal, float agentRadius, int maxExpansions, TArray<FVector>& path, const FNavCostProfile* costProfile)
+{
+    path.Reset();
+
+    FReadScopeLock readLock(gridLock);
+    if (IsGridEmpty() || gridStreaming.IsActive()) return Get_Success::Failed;
+
+    const FIntVector startNode = ResolveNode(start);
+    if (!IsUnblocked(startNode.X, startNode.Y, startNode.Z)) return Get_Success::Failed;
+    const FIntVector goalNode = ResolveNode(goal);
+    if (!IsUnblocked(goalNode.X, goalNode.Y, goalNode.Z)) return Get_Success::Failed;
+
+    const uint8 requiredClearance = GetRequiredClearance(agentRadius);
+    if (!HasClearance(goalNode.X, goalNode.Y, goalNode.Z, requiredClearance)) return Get_Success::Failed;
+
+    TArray<FIntVector> pathNodes;
+    if (startNode != goalNode)
+    {
+        int expansions = 0;
+        TUniquePtr<FPathSearchScratch> scratch = AcquireSearchScratch();
+        const bool found = FindPathAStar(startNode, goalNode, pathNodes, expansions, *scratch, requiredClearance, nullptr, costProfile, maxExpansions);
+        ReleaseSearchScratch(MoveTemp(scratch));
+        if (!found) return Get_Success::Failed;
+
+        //Same as FindPath, weighted paths keep their detours around the costly cells
+        if (smoothPaths && (costProfile == nullptr || !costProfile->IsWeighted())) SmoothPath(pathNodes, requiredClearance);
+    }
+
+    AppendWorldPath(pathNodes, path);
+    path.Add(goal);
+    return Get_Success::Success;
+}
+
+Get_Success AHeightNavigationVolume::FindPath(const FVector& start, const FVector& goal, float agentRadius, FPathSearchScratch& scratch, TArray<FVector>& path, int& expansions, int& lineOfSightChecks, TArray<int>* expandedNodes, const FNavCostProfile* costProfile)
+{
+    path.Reset();
+
+    //Start and goal can be inside of narrow passages that only exist in the finer levels,
+    //so the multi resolution grid resolves the positions to its own free leaves. Its leaves have no clearance and no cost layers,
+    //agents that don't fit into a finest cell and weighted queries search the regular grid with the clearance field.
+    //Endpoints without a free leaf close by get resolved by the regular grid instead, which looks further
+    const bool weighted = costProfile != nullptr && costProfile->IsWeighted();
+    if (resolutionLevels > 1 && multiResolutionGrid.IsBuilt() && !weighted && agentRadius * 2 <= multiResolutionGrid.GetFinestCellSize(*this)
+        && multiResolutionGrid.ResolveCell(*this, start) != INDEX_NONE && multiResolutionGrid.ResolveCell(*this, goal) != INDEX_NONE)
+    {
+        return multiResolutionGrid.FindPath(*this, start, goal, path, expansions) ? Get_Success::Success : Get_Success::Failed;
+    }
+
+    //Only searches when every chunk along the coarse route is resident, until then the route over the component anchors
+    //is returned, so agents can start moving while the chunks load. The route connects the components
+    //of the start and the goal, so the search finds a path inside of the resident chunks
+    if (gridStreaming.IsActive())
+    {
+        const FNavGridCoarseLayer& layer = gridStreaming.GetCoarseLayer();
+        const FIntVector startCoordinates = GetNodeCoordinatesFromWorld(start);
+        const FIntVector goalCoordinates = GetNodeCoordinatesFromWorld(goal);
+        TArray<int32> route;
+        if (!gridStreaming.FindRoute(startCoordinates, goalCoordinates, route)) return Get_Success::Failed;
+
+        if (!gridStreaming.RequestRoute(route))
+        {
+            //Linked components only share a chunk face, the straight line between their anchors can still cross a wall.
+            //Every segment needs a line of sight over the resident nodes (nodes of missing chunks are blocked),
+            //the pending path ends before the first one that can't be checked yet
+            const uint8 routeClearance = GetRequiredClearance(agentRadius);
+            FIntVector from = startCoordinates;
+            for (int i = 1; i < route.Num() - 1; i++)
+            {
+                const FIntVector& anchor = layer.Anchors[route[i]];
+                if (!HasLineOfSight(from, anchor, routeClearance)) return Get_Success::Pending;
+                path.Add(GetWorldPositionFromGridPosition(FVector(anchor)));
+                from = anchor;
+            }
+            if (HasLineOfSight(from, goalCoordinates, routeClearance)) path.Add(goal);
+            return Get_Success::Pending;
+        }
+    }
+
+    const FIntVector startNode = ResolveNode(start);
+    if (!IsUnblocked(startNode.X, startNode.Y, startNode.Z)) return Get_Success::Failed;
+    const FIntVector goalNode = ResolveNode(goal);
+    if (!IsUnblocked(goalNode.X, goalNode.Y, goalNode.Z)) return Get_Success::Failed;
+
+    //The start is exempt, the agent is already there. Agents up to a quarter of distanceBetweenNodes fit into every free
+    //node and get no clearance filter, above that up to 1.5 times distanceBetweenNodes they need nodes without walls around them
+    const uint8 requiredClearance = GetRequiredClearance(agentRadius);
+    if (!HasClearance(goalNode.X, goalNode.Y, goalNode.Z, requiredClearance)) return Get_Success::Failed;
+
+    if (startNode == goalNode)
+    {
+        path.Add(goal);
+        return Get_Success::Success;
+    }
+
+    TArray<FIntVector> pathNodes;
+
+    //Neither the path database nor Lazy Theta* know about the cost layers
+    if (weighted)
+    {
+        if (!FindPathAStar(startNode, goalNode, pathNodes, expansions, scratch, requiredClearance, expandedNodes, costProfile)) return Get_Success::Failed;
+    }
+    //Small volumes with a baked path database follow the stored first moves, no search at all
+    //Clearance 1 is every free node, so agents up to a quarter of distanceBetweenNodes can use it too
+    else if (usePathDatabase && requiredClearance <= 1 && pathDatabase.IsBound())
+    {
+        if (!pathDatabase.FindPath(*this, startNode, goalNode, pathNodes)) return Get_Success::Failed;
+
+        //String pulling gets close to the any angle paths of Lazy Theta*
+        if (smoothPaths || searchMode == EPathSearchMode::LazyThetaStar) lineOfSightChecks = SmoothPath(pathNodes);
+    }
+    else if (searchMode == EPathSearchMode::LazyThetaStar)
+    {
+        if (!FindPathLazyThetaStar(startNode, goalNode, pathNodes, expansions, lineOfSightChecks, scratch, requiredClearance, expandedNodes)) return Get_Success::Failed;
+    }
+    else
+    {
+        if (!FindPathAStar(startNode, goalNode, pathNodes, expansions, scratch, requiredClearance, expandedNodes)) return Get_Success::Failed;
+        if (smoothPaths) lineOfSightChecks = SmoothPath(pathNodes, requiredClearance);
+    }
+
+    AppendWorldPath(pathNodes, path);
+    path.Add(goal);
+    return Get_Success::Success;
+}
+
+void FPathSearchScratch::Prepare(int nodeCount)
+{
+    openList.Reset();
+    if (gCosts.Num() != nodeCount)
+    {
+        gCosts.Init(FLT_MAX, nodeCount);
+        parents.Init(INDEX_NONE, nodeCount);
+        closedList.Init(false, nodeCount);
+        touched.Reset();
+        return;
+    }
+
+    for (const int index : touched)
+    {
+        gCosts[index] = FLT_MAX;
+        parents[index] = INDEX_NONE;
+        closedList[index] = false;
+    }
+    touched.Reset();
+}
+
+bool AHeightNavigationVolume::FindPathAStar(const FIntVector& start, const FIntVector& goal, TArray<FIntVector>& pathNodes, int& expansions, FPathSearchScratch& scratch, uint8 requiredClearance, TArray<int>* expandedNodes, const FNavCostProfile* costProfile, int maxExpansions) const
+{
+    pathNodes.Reset();
+    scratch.Prepare(GetNodeCount());
+
+    FNavNode goalNode;
+    goalNode.X = goal.X;
+    goalNode.Y = goal.Y;
+    goalNode.Z = goal.Z;
+
+    const int startIndex = GetNodeIndex(start.X, start.Y, start.Z);
+    const int goalIndex = GetNodeIndex(goal.X, goal.Y, goal.Z);
+    scratch.gCosts[startIndex] = 0;
+    scratch.parents[startIndex] = startIndex;
+    scratch.touched.Add(startIndex);
+    scratch.openList.HeapPush({ 0.f, startIndex });
+
+    const bool weighted = costProfile != nullptr && costProfile->IsWeighted();
+    const int expansionLimit = maxExpansions > 0 ? expansions + maxExpansions : MAX_int32;
+    auto tracePath = [this, &scratch, &pathNodes, goalIndex]()
+    {
+        for (int index = goalIndex; ; index = scratch.parents[index])
+        {
+            pathNodes.Add(GetNodeCoordinates(index));
+            if (scratch.parents[index] == index) break;
+        }
+        Algo::Reverse(pathNodes);
+    };
+
+    while (!scratch.openList.IsEmpty())
+    {
+        FPathSearchScratch::FOpenEntry entry;
+        scratch.openList.HeapPop(entry, EAllowShrinking::No);
+        const int current = entry.index;
+
+        //Outdated entry of a node that got pushed again with a lower cost
+        if (scratch.closedList[current]) continue;
+        if (expansions >= expansionLimit) return false;
+        scratch.closedList[current] = true;
+        expansions++;
+        if (expandedNodes) expandedNodes->Add(current);
+
+        //Weighted searches only know the cheapest way to the goal once it gets expanded
+        if (current == goalIndex)
+        {
+            tracePath();
+            return true;
+        }
+
+        const FIntVector currentPos = GetNodeCoordinates(current);
+        const uint8 connections = GetConnectionMask(currentPos.X, currentPos.Y, currentPos.Z);
+        for (int direction = 0; direction < 6; direction++)
+        {
+            if (!(connections & (1 << direction))) continue;
+
+            const FIntVector neighbor = currentPos + GetNeighborOffset(direction);
+            const int neighborIndex = GetNeighborIndex(current, currentPos, direction);
+            if (neighborIndex == goalIndex && !weighted)
+            {
+                if (scratch.parents[goalIndex] == INDEX_NONE) scratch.touched.Add(goalIndex);
+                scratch.parents[goalIndex] = current;
+                tracePath();
+                return true;
+            }
+            if (scratch.closedList[neighborIndex] || !HasClearance(neighbor.X, neighbor.Y, neighbor.Z, requiredClearance)) continue;
+
+            const float gNew = scratch.gCosts[current] + (weighted ? GetTraversalCost(neighborIndex, *costProfile) : 1.0f);
+            if (gNew >= scratch.gCosts[neighborIndex]) continue;
+
+            if (scratch.parents[neighborIndex] == INDEX_NONE) scratch.touched.Add(neighborIndex);
+            scratch.gCosts[neighborIndex] = gNew;
+            scratch.parents[neighborIndex] = current;
+            scratch.openList.HeapPush({ gNew + CalculateH(neighbor.X, neighbor.Y, neighbor.Z, goalNode), neighborIndex });
+        }
+    }
+    return false;
+}
+
+void AHeightNavigationVolume::GetPathToNearest(FVector startPos, AActor* startActor, const TArray<FVector>& goalPositions, const TArray<AActor*>& goalActors, Get_Success& ReturnValue, TArray<FVector>& path, int& goalIndex, float agentRadius)
+{
+    ReturnValue = Get_Success::Failed;
+    path.Empty();
+    goalIndex = INDEX_NONE;
+
+    if (startActor == nullptr && startPos.IsZero()) return;
+    const FVector start = startActor != nullptr ? startActor->GetActorLocation() : startPos;
+
+    //Missing actors keep their slot, so goalIndex still matches the inputs
+    TArray<FVector> goals = goalPositions;
+    TBitArray<> validGoals(true, goalPositions.Num() + goalActors.Num());
+    for (int i = 0; i < goalActors.Num(); i++)
+    {
+        goals.Add(goalActors[i] != nullptr ? goalActors[i]->GetActorLocation() : FVector::ZeroVector);
+        validGoals[goalPositions.Num() + i] = goalActors[i] != nullptr;
+    }
+
+    FReadScopeLock readLock(gridLock);
+    if (IsGridEmpty()) return;
+
+    int expansions = 0;
+    int lineOfSightChecks = 0;
+    TArray<int> expandedNodes;
+    TArray<int>* heatNodes = recordSearchHeat ? &expandedNodes : nullptr;
+    ON_SCOPE_EXIT
+    {
+        if (heatNodes) RecordSearchHeat(expandedNodes);
+        if (!IsInGameThread()) return;
+        lastSearchExpansions = expansions;
+        lastSearchLineOfSightChecks = lineOfSightChecks;
+    };
+
+    //Only goals with a position get searched, goalSlots maps them back to the inputs
+    TArray<int> goalSlots;
+    TArray<FVector> validPositions;
+    for (int i = 0; i < goals.Num(); i++)
+    {
+        if (!validGoals[i]) continue;
+        goalSlots.Add(i);
+        validPositions.Add(goals[i]);
+    }
+
+    TUniquePtr<FPathSearchScratch> scratch = AcquireSearchScratch();
+    int reached = INDEX_NONE;
+    ReturnValue = FindPathToNearest(start, validPositions, agentRadius, *scratch, path, reached, expansions, lineOfSightChecks, heatNodes);
+    ReleaseSearchScratch(MoveTemp(scratch));
+    if (reached != INDEX_NONE) goalIndex = goalSlots[reached];
+}
+
+Get_Success AHeightNavigationVolume::FindPathToNearest(const FVector& start, TConstArrayView<FVector> goals, float agentRadius, FPathSearchScratch& scratch, TArray<FVector>& path, int& goalIndex, int& expansions, int& lineOfSightChecks, TArray<int>* expandedNodes)
+{
+    path.Reset();
+    goalIndex = INDEX_NONE;
+    if (goals.IsEmpty()) return Get_Success::Failed;
+
+    //The multi resolution and the streamed grid have their own searches, there it stays one search per goal
+    if ((resolutionLevels > 1 && multiResolutionGrid.IsBuilt()) || gridStreaming.IsActive())
+    {
+        Get_Success result = Get_Success::Failed;
+        double shortest = DBL_MAX;
+        TArray<FVector> goalPath;
+        for (int i = 0; i < goals.Num(); i++)
+        {
+            const Get_Success goalResult = FindPath(start, goals[i], agentRadius, scratch, goalPath, expansions, lineOfSightChecks, expandedNodes);
+            if (goalResult == Get_Success::Failed) continue;
+            //Found paths always win over coarse routes
+            if (result == Get_Success::Success && goalResult == Get_Success::Pending) continue;
+
+            double length = FVector::Distance(start, goalPath[0]);
+            for (int j = 1; j < goalPath.Num(); j++) length += FVector::Distance(goalPath[j - 1], goalPath[j]);
+            if (goalResult == result && length >= shortest) continue;
+
+            result = goalResult;
+            shortest = length;
+            goalIndex = i;
+            path = goalPath;
+        }
+        return result;
+    }
+
+    const FIntVector startNode = ResolveNode(start);
+    if (!IsUnblocked(startNode.X, startNode.Y, startNode.Z)) return Get_Success::Failed;
+
+    //Goals that are blocked or too narrow for the agent are left out, the indices still point into goals
+    const uint8 requiredClearance = GetRequiredClearance(agentRadius);
+    TArray<FIntVector> goalNodes;
+    TArray<int> goalSlots;
+    for (int i = 0; i < goals.Num(); i++)
+    {
+        const FIntVector goalNode = ResolveNode(goals[i]);
+        if (!IsUnblocked(goalNode.X, goalNode.Y, goalNode.Z) || !HasClearance(goalNode.X, goalNode.Y, goalNode.Z, requiredClearance)) continue;
+        if (goalNode == startNode)
+        {
+            goalIndex = i;
+            path.Add(goals[i]);
+            return Get_Success::Success;
+        }
+        goalNodes.Add(goalNode);
+        goalSlots.Add(i);
+    }
+    if (goalNodes.IsEmpty()) return Get_Success::Failed;
+
+    TArray<FIntVector> pathNodes;
+    int reachedGoal = INDEX_NONE;
+    if (!FindPathToNearestNode(startNode, goalNodes, pathNodes, reachedGoal, expansions, scratch, requiredClearance, expandedNodes)) return Get_Success::Failed;
+    goalIndex = goalSlots[reachedGoal];
+
+    if (smoothPaths || searchMode == EPathSearchMode::LazyThetaStar) lineOfSightChecks = SmoothPath(pathNodes, requiredClearance);
+    AppendWorldPath(pathNodes, path);
+    path.Add(goals[goalIndex]);
+    return Get_Success::Success;
+}
+
+bool AHeightNavigationVolume::FindPathToNearestNode(const FIntVector& start, TConstArrayView<FIntVector> goals, TArray<FIntVector>& pathNodes, int& reachedGoal, int& expansions, FPathSearchScratch& scratch, uint8 requiredClearance, TArray<int>* expandedNodes) const
+{
+    //Past this the heuristic costs more than the nodes it saves
+    const int maxHeuristicGoals = 8;
+
+    pathNodes.Reset();
+    reachedGoal = INDEX_NONE;
+    scratch.Prepare(GetNodeCount());
+
+    TMap<int, int> goalIndices;
+    TArray<FNavNode> goalNodes;
+    for (int i = 0; i < goals.Num(); i++)
+    {
+        goalIndices.FindOrAdd(GetNodeIndex(goals[i].X, goals[i].Y, goals[i].Z), i);
+
+        FNavNode goalNode;
+        goalNode.X = goals[i].X;
+        goalNode.Y = goals[i].Y;
+        goalNode.Z = goals[i].Z;
+        goalNodes.Add(goalNode);
+    }
+    if (goalNodes.Num() > maxHeuristicGoals) goalNodes.Empty();
+
+    //Minimum over the goals stays admissible, without goals it is 0 and the search a Dijkstra
+    auto heuristic = [this, &goalNodes](const FIntVector& node)
+    {
+        float h = goalNodes.IsEmpty() ? 0.f : FLT_MAX;
+        for (const FNavNode& goalNode : goalNodes)
+        {
+            h = FMath::Min(h, CalculateH(node.X, node.Y, node.Z, goalNode));
+        }
+        return h;
+    };
+
+    const int startIndex = GetNodeIndex(start.X, start.Y, start.Z);
+    scratch.gCosts[startIndex] = 0;
+    scratch.parents[startIndex] = startIndex;
+    scratch.touched.Add(startIndex);
+    scratch.openList.HeapPush({ heuristic(start), startIndex });
+
+    while (!scratch.openList.IsEmpty())
+    {
+        FPathSearchScratch::FOpenEntry entry;
+        scratch.openList.HeapPop(entry, EAllowShrinking::No);
+        const int current = entry.index;
+
+        if (scratch.closedList[current]) continue;
+        scratch.closedList[current] = true;
+        expansions++;
+        if (expandedNodes) expandedNodes->Add(current);
+
+        //Only the first goal that gets expanded is known to be the closest one
+        if (const int* goal = goalIndices.Find(current))
+        {
+            reachedGoal = *goal;
+            for (int index = current; ; index = scratch.parents[index])
+            {
+                pathNodes.Add(GetNodeCoordinates(index));
+                if (scratch.parents[index] == index) break;
             }
+            Algo::Reverse(pathNodes);
+            return true;
+        }
+
+        const FIntVector currentPos = GetNodeCoordinates(current);
+        const uint8 connections = GetConnectionMask(currentPos.X, currentPos.Y, currentPos.Z);
+        for (int direction = 0; direction < 6; direction++)
+        {
+            if (!(connections & (1 << direction))) continue;
+
+            const FIntVector neighbor = currentPos + GetNeighborOffset(direction);
+            const int neighborIndex = GetNeighborIndex(current, currentPos, direction);
+            if (scratch.closedList[neighborIndex] || !HasClearance(neighbor.X, neighbor.Y, neighbor.Z, requiredClearance)) continue;
+
+            const float gNew = scratch.gCosts[current] + 1.0f;
+            if (gNew >= scratch.gCosts[neighborIndex]) continue;
+
+            if (scratch.parents[neighborIndex] == INDEX_NONE) scratch.touched.Add(neighborIndex);
+            scratch.gCosts[neighborIndex] = gNew;
+            scratch.parents[neighborIndex] = current;
+            scratch.openList.HeapPush({ gNew + heuristic(neighbor), neighborIndex });
+        }
+    }
+    return false;
+}
+
+float FNavReachability::GetDistance(int nodeIndex) const
+{
+    const int i = Algo::BinarySearch(nodeIndices, nodeIndex);
+    return i == INDEX_NONE ? -1.f : steps[i] * distanceBetweenNodes;
+}
+
+void FNavReachability::Reset()
+{
+    nodeIndices.Reset();
+    steps.Reset();
+}
+
+TUniquePtr<FPathSearchScratch> AHeightNavigationVolume::AcquireSearchScratch() const
+{
+    {
+        FScopeLock lock(&searchScratchLock);
+        if (!searchScratchPool.IsEmpty()) return searchScratchPool.Pop(EAllowShrinking::No);
+    }
+    return MakeUnique<FPathSearchScratch>();
+}
+
+void AHeightNavigationVolume::ReleaseSearchScratch(TUniquePtr<FPathSearchScratch> scratch) const
+{
+    //Enough for the queries that run at the same time, more would only hold on to memory
+    const int maxPooledScratches = 8;
+
+    FScopeLock lock(&searchScratchLock);
+    if (searchScratchPool.Num() < maxPooledScratches) searchScratchPool.Add(MoveTemp(scratch));
+}
+
+bool AHeightNavigationVolume::CalculateReachability(const FVector& start, float maxDistance, float agentRadius, FNavReachability& reachability) const
+{
+    reachability.Reset();
+    reachability.distanceBetweenNodes = distanceBetweenNodes;
+    if (maxDistance < 0) return false;
+
+    FReadScopeLock readLock(gridLock);
+    if (IsGridEmpty()) return false;
+
+    const FIntVector startNode = ResolveNode(start);
+    const int maxSteps = FMath::Min(int(maxDistance / distanceBetweenNodes), MAX_uint16 - 1);
+
+    TUniquePtr<FPathSearchScratch> scratch = AcquireSearchScratch();
+    const bool found = FindReachableNodes(startNode, maxSteps, GetRequiredClearance(agentRadius), *scratch, reachability);
+    ReleaseSearchScratch(MoveTemp(scratch));
+    return found;
+}
+
+UE::Tasks::TTask<FNavReachability> AHeightNavigationVolume::LaunchReachability(const FVector& start, float maxDistance, float agentRadius) const
+{
+    return UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, start, maxDistance, agentRadius]
+    {
+        FNavReachability reachability;
+        CalculateReachability(start, maxDistance, agentRadius, reachability);
+        return reachability;
+    });
+}
+
+void AHeightNavigationVolume::GetReachablePositions(FVector startPos, AActor* startActor, float maxDistance, Get_Success& ReturnValue, TArray<FVector>& positions, TArray<float>& distances, float agentRadius) const
+{
+    ReturnValue = Get_Success::Failed;
+    positions.Empty();
+    distances.Empty();
+
+    if (startActor == nullptr && startPos.IsZero()) return;
+    FNavReachability reachability;
+    if (!CalculateReachability(startActor != nullptr ? startActor->GetActorLocation() : startPos, maxDistance, agentRadius, reachability)) return;
+
+    positions.Reserve(reachability.Num());
+    distances.Reserve(reachability.Num());
+    for (int i = 0; i < reachability.Num(); i++)
+    {
+        positions.Add(GetWorldPositionFromGridPosition(FVector(GetNodeCoordinates(reachability.nodeIndices[i]))));
+        distances.Add(reachability.steps[i] * distanceBetweenNodes);
+    }
+    ReturnValue = Get_Success::Success;
+}
+
+void AHeightNavigationVolume::FilterReachablePositions(FVector startPos, AActor* startActor, const TArray<FVector>& positions, float maxDistance, Get_Success& ReturnValue, TArray<int>& reachableIndices, TArray<float>& distances, float agentRadius) const
+{
+    ReturnValue = Get_Success::Failed;
+    reachableIndices.Empty();
+    distances.Empty();
+
+    if (startActor == nullptr && startPos.IsZero()) return;
+    FNavReachability reachability;
+    if (!CalculateReachability(startActor != nullptr ? startActor->GetActorLocation() : startPos, maxDistance, agentRadius, reachability)) return;
+
+    FReadScopeLock readLock(gridLock);
+    for (int i = 0; i < positions.Num(); i++)
+    {
+        const FIntVector node = ResolveNode(positions[i]);
+        if (!IsValid(node.X, node.Y, node.Z)) continue;
+
+        const float distance = reachability.GetDistance(GetNodeIndex(node.X, node.Y, node.Z));
+        if (distance < 0) continue;
+        reachableIndices.Add(i);
+        distances.Add(distance);
+    }
+    ReturnValue = Get_Success::Success;
+}
+
+bool AHeightNavigationVolume::FindReachableNodes(const FIntVector& start, int maxSteps, uint8 requiredClearance, FPathSearchScratch& scratch, FNavReachability& reachability) const
+{
+    reachability.Reset();
+    if (!IsUnblocked(start.X, start.Y, start.Z)) return false;
+    scratch.Prepare(GetNodeCount());
+
+    //Every step costs the same, so the touched list doubles as the queue of the breadth first search
+    const int startIndex = GetNodeIndex(start.X, start.Y, start.Z);
+    scratch.gCosts[startIndex] = 0;
+    scratch.parents[startIndex] = startIndex;
+    scratch.touched.Add(startIndex);
+
+    for (int head = 0; head < scratch.touched.Num(); head++)
+    {
+        const int current = scratch.touched[head];
+        const int steps = int(scratch.gCosts[current]);
+        if (steps >= maxSteps) continue;
+
+        const FIntVector currentPos = GetNodeCoordinates(current);
+        const uint8 connections = GetConnectionMask(currentPos.X, currentPos.Y, currentPos.Z);
+        for (int direction = 0; direction < 6; direction++)
+        {
+            if (!(connections & (1 << direction))) continue;
+
+            const FIntVector neighbor = currentPos + GetNeighborOffset(direction);
+            const int neighborIndex = GetNeighborIndex(current, currentPos, direction);
+            if (scratch.parents[neighborIndex] != INDEX_NONE || !HasClearance(neighbor.X, neighbor.Y, neighbor.Z, requiredClearance)) continue;
+
+            scratch.gCosts[neighborIndex] = float(steps + 1);
+            scratch.parents[neighborIndex] = current;
+            scratch.touched.Add(neighborIndex);
         }
     }
-    return;
+
+    reachability.nodeIndices = scratch.touched;
+    reachability.nodeIndices.Sort();
+    reachability.steps.Reserve(reachability.nodeIndices.Num());
+    for (const int index : reachability.nodeIndices)
+    {
+        reachability.steps.Add(uint16(scratch.gCosts[index]));
+    }
+    return true;
+}
+
+FIntVector AHeightNavigationVolume::ResolveNode(const FVector& position) const
+{
+    const FIntVector closest = GetNodeCoordinatesFromWorld(position);
+    if (IsUnblocked(closest.X, closest.Y, closest.Z)) return closest;
+
+    const FNavNode node = GetNodeFromPosition(position);
+    if (!IsValid(node) || node.blocked) return FIntVector(-1);
+    return FIntVector(node.X, node.Y, node.Z);
 }
 
 TArray<FVector> AHeightNavigationVolume::TracePath(TArray<F_YLayer> grid, FNavNode goalNode)
@@ -760,6 +1840,988 @@ TArray<FVector> AHeightNavigationVolume::TracePath(TArray<F_YLayer> grid, FNavNo
     return retVal;
 }
 
+bool AHeightNavigationVolume::IsConnected(int x, int y, int z, int neighborX, int neighborY, int neighborZ) const
+{
+    if (!IsValid(x, y, z) || !IsValid(neighborX, neighborY, neighborZ)) return false;
+    if (IsNodeBlocked(neighborX, neighborY, neighborZ)) return false;
+
+    const FIntVector offset(neighborX - x, neighborY - y, neighborZ - z);
+    for (int direction = 0; direction < 6; direction++)
+    {
+        if (offset == neighborOffsets[direction]) return (GetConnectionMask(x, y, z) & (1 << direction)) != 0;
+    }
+    return false;
+}
+
+bool AHeightNavigationVolume::HasLineOfSight(const FIntVector& from, const FIntVector& to, uint8 requiredClearance) const
+{
+    if (!IsValid(from.X, from.Y, from.Z) || !IsValid(to.X, to.Y, to.Z)) return false;
+
+    const FIntVector delta = to - from;
+    const int64 length[3] = { FMath::Abs(delta.X), FMath::Abs(delta.Y), FMath::Abs(delta.Z) };
+    const int step[3] = { FMath::Sign(delta.X), FMath::Sign(delta.Y), FMath::Sign(delta.Z) };
+
+    //Number of cell borders already crossed per axis. The line starts in the center of a cell, so the
+    //next border on axis i is at t = (2 * crossed[i] + 1) / (2 * length[i]). Comparing those fractions
+    //with integers keeps ties (line passing exactly through an edge or corner) exact
+    int64 crossed[3] = { 0, 0, 0 };
+    FIntVector current = from;
+
+    while (current != to)
+    {
+        //Find the axes with the closest border, there can be more than one on a tie
+        int closest[3];
+        int closestCount = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (crossed[axis] >= length[axis]) continue;
+            if (closestCount == 0)
+            {
+                closest[closestCount++] = axis;
+                continue;
+            }
+
+            const int best = closest[0];
+            const int64 lhs = (2 * crossed[axis] + 1) * length[best];
+            const int64 rhs = (2 * crossed[best] + 1) * length[axis];
+            if (lhs < rhs)
+            {
+                closestCount = 0;
+                closest[closestCount++] = axis;
+            }
+            else if (lhs == rhs)
+            {
+                closest[closestCount++] = axis;
+            }
+        }
+
+        //When the line runs through an edge or corner every cell touching it has to be free and connected.
+        //That is the square (edge) or cube (corner) spanned by the tied axes, 3 or 7 cells besides the current one,
+        //and every cell has to be connected to each of its neighbors inside of it
+        if (closestCount > 1)
+        {
+            for (int subset = 1; subset < (1 << closestCount); subset++)
+            {
+                FIntVector cell = current;
+                for (int i = 0; i < closestCount; i++)
+                {
+                    if (subset & (1 << i)) cell[closest[i]] += step[closest[i]];
+                }
+
+                for (int i = 0; i < closestCount; i++)
+                {
+                    if (!(subset & (1 << i))) continue;
+                    FIntVector previous = cell;
+                    previous[closest[i]] -= step[closest[i]];
+                    if (!IsConnected(previous.X, previous.Y, previous.Z, cell.X, cell.Y, cell.Z)) return false;
+                }
+                if (!HasClearance(cell.X, cell.Y, cell.Z, requiredClearance)) return false;
+            }
+        }
+
+        for (int i = 0; i < closestCount; i++)
+        {
+            FIntVector next = current;
+            next[closest[i]] += step[closest[i]];
+            if (!IsConnected(current.X, current.Y, current.Z, next.X, next.Y, next.Z)) return false;
+            if (!HasClearance(next.X, next.Y, next.Z, requiredClearance)) return false;
+            current = next;
+            crossed[closest[i]]++;
+        }
+    }
+    return true;
+}
+
+int AHeightNavigationVolume::SmoothPath(TArray<FIntVector>& pathNodes, uint8 requiredClearance) const
+{
+    if (pathNodes.Num() <= 2) return 0;
+    int lineOfSightChecks = 0;
+
+    TArray<FIntVector> smoothed = TArray<FIntVector>();
+    smoothed.Add(pathNodes[0]);
+
+    int anchor = 0;
+    for (int i = 2; i < pathNodes.Num(); i++)
+    {
+        lineOfSightChecks++;
+        if (HasLineOfSight(pathNodes[anchor], pathNodes[i], requiredClearance)) continue;
+
+        anchor = i - 1;
+        smoothed.Add(pathNodes[anchor]);
+    }
+    smoothed.Add(pathNodes.Last());
+
+    pathNodes = MoveTemp(smoothed);
+    return lineOfSightChecks;
+}
+
+void AHeightNavigationVolume::AppendWorldPath(const TArray<FIntVector>& pathNodes, TArray<FVector>& path) const
+{
+    path.Reserve(path.Num() + pathNodes.Num() + 1);
+    for (const FIntVector& pathNode : pathNodes)
+    {
+        FNavNode node;
+        node.X = pathNode.X;
+        node.Y = pathNode.Y;
+        node.Z = pathNode.Z;
+        path.Add(GetWorldPositionFromNode(node));
+    }
+}
+
+FIntVector AHeightNavigationVolume::GetNodeCoordinates(int index) const
+{
+    if (tableLayout == ENodeLayout::Linear) return FIntVector(index / (yNodes * zNodes), (index / zNodes) % yNodes, index % zNodes);
+
+    const int bricksY = GetBrickCount(yNodes);
+    const int bricksZ = GetBrickCount(zNodes);
+    const int brick = index >> brickNodeShift;
+    const FIntVector brickPosition(brick / (bricksY * bricksZ), (brick / bricksZ) % bricksY, brick % bricksZ);
+    return brickPosition * brickSize + FIntVector(CompactMortonBits(index >> 2), CompactMortonBits(index >> 1), CompactMortonBits(index));
+}
+
+//Lazy Theta* (Nash, Koenig, Tovey 2010)
+//Every node assumes it can see the parent of the node that expanded it. That assumption only gets checked once the
+//node itself is expanded, if there is no line of sight the best already closed neighbor becomes the parent instead.
+//Costs are euclidean distances in grid units, so the euclidean heuristic is admissible
+bool AHeightNavigationVolume::FindPathLazyThetaStar(const FIntVector& start, const FIntVector& goal, TArray<FIntVector>& pathNodes, int& expansions, int& lineOfSightChecks, FPathSearchScratch& scratch, uint8 requiredClearance, TArray<int>* expandedNodes) const
+{
+    pathNodes.Empty();
+    expansions = 0;
+    lineOfSightChecks = 0;
+    if (!IsValid(start.X, start.Y, start.Z) || !IsValid(goal.X, goal.Y, goal.Z)) return false;
+
+    //Same search state as A*, only the nodes the last query touched get reset. Open and unvisited nodes are never told
+    //apart, so the closed list is the only state there is
+    scratch.Prepare(GetNodeCount());
+    TArray<float>& gCosts = scratch.gCosts;
+    TArray<int>& parents = scratch.parents;
+
+    auto distance = [this](int from, int to)
+    {
+        return FVector(GetNodeCoordinates(from) - GetNodeCoordinates(to)).Length();
+    };
+
+    const int startIndex = GetNodeIndex(start.X, start.Y, start.Z);
+    const int goalIndex = GetNodeIndex(goal.X, goal.Y, goal.Z);
+
+    gCosts[startIndex] = 0;
+    parents[startIndex] = startIndex;
+    scratch.touched.Add(startIndex);
+    scratch.openList.HeapPush({ distance(startIndex, goalIndex), startIndex });
+
+    while (!scratch.openList.IsEmpty())
+    {
+        FPathSearchScratch::FOpenEntry entry;
+        scratch.openList.HeapPop(entry, EAllowShrinking::No);
+
+        //Outdated entry of a node that got pushed again with a lower cost
+        if (scratch.closedList[entry.index]) continue;
+        expansions++;
+        if (expandedNodes) expandedNodes->Add(entry.index);
+
+        const int current = entry.index;
+        const FIntVector currentPos = GetNodeCoordinates(current);
+        const uint8 connections = GetConnectionMask(currentPos.X, currentPos.Y, currentPos.Z);
+
+        //SetVertex, check the line of sight that got assumed when this node was opened
+        const int parent = parents[current];
+        if (parent != current)
+        {
+            //Path 2 can make a face neighbor the parent that isn't connected to this node, those only need the edge checked
+            const FIntVector parentPos = GetNodeCoordinates(parent);
+            bool visible;
+            if (FMath::Abs(distance(parent, current) - 1.0f) <= KINDA_SMALL_NUMBER)
+            {
+                visible = IsConnected(parentPos.X, parentPos.Y, parentPos.Z, currentPos.X, currentPos.Y, currentPos.Z)
+                    && HasClearance(currentPos.X, currentPos.Y, currentPos.Z, requiredClearance);
+            }
+            else
+            {
+                lineOfSightChecks++;
+                visible = HasLineOfSight(parentPos, currentPos, requiredClearance);
+            }
+
+            if (!visible)
+            {
+                gCosts[current] = FLT_MAX;
+                for (int direction = 0; direction < 6; direction++)
+                {
+                    if (!(connections & (1 << direction))) continue;
+                    const int neighborIndex = GetNeighborIndex(current, currentPos, direction);
+                    if (!scratch.closedList[neighborIndex]) continue;
+
+                    const float gNew = gCosts[neighborIndex] + 1.0f;
+                    if (gNew < gCosts[current])
+                    {
+                        gCosts[current] = gNew;
+                        parents[current] = neighborIndex;
+                    }
+                }
+            }
+        }
+
+        if (current == goalIndex)
+        {
+            for (int index = goalIndex; ; index = parents[index])
+            {
+                pathNodes.Add(GetNodeCoordinates(index));
+                if (parents[index] == index) break;
+            }
+            Algo::Reverse(pathNodes);
+            return true;
+        }
+        scratch.closedList[current] = true;
+
+        //UpdateVertex, path 2: connect the neighbor straight to our parent
+        const int currentParent = parents[current];
+        for (int direction = 0; direction < 6; direction++)
+        {
+            if (!(connections & (1 << direction))) continue;
+            const FIntVector neighbor = currentPos + neighborOffsets[direction];
+            const int neighborIndex = GetNeighborIndex(current, currentPos, direction);
+            if (scratch.closedList[neighborIndex]) continue;
+            if (IsNodeBlocked(neighbor.X, neighbor.Y, neighbor.Z)) continue;
+            if (!HasClearance(neighbor.X, neighbor.Y, neighbor.Z, requiredClearance)) continue;
+
+            const float gNew = gCosts[currentParent] + distance(currentParent, neighborIndex);
+            if (gNew < gCosts[neighborIndex])
+            {
+                if (gCosts[neighborIndex] == FLT_MAX) scratch.touched.Add(neighborIndex);
+                gCosts[neighborIndex] = gNew;
+                parents[neighborIndex] = currentParent;
+                scratch.openList.HeapPush({ gNew + distance(neighborIndex, goalIndex), neighborIndex });
+            }
+        }
+    }
+    return false;
+}
+
+void AHeightNavigationVolume::GenerateClearanceField()
+{
+    const int nodeCount = GetNodeCount();
+    clearanceField.Init(MAX_uint8, nodeCount);
+    if (IsGridEmpty()) return;
+
+    //Multi source breadth first search from every blocked node over all 26 neighbors, which results in the chebyshev distance
+    TArray<int> queue;
+    queue.Reserve(nodeCount);
+    for (int x = 0; x < xNodes; x++)
+    {
+        for (int y = 0; y < yNodes; y++)
+        {
+            for (int z = 0; z < zNodes; z++)
+            {
+                if (!IsNodeBlocked(x, y, z)) continue;
+                const int index = GetNodeIndex(x, y, z);
+                clearanceField[index] = 0;
+                queue.Add(index);
+            }
+        }
+    }
+
+    //Free nodes with a missing connection to a free neighbor have a wall between the nodes (thin walls, failed traces),
+    //so they are sources too. After the blocked nodes, the queue has to stay sorted by clearance
+    for (int x = 0; x < xNodes; x++)
+    {
+        for (int y = 0; y < yNodes; y++)
+        {
+            for (int z = 0; z < zNodes; z++)
+            {
+                const int index = GetNodeIndex(x, y, z);
+                if (clearanceField[index] == 0) continue;
+
+                const uint8 connections = GetConnectionMask(x, y, z);
+                for (int direction = 0; direction < 6; direction++)
+                {
+                    const FIntVector neighbor = FIntVector(x, y, z) + neighborOffsets[direction];
+                    if ((connections & (1 << direction)) || !IsValid(neighbor.X, neighbor.Y, neighbor.Z)) continue;
+
+                    clearanceField[index] = 1;
+                    queue.Add(index);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int head = 0; head < queue.Num(); head++)
+    {
+        const int index = queue[head];
+        const int nextClearance = clearanceField[index] + 1;
+        if (nextClearance >= MAX_uint8) break;
+
+        const FIntVector position = GetNodeCoordinates(index);
+        for (int x = -1; x <= 1; x++)
+        {
+            for (int y = -1; y <= 1; y++)
+            {
+                for (int z = -1; z <= 1; z++)
+                {
+                    const FIntVector neighbor = position + FIntVector(x, y, z);
+                    if (!IsValid(neighbor.X, neighbor.Y, neighbor.Z)) continue;
+
+                    const int neighborIndex = GetNodeIndex(neighbor.X, neighbor.Y, neighbor.Z);
+                    if (clearanceField[neighborIndex] != MAX_uint8) continue;
+                    clearanceField[neighborIndex] = uint8(nextClearance);
+                    queue.Add(neighborIndex);
+                }
+            }
+        }
+    }
+}
+
+uint8 AHeightNavigationVolume::GetRequiredClearance(float agentRadius) const
+{
+    if (agentRadius <= 0.f) return 0;
+    //Only the box of a free node is known to be empty, every node works for agents that fit into it
+    if (agentRadius <= distanceBetweenNodes / 4) return 1;
+    //Bigger sub cell radii need a node without walls around it
+    return uint8(FMath::Clamp(FMath::CeilToInt(agentRadius / distanceBetweenNodes + 0.5f), 2, int(MAX_uint8)));
+}
+
+bool AHeightNavigationVolume::HasClearance(int x, int y, int z, uint8 requiredClearance) const
+{
+    //Every free node has at least a clearance of 1
+    if (requiredClearance <= 1) return true;
+    if (gridStreaming.IsActive()) return gridStreaming.GetClearance(x, y, z) >= requiredClearance;
+    if (clearanceField.IsEmpty()) return true;
+    return clearanceField[GetNodeIndex(x, y, z)] >= requiredClearance;
+}
+
+uint8 AHeightNavigationVolume::GetClearance(int x, int y, int z) const
+{
+    if (gridStreaming.IsActive()) return gridStreaming.GetClearance(x, y, z);
+    if (clearanceField.IsEmpty()) return IsNodeBlocked(x, y, z) ? 0 : MAX_uint8;
+    return clearanceField[GetNodeIndex(x, y, z)];
+}
+
+float AHeightNavigationVolume::GetClearanceAtPosition(FVector position) const
+{
+    if ((clearanceField.IsEmpty() && !gridStreaming.IsActive()) || !IsInsideVolume(position)) return 0.f;
+
+    const FVector gridPosition = GetGridPositionFromWorld(position);
+    const int x = FMath::Clamp(FMath::RoundToInt(gridPosition.X), 0, xNodes - 1);
+    const int y = FMath::Clamp(FMath::RoundToInt(gridPosition.Y), 0, yNodes - 1);
+    const int z = FMath::Clamp(FMath::RoundToInt(gridPosition.Z), 0, zNodes - 1);
+
+    const uint8 clearance = GetClearance(x, y, z);
+    if (clearance <= 1) return clearance * distanceBetweenNodes / 4;
+    return (clearance - 0.5f) * distanceBetweenNodes;
+}
+
+float FNavCostProfile::GetWeight(ENavCostLayer layer) const
+{
+    switch (layer)
+    {
+    case ENavCostLayer::Danger: return danger;
+    case ENavCostLayer::Wind: return wind;
+    case ENavCostLayer::Preference: return preference;
+    case ENavCostLayer::Custom: return custom;
+    default: return 0.f;
+    }
+}
+
+uint8* AHeightNavigationVolume::GetWritableCostLayer(ENavCostLayer layer)
+{
+    //The layers only get allocated and freed on the game thread, so checking the size needs no lock
+    TArray<uint8>& costs = costLayers[int(layer)];
+    if (costs.Num() != GetNodeCount())
+    {
+        FWriteScopeLock writeLock(gridLock);
+        costs.Init(0, GetNodeCount());
+    }
+    return costs.GetData();
+}
+
+void AHeightNavigationVolume::SetCellCost(ENavCostLayer layer, FVector position, uint8 cost)
+{
+    if (IsGridEmpty() || layer == ENavCostLayer::Count) return;
+    if (cost == 0 && costLayers[int(layer)].IsEmpty()) return;
+
+    const FIntVector node = GetNodeCoordinatesFromWorld(position);
+    if (!IsValid(node.X, node.Y, node.Z)) return;
+
+    StoreCost(GetWritableCostLayer(layer), GetNodeIndex(node.X, node.Y, node.Z), cost);
+}
+
+void AHeightNavigationVolume::PaintCostSphere(ENavCostLayer layer, FVector center, float radius, uint8 cost)
+{
+    if (IsGridEmpty() || layer == ENavCostLayer::Count || radius < 0) return;
+    if (cost == 0 && costLayers[int(layer)].IsEmpty()) return;
+
+    //The grid axes are orthonormal, so the sphere stays a sphere in grid space
+    const FVector gridCenter = GetGridPositionFromWorld(center);
+    const float gridRadius = radius / distanceBetweenNodes;
+    const FIntVector minNode(FMath::Max(FMath::CeilToInt(gridCenter.X - gridRadius), 0), FMath::Max(FMath::CeilToInt(gridCenter.Y - gridRadius), 0), FMath::Max(FMath::CeilToInt(gridCenter.Z - gridRadius), 0));
+    const FIntVector maxNode(FMath::Min(FMath::FloorToInt(gridCenter.X + gridRadius), xNodes - 1), FMath::Min(FMath::FloorToInt(gridCenter.Y + gridRadius), yNodes - 1), FMath::Min(FMath::FloorToInt(gridCenter.Z + gridRadius), zNodes - 1));
+    if (minNode.X > maxNode.X || minNode.Y > maxNode.Y || minNode.Z > maxNode.Z) return;
+
+    uint8* costs = GetWritableCostLayer(layer);
+    for (int x = minNode.X; x <= maxNode.X; x++)
+    {
+        for (int y = minNode.Y; y <= maxNode.Y; y++)
+        {
+            for (int z = minNode.Z; z <= maxNode.Z; z++)
+            {
+                if (FVector::DistSquared(FVector(x, y, z), gridCenter) > gridRadius * gridRadius) continue;
+                StoreCost(costs, GetNodeIndex(x, y, z), cost);
+            }
+        }
+    }
+}
+
+void AHeightNavigationVolume::PaintCostVolume(ENavCostLayer layer, const AVolume& volume, uint8 cost, TArray<FIntVector>* paintedNodes)
+{
+    TArray<FIntVector> insideNodes;
+    TArray<FIntVector>& nodes = paintedNodes ? *paintedNodes : insideNodes;
+    nodes.Reset();
+    if (IsGridEmpty() || layer == ENavCostLayer::Count) return;
+    if (cost == 0 && costLayers[int(layer)].IsEmpty()) return;
+
+    //Grid space bounds of all corners, the volumes can be rotated against each other
+    FVector corners[8];
+    volume.GetBounds().GetBox().GetVertices(corners);
+    FVector minPosition(FLT_MAX);
+    FVector maxPosition(-FLT_MAX);
+    for (const FVector& corner : corners)
+    {
+        const FVector gridCorner = GetGridPositionFromWorld(corner);
+        minPosition = minPosition.ComponentMin(gridCorner);
+        maxPosition = maxPosition.ComponentMax(gridCorner);
+    }
+    const FIntVector minNode(FMath::Max(FMath::CeilToInt(minPosition.X), 0), FMath::Max(FMath::CeilToInt(minPosition.Y), 0), FMath::Max(FMath::CeilToInt(minPosition.Z), 0));
+    const FIntVector maxNode(FMath::Min(FMath::FloorToInt(maxPosition.X), xNodes - 1), FMath::Min(FMath::FloorToInt(maxPosition.Y), yNodes - 1), FMath::Min(FMath::FloorToInt(maxPosition.Z), zNodes - 1));
+    if (minNode.X > maxNode.X || minNode.Y > maxNode.Y || minNode.Z > maxNode.Z) return;
+
+    for (int x = minNode.X; x <= maxNode.X; x++)
+    {
+        for (int y = minNode.Y; y <= maxNode.Y; y++)
+        {
+            for (int z = minNode.Z; z <= maxNode.Z; z++)
+            {
+                if (volume.EncompassesPoint(GetWorldPositionFromGridPosition(FVector(x, y, z)))) nodes.Add(FIntVector(x, y, z));
+            }
+        }
+    }
+    if (nodes.IsEmpty()) return;
+
+    uint8* costs = GetWritableCostLayer(layer);
+    for (const FIntVector& node : nodes) StoreCost(costs, GetNodeIndex(node.X, node.Y, node.Z), cost);
+}
+
+void AHeightNavigationVolume::ClearCostCells(ENavCostLayer layer, TConstArrayView<FIntVector> nodes)
+{
+    if (layer == ENavCostLayer::Count || costLayers[int(layer)].IsEmpty()) return;
+
+    uint8* costs = costLayers[int(layer)].GetData();
+    for (const FIntVector& node : nodes)
+    {
+        //The cells can be gone since they got painted
+        if (IsValid(node.X, node.Y, node.Z)) StoreCost(costs, GetNodeIndex(node.X, node.Y, node.Z), 0);
+    }
+}
+
+void AHeightNavigationVolume::ClearCostLayer(ENavCostLayer layer)
+{
+    if (layer == ENavCostLayer::Count) return;
+
+    FWriteScopeLock writeLock(gridLock);
+    costLayers[int(layer)].Empty();
+}
+
+uint8 AHeightNavigationVolume::GetCellCost(ENavCostLayer layer, int nodeIndex) const
+{
+    if (layer == ENavCostLayer::Count) return 0;
+    const TArray<uint8>& costs = costLayers[int(layer)];
+    return costs.IsValidIndex(nodeIndex) ? costs[nodeIndex] : 0;
+}
+
+float AHeightNavigationVolume::GetTraversalCost(int nodeIndex, const FNavCostProfile& costProfile) const
+{
+    float cost = 1.f;
+    for (int layer = 0; layer < int(ENavCostLayer::Count); layer++)
+    {
+        const float weight = costProfile.GetWeight(ENavCostLayer(layer));
+        if (weight <= 0 || costLayers[layer].IsEmpty()) continue;
+        cost += weight * LoadCost(costLayers[layer].GetData(), nodeIndex) / 255.f;
+    }
+    return cost;
+}
+
+void AHeightNavigationVolume::ApplyCostVolumes()
+{
+    if (IsGridEmpty()) return;
+
+    TArray<AActor*> costVolumes;
+    UGameplayStatics::GetAllActorsOfClass(this, ANavCostVolume::StaticClass(), costVolumes);
+    for (AActor* actor : costVolumes)
+    {
+        Cast<ANavCostVolume>(actor)->ApplyTo(*this);
+    }
+}
+
+void AHeightNavigationVolume::RecordSearchHeat(TConstArrayView<int> expandedNodes) const
+{
+    FScopeLock lock(&searchHeatLock);
+    if (searchHeat.Num() != GetNodeCount()) searchHeat.Init(0, GetNodeCount());
+    for (const int index : expandedNodes)
+    {
+        if (searchHeat.IsValidIndex(index) && searchHeat[index] < MAX_uint16) searchHeat[index]++;
+    }
+}
+
+void AHeightNavigationVolume::ResetSearchHeat()
+{
+    FScopeLock lock(&searchHeatLock);
+    searchHeat.Empty();
+}
+
+void AHeightNavigationVolume::CopySearchHeat(TArray<uint16>& heat) const
+{
+    FScopeLock lock(&searchHeatLock);
+    heat = searchHeat;
+}
+
+bool AHeightNavigationVolume::IsPositionFree(const FVector& position, uint8 requiredClearance) const
+{
+    if (IsGridEmpty()) return false;
+
+    const FIntVector node = GetNodeCoordinatesFromWorld(position);
+    if (!IsValid(node.X, node.Y, node.Z)) return false;
+    return !IsNodeBlocked(node.X, node.Y, node.Z) && HasClearance(node.X, node.Y, node.Z, requiredClearance);
+}
+
+FIntVector AHeightNavigationVolume::GetNodeCoordinatesFromWorld(const FVector& position) const
+{
+    const FVector gridPosition = GetGridPositionFromWorld(position);
+    return FIntVector(FMath::RoundToInt(gridPosition.X), FMath::RoundToInt(gridPosition.Y), FMath::RoundToInt(gridPosition.Z));
+}
+
+void AHeightNavigationVolume::BenchmarkSearchModes()
+{
+    if (IsGridEmpty())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s - Generate the grid before running the benchmark"), *GetName());
+        return;
+    }
+
+    struct FModeResult
+    {
+        const TCHAR* name;
+        EPathSearchMode mode;
+        bool smooth;
+        int paths = 0;
+        int64 waypoints = 0;
+        double length = 0;
+        int64 lineOfSightChecks = 0;
+        int64 expansions = 0;
+        double seconds = 0;
+    };
+    FModeResult results[3] = {
+        { TEXT("A*"), EPathSearchMode::AStar, false },
+        { TEXT("A* + smoothing"), EPathSearchMode::AStar, true },
+        { TEXT("Lazy Theta*"), EPathSearchMode::LazyThetaStar, false },
+    };
+
+    TArray<FVector> freePositions;
+    for (int x = 0; x < xNodes; x++)
+    {
+        for (int y = 0; y < yNodes; y++)
+        {
+            for (int z = 0; z < zNodes; z++)
+            {
+                if (!IsNodeBlocked(x, y, z)) freePositions.Add(GetWorldPositionFromGridPosition(FVector(x, y, z)));
+            }
+        }
+    }
+    if (freePositions.Num() < 2) return;
+
+    const EPathSearchMode usedMode = searchMode;
+    const bool usedSmoothing = smoothPaths;
+    FRandomStream random(1337);
+    const int queries = 32;
+
+    for (int i = 0; i < queries; i++)
+    {
+        const FVector start = freePositions[random.RandHelper(freePositions.Num())];
+        const FVector goal = freePositions[random.RandHelper(freePositions.Num())];
+
+        for (FModeResult& result : results)
+        {
+            searchMode = result.mode;
+            smoothPaths = result.smooth;
+
+            Get_Success success = Get_Success::Failed;
+            TArray<FVector> path;
+            const double startTime = FPlatformTime::Seconds();
+            GetPath(start, nullptr, goal, nullptr, success, path);
+            result.seconds += FPlatformTime::Seconds() - startTime;
+            if (success != Get_Success::Success) continue;
+
+            result.paths++;
+            result.waypoints += path.Num();
+            result.lineOfSightChecks += lastSearchLineOfSightChecks;
+            result.expansions += lastSearchExpansions;
+            for (int j = 1; j < path.Num(); j++)
+            {
+                result.length += FVector::Distance(path[j - 1], path[j]);
+            }
+        }
+    }
+    searchMode = usedMode;
+    smoothPaths = usedSmoothing;
+
+    for (const FModeResult& result : results)
+    {
+        if (result.paths == 0) continue;
+        UE_LOG(LogTemp, Log, TEXT("%s - %s over %d paths: %.1f waypoints, %.0f cm, %.1f line of sight checks, %.1f expansions, %.3f ms per query"),
+            *GetName(), result.name, result.paths, double(result.waypoints) / result.paths, result.length / result.paths,
+            double(result.lineOfSightChecks) / result.paths, double(result.expansions) / result.paths, result.seconds * 1000.0 / queries);
+    }
+}
+
+void AHeightNavigationVolume::CompressGrid()
+{
+    if (IsGridEmpty() || compressedGrid.IsBuilt() || gridStreaming.IsActive()) return;
+
+    FCompressedGrid grid;
+    BuildCompressedGrid(grid);
+
+    //Every accessor uses the compressed grid from now on
+    FWriteScopeLock writeLock(gridLock);
+    compressedGrid = MoveTemp(grid);
+    nodeFlags.Empty();
+    UE_LOG(LogTemp, Log, TEXT("%s - Compressed grid: %.2f MB for %d nodes (%d unique planes)"),
+        *GetName(), compressedGrid.GetAllocatedSize() / (1024.f * 1024.f), GetNodeCount(), compressedGrid.GetUniquePlaneCount());
+}
+
+void AHeightNavigationVolume::BuildNodeFlags(const TArray<F_YLayer>& grid)
+{
+    //The nested grid is only needed while the connections get set up, every accessor reads the table from now on
+    nodeFlags.Init(FCompressedGrid::BlockedBit, GetNodeCount());
+    navNodeGrid.Empty();
+    for (int x = 0; x < xNodes; x++)
+    {
+        for (int y = 0; y < yNodes; y++)
+        {
+            for (int z = 0; z < zNodes; z++)
+            {
+                const FNavNode& node = grid[x][y][z];
+                nodeFlags[GetNodeIndex(x, y, z)] = GetConnectionMask(node) | (node.blocked ? FCompressedGrid::BlockedBit : 0);
+            }
+        }
+    }
+}
+
+void AHeightNavigationVolume::BuildCompressedGrid(FCompressedGrid& grid) const
+{
+    //x, y, z order like FCompressedGrid::Build expects it
+    TArray<uint8> flags;
+    flags.Reserve(GetNodeCount());
+    for (int x = 0; x < xNodes; x++)
+    {
+        for (int y = 0; y < yNodes; y++)
+        {
+            for (int z = 0; z < zNodes; z++)
+            {
+                flags.Add(GetNodeFlags(x, y, z));
+            }
+        }
+    }
+    grid.Build(FIntVector(xNodes, yNodes, zNodes), flags);
+}
+
+void AHeightNavigationVolume::BenchmarkGridCompression()
+{
+    //The comparison needs the node table
+    const bool usedCompression = compressGrid;
+    compressGrid = false;
+    if (nodeFlags.IsEmpty()) GenerateNavNodeGrid();
+    compressGrid = usedCompression;
+    if (nodeFlags.IsEmpty()) return;
+
+    TArray<FVector> freePositions;
+    for (int x = 0; x < xNodes; x++)
+    {
+        for (int y = 0; y < yNodes; y++)
+        {
+            for (int z = 0; z < zNodes; z++)
+            {
+                if (!IsNodeBlocked(x, y, z)) freePositions.Add(GetWorldPositionFromGridPosition(FVector(x, y, z)));
+            }
+        }
+    }
+    if (freePositions.Num() < 2) return;
+
+    //Same queries on both. The accessors prefer the node table, it gets moved aside while the compressed grid is timed
+    FRandomStream random(1337);
+    const int queries = 32;
+    TArray<TPair<FVector, FVector>> queryPositions;
+    for (int i = 0; i < queries; i++)
+    {
+        queryPositions.Emplace(freePositions[random.RandHelper(freePositions.Num())], freePositions[random.RandHelper(freePositions.Num())]);
+    }
+
+    auto runQueries = [this, &queryPositions](int& paths)
+    {
+        paths = 0;
+        const double startTime = FPlatformTime::Seconds();
+        for (const TPair<FVector, FVector>& query : queryPositions)
+        {
+            Get_Success success = Get_Success::Failed;
+            TArray<FVector> path;
+            GetPath(query.Key, nullptr, query.Value, nullptr, success, path);
+            if (success == Get_Success::Success) paths++;
+        }
+        return FPlatformTime::Seconds() - startTime;
+    };
+
+    int flatPaths = 0;
+    int compressedPaths = 0;
+    const double flatSeconds = runQueries(flatPaths);
+
+    FCompressedGrid compressed;
+    BuildCompressedGrid(compressed);
+    TArray<uint8> flags;
+    {
+        FWriteScopeLock writeLock(gridLock);
+        compressedGrid = MoveTemp(compressed);
+        flags = MoveTemp(nodeFlags);
+    }
+    const double compressedSeconds = runQueries(compressedPaths);
+
+    const int64 flatBytes = flags.GetAllocatedSize();
+    const int64 compressedBytes = compressedGrid.GetAllocatedSize();
+    UE_LOG(LogTemp, Log, TEXT("%s - Grid compression: %.2f MB compressed, %.2f MB node table (%.1fx), %d unique planes"),
+        *GetName(), compressedBytes / (1024.f * 1024.f), flatBytes / (1024.f * 1024.f), double(flatBytes) / FMath::Max<int64>(compressedBytes, 1),
+        compressedGrid.GetUniquePlaneCount());
+    UE_LOG(LogTemp, Log, TEXT("%s - Grid compression: %.3f ms per query on the node table, %.3f ms compressed (%.2fx), %d / %d paths found"),
+        *GetName(), flatSeconds * 1000.0 / queries, compressedSeconds * 1000.0 / queries, compressedSeconds / FMath::Max(flatSeconds, 1e-9),
+        flatPaths, compressedPaths);
+
+    if (!usedCompression)
+    {
+        FWriteScopeLock writeLock(gridLock);
+        nodeFlags = MoveTemp(flags);
+        compressedGrid.Reset();
+    }
+}
+
+void AHeightNavigationVolume::BakePathDatabase()
+{
+    GenerateNavNodeGrid();
+    if (IsGridEmpty()) return;
+
+    const double startTime = FPlatformTime::Seconds();
+    FNavPathDatabase database;
+    if (!FNavPathDatabase::Build(*this, pathDatabaseMaxNodes, database))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s - No path database baked, the grid has no free nodes or more than %d"), *GetName(), pathDatabaseMaxNodes);
+        return;
+    }
+    Modify();
+    FWriteScopeLock writeLock(gridLock);
+    pathDatabase = MoveTemp(database);
+    pathDatabase.Bind(*this);
+
+    //One byte per move is the uncompressed table
+    const int64 freeNodes = pathDatabase.GetFreeNodeCount();
+    UE_LOG(LogTemp, Log, TEXT("%s - Baked path database for %lld free nodes in %.2f s: %d runs, %.2f MB (%.2f MB uncompressed)"),
+        *GetName(), freeNodes, FPlatformTime::Seconds() - startTime, pathDatabase.Runs.Num(),
+        pathDatabase.GetAllocatedSize() / (1024.f * 1024.f), freeNodes * freeNodes / (1024.f * 1024.f));
+}
+
+void AHeightNavigationVolume::BenchmarkPathDatabase()
+{
+    if (IsGridEmpty() || !pathDatabase.IsBound())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s - Bake the path database first"), *GetName());
+        return;
+    }
+
+    TArray<FVector> freePositions;
+    for (int x = 0; x < xNodes; x++)
+    {
+        for (int y = 0; y < yNodes; y++)
+        {
+            for (int z = 0; z < zNodes; z++)
+            {
+                if (!IsNodeBlocked(x, y, z)) freePositions.Add(GetWorldPositionFromGridPosition(FVector(x, y, z)));
+            }
+        }
+    }
+    if (freePositions.Num() < 2) return;
+
+    FRandomStream random(1337);
+    const int queries = 256;
+    TArray<TPair<FVector, FVector>> queryPositions;
+    for (int i = 0; i < queries; i++)
+    {
+        queryPositions.Emplace(freePositions[random.RandHelper(freePositions.Num())], freePositions[random.RandHelper(freePositions.Num())]);
+    }
+
+    auto runQueries = [this, &queryPositions](int& paths)
+    {
+        paths = 0;
+        const double startTime = FPlatformTime::Seconds();
+        for (const TPair<FVector, FVector>& query : queryPositions)
+        {
+            Get_Success success = Get_Success::Failed;
+            TArray<FVector> path;
+            GetPath(query.Key, nullptr, query.Value, nullptr, success, path);
+            if (success == Get_Success::Success) paths++;
+        }
+        return FPlatformTime::Seconds() - startTime;
+    };
+
+    const bool usedPathDatabase = usePathDatabase;
+    int searchPaths = 0;
+    int databasePaths = 0;
+    usePathDatabase = false;
+    const double searchSeconds = runQueries(searchPaths);
+    usePathDatabase = true;
+    const double databaseSeconds = runQueries(databasePaths);
+    usePathDatabase = usedPathDatabase;
+
+    UE_LOG(LogTemp, Log, TEXT("%s - Path database: %.4f ms per query searching, %.4f ms with the database (%.1fx), %d / %d paths found"),
+        *GetName(), searchSeconds * 1000.0 / queries, databaseSeconds * 1000.0 / queries, searchSeconds / FMath::Max(databaseSeconds, 1e-9),
+        searchPaths, databasePaths);
+}
+
+void AHeightNavigationVolume::SetNodeLayout(ENodeLayout layout)
+{
+    nodeLayout = layout;
+    if (layout == tableLayout) return;
+
+    FWriteScopeLock writeLock(gridLock);
+    const uint32 gridHash = CalculateGridHash();
+    const bool landmarksValid = landmarkGridHash == HashCombine(gridHash, uint32(tableLayout));
+
+    //Index of every node in the current layout, in x, y, z order
+    auto collectIndices = [this](TArray<int>& indices)
+    {
+        indices.Reserve(xNodes * yNodes * zNodes);
+        for (int x = 0; x < xNodes; x++)
+        {
+            for (int y = 0; y < yNodes; y++)
+            {
+                for (int z = 0; z < zNodes; z++)
+                {
+                    indices.Add(GetNodeIndex(x, y, z));
+                }
+            }
+        }
+    };
+    TArray<int> oldIndices;
+    TArray<int> newIndices;
+    collectIndices(oldIndices);
+    const int oldCount = GetNodeCount();
+    tableLayout = layout;
+    collectIndices(newIndices);
+    const int newCount = GetNodeCount();
+
+    RemapNodeTable<uint8>(nodeFlags, oldIndices, oldCount, newIndices, newCount, FCompressedGrid::BlockedBit);
+    RemapNodeTable<uint8>(clearanceField, oldIndices, oldCount, newIndices, newCount, 0);
+    RemapNodeTable<uint16>(landmarkDistances, oldIndices, oldCount, newIndices, newCount, MAX_uint16);
+    for (TArray<uint8>& costs : costLayers)
+    {
+        RemapNodeTable<uint8>(costs, oldIndices, oldCount, newIndices, newCount, 0);
+    }
+    {
+        FScopeLock heatLock(&searchHeatLock);
+        RemapNodeTable<uint16>(searchHeat, oldIndices, oldCount, newIndices, newCount, 0);
+    }
+    if (landmarksValid) landmarkGridHash = HashCombine(gridHash, uint32(tableLayout));
+}
+
+void AHeightNavigationVolume::BenchmarkNodeLayout()
+{
+    //The compressed and the streamed grid have their own order
+    if (nodeFlags.IsEmpty())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s - Generate the grid without compression or streaming before running the benchmark"), *GetName());
+        return;
+    }
+
+    TArray<FIntVector> freeNodes;
+    for (int x = 0; x < xNodes; x++)
+    {
+        for (int y = 0; y < yNodes; y++)
+        {
+            for (int z = 0; z < zNodes; z++)
+            {
+                if (!IsNodeBlocked(x, y, z)) freeNodes.Emplace(x, y, z);
+            }
+        }
+    }
+    if (freeNodes.Num() < 2) return;
+
+    FRandomStream random(1337);
+    const int queries = 256;
+    TArray<TPair<FIntVector, FIntVector>> queryNodes;
+    for (int i = 0; i < queries; i++)
+    {
+        queryNodes.Emplace(freeNodes[random.RandHelper(freeNodes.Num())], freeNodes[random.RandHelper(freeNodes.Num())]);
+    }
+
+    struct FLayoutResult
+    {
+        const TCHAR* name;
+        ENodeLayout layout;
+        int paths = 0;
+        int64 expansions = 0;
+        int64 tableBytes = 0;
+        double seconds = DBL_MAX;
+    };
+    FLayoutResult results[2] = {
+        { TEXT("Linear"), ENodeLayout::Linear },
+        { TEXT("Bricked"), ENodeLayout::Bricked },
+    };
+
+    //The node table, the clearance and the search state all follow the layout, so this times the whole search.
+    //One warm up pass, then the fastest of a few rounds, the other rounds are mostly noise of the editor
+    const ENodeLayout usedLayout = nodeLayout;
+    const int rounds = 3;
+    FPathSearchScratch scratch;
+    for (FLayoutResult& result : results)
+    {
+        SetNodeLayout(result.layout);
+        FReadScopeLock readLock(gridLock);
+        scratch.Prepare(GetNodeCount());
+        result.tableBytes = nodeFlags.GetAllocatedSize() + clearanceField.GetAllocatedSize();
+
+        for (int round = 0; round <= rounds; round++)
+        {
+            int paths = 0;
+            int64 expansions = 0;
+            const double startTime = FPlatformTime::Seconds();
+            for (const TPair<FIntVector, FIntVector>& query : queryNodes)
+            {
+                TArray<FIntVector> pathNodes;
+                int queryExpansions = 0;
+                if (FindPathAStar(query.Key, query.Value, pathNodes, queryExpansions, scratch)) paths++;
+                expansions += queryExpansions;
+            }
+            const double seconds = FPlatformTime::Seconds() - startTime;
+            if (round == 0) continue;
+
+            result.seconds = FMath::Min(result.seconds, seconds);
+            result.paths = paths;
+            result.expansions = expansions;
+        }
+    }
+    SetNodeLayout(usedLayout);
+
+    for (const FLayoutResult& result : results)
+    {
+        UE_LOG(LogTemp, Log, TEXT("%s - %s layout over %d queries: %.4f ms per query, %.0f expansions per ms, %.2f MB node and clearance tables, %d paths found"),
+            *GetName(), result.name, queries, result.seconds * 1000.0 / queries, result.expansions / FMath::Max(result.seconds * 1000.0, 1e-9),
+            result.tableBytes / (1024.f * 1024.f), result.paths);
+    }
+    UE_LOG(LogTemp, Log, TEXT("%s - Bricked layout: %.2fx the A* time of the linear layout"),
+        *GetName(), results[1].seconds / FMath::Max(results[0].seconds, 1e-9));
+}
+
 
 
 
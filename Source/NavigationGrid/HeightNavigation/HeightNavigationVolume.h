@@ -5,13 +5,135 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Volume.h"
 #include "NavNode.h"
+#include "MultiResolutionGrid.h"
+#include "NavGridVisualizerComponent.h"
+#include "NavGridStreaming.h"
+#include "CompressedGrid.h"
+#include "NavPathDatabase.h"
+#include "Tasks/Task.h"
 #include "HeightNavigationVolume.generated.h"
 
-UENUM()
+class FGridVoxelizer;
+
+UENUM(BlueprintType)
 enum class Get_Success : uint8
 {
     Success,
-	Failed
+	Failed,
+	//Streamed grids only: chunks along the way are still loading, the path is the part of the coarse route over the chunks
+	//that is known to be free, it only ends with the goal when that part reaches it
+	Pending
+};
+
+UENUM(BlueprintType)
+enum class ENavCostLayer : uint8
+{
+	Danger,
+	Wind,
+	//Cells agents should rather stay out of, like everything off the flight lanes
+	Preference,
+	Custom,
+	Count		UMETA(Hidden)
+};
+
+//Weights of the cost layers for one query. Entering a cell with cost c on a layer with weight w costs 1 + w * c / 255 steps,
+//every step stays at least 1, so the heuristic stays admissible
+USTRUCT(BlueprintType)
+struct FNavCostProfile
+{
+    GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = 0))
+	float danger = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = 0))
+	float wind = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = 0))
+	float preference = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = 0))
+	float custom = 0.f;
+
+	float GetWeight(ENavCostLayer layer) const;
+	bool IsWeighted() const { return danger > 0 || wind > 0 || preference > 0 || custom > 0; }
+
+	bool operator==(const FNavCostProfile& other) const
+	{
+		return danger == other.danger && wind == other.wind && preference == other.preference && custom == other.custom;
+	}
+
+	friend uint32 GetTypeHash(const FNavCostProfile& profile)
+	{
+		return HashCombine(HashCombine(GetTypeHash(profile.danger), GetTypeHash(profile.wind)), HashCombine(GetTypeHash(profile.preference), GetTypeHash(profile.custom)));
+	}
+};
+
+//One start and goal pair for GetPaths
+USTRUCT(BlueprintType)
+struct FNavPathQuery
+{
+    GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FVector start = FVector::ZeroVector;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FVector goal = FVector::ZeroVector;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float agentRadius = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FNavCostProfile costProfile;
+};
+
+USTRUCT(BlueprintType)
+struct FNavPathQueryResult
+{
+    GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	Get_Success result = Get_Success::Failed;
+
+	//Same as the path of GetPath
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	TArray<FVector> path = TArray<FVector>();
+};
+
+//Search state of A* that gets reused between queries, only the entries touched by the last search get reset
+struct FPathSearchScratch
+{
+	struct FOpenEntry
+	{
+		float fCost;
+		int index;
+		bool operator<(const FOpenEntry& other) const { return fCost < other.fCost; }
+	};
+
+	TArray<float> gCosts;
+	TArray<int> parents;
+	TBitArray<> closedList;
+	TArray<int> touched;
+	//Binary heap, cheapest entry on top
+	TArray<FOpenEntry> openList;
+
+	void Prepare(int nodeCount);
+};
+
+//Path distances from one start to every node within a budget, see CalculateReachability
+struct FNavReachability
+{
+	//Sorted, so single nodes can be looked up with a binary search
+	TArray<int> nodeIndices;
+	//Steps from the start to the node at the same position in nodeIndices
+	TArray<uint16> steps;
+	float distanceBetweenNodes = 0.f;
+
+	//Path distance along the grid, negative when the node is not reachable within the budget
+	float GetDistance(int nodeIndex) const;
+	int Num() const { return nodeIndices.Num(); }
+	void Reset();
 };
 
 USTRUCT(BlueprintType, Blueprintable)
@@ -62,6 +184,28 @@ struct F_YLayer
 	}
 };
 
+UENUM(BlueprintType)
+enum class EEdgeValidation : uint8
+{
+	Traces		UMETA(DisplayName = "Traces"),						//Two line traces per connection
+	Occupancy	UMETA(DisplayName = "Occupancy"),					//Traces only for connections close to geometry, needs voxelizeGeometry
+	ThinWalls	UMETA(DisplayName = "Occupancy and Thin Walls"),	//Connections close to geometry get tested against the voxelized shapes, traces only without collision data
+};
+
+UENUM(BlueprintType)
+enum class EPathSearchMode : uint8
+{
+	AStar			UMETA(DisplayName = "A*"),				//Moves along the grid connections
+	LazyThetaStar	UMETA(DisplayName = "Lazy Theta*"),		//Any angle, parents can be any node in line of sight
+};
+
+UENUM(BlueprintType)
+enum class ENodeLayout : uint8
+{
+	Linear		UMETA(DisplayName = "Linear"),		//x, y, z order, neighbors in y and x are whole rows and planes apart
+	Bricked		UMETA(DisplayName = "Bricked"),		//4x4x4 bricks in x, y, z order, the nodes of a brick in Morton order
+};
+
 /**
  * 
  */
@@ -72,18 +216,24 @@ class NAVIGATIONGRID_API AHeightNavigationVolume : public AVolume
 
 	//Functions
 public:
+	AHeightNavigationVolume();
+
 	void DrawBox(FVector pos, FColor color) const;
 
 	//Grid Functions
 	UFUNCTION(BlueprintCallable, CallInEditor, Category = "Height Navigation Volume")
 	void GenerateNavNodeGrid();
-	void SetupNeighbors();
+	//With a voxelizer only connections close to geometry get traced, see edgeValidation
+	//Works on a grid that is not swapped in yet, so searches keep running on the current one
+	void SetupNeighbors(TArray<F_YLayer>& grid, const FGridVoxelizer* voxelizer = nullptr);
 	void GetNeighbors(FNavNode node, TArray<F_YLayer>& grid, TArray<FNavNode>& neighbors);
 	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume")
     FVector GetExtents() const;
 	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume")
 	bool IsGridEmpty() const;
+	//Call with the write lock held, searches read the counts
 	void InitializeNodeCount();
+	FIntVector CalculateNodeCount() const;
 	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume")
 	FVector GetRandomMovablePosition() const;
 
@@ -91,26 +241,148 @@ public:
 	//When putting in an Actor it is converted to the Actor Location
 	//Actor is getting prioritized over the position so set one of them, not both
 	//Returns: An Array of Vector3 where the first position is the first Node to move to
-	//and the last position is the position you put in
+	//and the last position is the position you put in, or Pending with the checked start of a coarse route when streamed chunks are missing
+	//agentRadius filters out every node with less free space around it than the radius (see clearanceField)
+	//Can be called from worker threads, regenerating the grid swaps the new tables in with the write lock
 	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume", meta=(ExpandEnumAsExecs="ReturnValue"))
-	void GetPath(FVector startPos, AActor* startActor, FVector goalPos, AActor* goalActor, Get_Success& ReturnValue, TArray<FVector>& path);
+	void GetPath(FVector startPos, AActor* startActor, FVector goalPos, AActor* goalActor, Get_Success& ReturnValue, TArray<FVector>& path, float agentRadius = 0.f);
+	//GetPath with the cost layers weighted by costProfile. Weighted searches always use A* and skip smoothPaths,
+	//string pulling would cut straight through the costly cells again
+	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume|Cost Layers", meta=(ExpandEnumAsExecs="ReturnValue"))
+	void GetPathWithCosts(FVector startPos, AActor* startActor, FVector goalPos, AActor* goalActor, const FNavCostProfile& costProfile, Get_Success& ReturnValue, TArray<FVector>& path, float agentRadius = 0.f);
+	//Many queries at once: one grid lock for all of them, spread over the worker threads with one search state per
+	//worker. results gets one entry per query in the same order. Can be called from worker threads like GetPath
+	void GetPaths(TConstArrayView<FNavPathQuery> queries, TArray<FNavPathQueryResult>& results);
+	//A* on the regular grid that gives up after maxExpansions expanded nodes, for short repairs on the game thread
+	//that must not search the whole grid. Fails on streamed grids, the full query waits for the chunks there
+	Get_Success FindLocalPath(const FVector& start, const FVector& goal, float agentRadius, int maxExpansions, TArray<FVector>& path, const FNavCostProfile* costProfile = nullptr);
+	//Finds the volume of every query like EvaluateNavGrid, but collects the volumes only once, and runs the queries
+	//of each volume with GetPaths. Queries that don't fit into any volume fail
+	UFUNCTION(BlueprintCallable, meta=(WorldContext="WorldContext"), Category="Height Navigation Volume")
+	static void GetPathsBatch(UObject* WorldContext, const TArray<FNavPathQuery>& queries, TArray<FNavPathQueryResult>& results);
+	//Path to the closest reachable goal, found with one search instead of one GetPath per goal.
+	//goalIndex is the index of the reached goal: goalPositions first, goalActors counted after them
+	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume", meta=(ExpandEnumAsExecs="ReturnValue", AutoCreateRefTerm="goalPositions,goalActors"))
+	void GetPathToNearest(FVector startPos, AActor* startActor, const TArray<FVector>& goalPositions, const TArray<AActor*>& goalActors, Get_Success& ReturnValue, TArray<FVector>& path, int& goalIndex, float agentRadius = 0.f);
+
+	//Cost Layers
+	//Costs live next to the grid and can be changed at any time without regeneration. Writing a single cell is a byte
+	//store that doesn't wait for running searches, only the first write to a layer allocates it. Painted costs stay when the grid gets regenerated with the same
+	//node count and layout, the ANavCostVolumes get repainted
+	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume|Cost Layers")
+	void SetCellCost(ENavCostLayer layer, FVector position, uint8 cost);
+	//Every node within the radius
+	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume|Cost Layers")
+	void PaintCostSphere(ENavCostLayer layer, FVector center, float radius, uint8 cost);
+	//Every node inside of the volume, paintedNodes gets the painted nodes
+	void PaintCostVolume(ENavCostLayer layer, const AVolume& volume, uint8 cost, TArray<FIntVector>* paintedNodes = nullptr);
+	//Sets the nodes back to 0, nodes that are not in the grid anymore are skipped
+	void ClearCostCells(ENavCostLayer layer, TConstArrayView<FIntVector> nodes);
+	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume|Cost Layers")
+	void ClearCostLayer(ENavCostLayer layer);
+	uint8 GetCellCost(ENavCostLayer layer, int nodeIndex) const;
+	//Cost of entering the node, at least 1
+	float GetTraversalCost(int nodeIndex, const FNavCostProfile& costProfile) const;
+	//Paints every ANavCostVolume that overlaps this volume
+	void ApplyCostVolumes();
+
+	//Reachability
+	//Every node that can be reached from the start within maxDistance of path distance, breadth first over the grid
+	//connections. Thread safe like GetPath. Streamed chunks that are not resident count as blocked
+	bool CalculateReachability(const FVector& start, float maxDistance, float agentRadius, FNavReachability& reachability) const;
+	//CalculateReachability on a worker thread, the volume has to stay alive until the task is done
+	UE::Tasks::TTask<FNavReachability> LaunchReachability(const FVector& start, float maxDistance, float agentRadius = 0.f) const;
+	//World positions of every node within maxDistance and their path distances
+	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume|Reachability", meta=(ExpandEnumAsExecs="ReturnValue"))
+	void GetReachablePositions(FVector startPos, AActor* startActor, float maxDistance, Get_Success& ReturnValue, TArray<FVector>& positions, TArray<float>& distances, float agentRadius = 0.f) const;
+	//Keeps only the positions whose closest free node is within maxDistance, reachableIndices point into positions
+	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume|Reachability", meta=(ExpandEnumAsExecs="ReturnValue"))
+	void FilterReachablePositions(FVector startPos, AActor* startActor, const TArray<FVector>& positions, float maxDistance, Get_Success& ReturnValue, TArray<int>& reachableIndices, TArray<float>& distances, float agentRadius = 0.f) const;
 	TArray<FVector> TracePath(TArray<F_YLayer> grid, FNavNode goalNode);
-	float CalculateH(float x, float y, float z, FNavNode goal);
+	float CalculateH(float x, float y, float z, FNavNode goal) const;
 	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume")
 	bool IsInsideVolume(FVector position) const;
 
 	UFUNCTION(CallInEditor, BlueprintCallable, Category = "Height Navigation Volume")
 	void ClearGrid();
+	//ClearGrid without the lock, for callers that already hold the write lock
+	void ClearGridTables();
+	//Refreshes the grid visualizer, see gridVisualizer for the display settings
 	UFUNCTION(CallInEditor, BlueprintCallable, Category = "Height Navigation Volume")
 	void ShowGrid();
+	UFUNCTION(CallInEditor, BlueprintCallable, Category = "Height Navigation Volume")
+	void HideGrid();
+
+	//Node access that works with the node table, the compressed and the streamed grid, everything on the search path goes through these
+	bool IsNodeBlocked(int x, int y, int z) const;
+	//Connections in the order of GetNeighbors (+x, -x, +y, -y, +z, -z), one bit per direction
+	uint8 GetConnectionMask(int x, int y, int z) const;
+	static uint8 GetConnectionMask(const FNavNode& node);
+	//Connection mask plus the blocked state in bit 7, the format of the compressed grid and the streamed chunks
+	uint8 GetNodeFlags(int x, int y, int z) const;
+	static const FIntVector& GetNeighborOffset(int direction);
 
 	//Is the position of the node inside the the boundaries or not
 	bool IsValid(FNavNode node) const;
 	bool IsValid(int x, int y, int z) const ;
 
 	//Is the position inside the grid unblocked and therefore able to be moved to
-	bool IsUnblocked(FNavNode node);
-	bool IsUnblocked(int x, int y, int z);
+	bool IsUnblocked(FNavNode node) const;
+	bool IsUnblocked(int x, int y, int z) const;
+
+	//Are both nodes direct neighbors that are connected with each other
+	bool IsConnected(int x, int y, int z, int neighborX, int neighborY, int neighborZ) const;
+
+	//Walks the line between the centers of both nodes through the grid (3D DDA) and checks that every
+	//step between two cells is a valid connection. No physics traces, only grid lookups
+	//Every cell on the line also needs at least requiredClearance
+	bool HasLineOfSight(const FIntVector& from, const FIntVector& to, uint8 requiredClearance = 0) const;
+
+	//String pulling: removes every node that can be skipped because there is a line of sight past it
+	//Returns: the amount of line of sight checks
+	int SmoothPath(TArray<FIntVector>& pathNodes, uint8 requiredClearance = 0) const;
+	void AppendWorldPath(const TArray<FIntVector>& pathNodes, TArray<FVector>& path) const;
+
+	//Grid search along the connections, expandedNodes collects the index of every expanded node when it is set
+	//costProfile weights the cost layers, without one every step costs 1. The search gives up after maxExpansions
+	//expanded nodes when it is above 0
+	bool FindPathAStar(const FIntVector& start, const FIntVector& goal, TArray<FIntVector>& pathNodes, int& expansions, FPathSearchScratch& scratch, uint8 requiredClearance = 0, TArray<int>* expandedNodes = nullptr, const FNavCostProfile* costProfile = nullptr, int maxExpansions = 0) const;
+
+	//One search towards all goals, stops at the first goal that gets expanded. reachedGoal is its index in goals.
+	//The heuristic is the minimum over the goals, with more than maxHeuristicGoals goals it is a Dijkstra search
+	bool FindPathToNearestNode(const FIntVector& start, TConstArrayView<FIntVector> goals, TArray<FIntVector>& pathNodes, int& reachedGoal, int& expansions, FPathSearchScratch& scratch, uint8 requiredClearance = 0, TArray<int>* expandedNodes = nullptr) const;
+
+	//Breadth first search that stops at maxSteps, the start needs no clearance
+	bool FindReachableNodes(const FIntVector& start, int maxSteps, uint8 requiredClearance, FPathSearchScratch& scratch, FNavReachability& reachability) const;
+
+	//Any angle search, the path contains only the corners
+	//expandedNodes collects the index of every expanded node when it is set
+	bool FindPathLazyThetaStar(const FIntVector& start, const FIntVector& goal, TArray<FIntVector>& pathNodes, int& expansions, int& lineOfSightChecks, FPathSearchScratch& scratch, uint8 requiredClearance = 0, TArray<int>* expandedNodes = nullptr) const;
+
+	//Search heat map for the grid visualizer, thread safe so searches of the agents on worker threads count too
+	void RecordSearchHeat(TConstArrayView<int> expandedNodes) const;
+	UFUNCTION(CallInEditor, Category = "Height Navigation Volume|Visualizer")
+	void ResetSearchHeat();
+	//Empty until the first search got recorded
+	void CopySearchHeat(TArray<uint16>& heat) const;
+
+	//Clearance
+	//Chebyshev distance (in nodes) from every node to the closest blocked node, calculated once after generation
+	void GenerateClearanceField();
+	//Clearance a node needs so an agent with the given radius fits into it. 0 and 1 don't filter anything,
+	//1 is every agent that fits into the box of a node (a quarter of distanceBetweenNodes)
+	uint8 GetRequiredClearance(float agentRadius) const;
+	bool HasClearance(int x, int y, int z, uint8 requiredClearance) const;
+	UFUNCTION(BlueprintCallable, Category = "Height Navigation Volume")
+	float GetClearanceAtPosition(FVector position) const;
+	//0 for blocked nodes, 255 when there is no clearance field
+	uint8 GetClearance(int x, int y, int z) const;
+	//Constant time check of the node closest to the position, no search for the closest free node like GetNodeFromPosition
+	bool IsPositionFree(const FVector& position, uint8 requiredClearance = 0) const;
+
+	//Runs the same random queries with A*, A* with smoothing and Lazy Theta* and logs waypoints, length and line of sight checks
+	UFUNCTION(CallInEditor, Category = "Height Navigation Volume")
+	void BenchmarkSearchModes();
 
 	//Is the given node at the same position as the goal Node
 	bool IsDestination(FNavNode node, FNavNode goal) const;
@@ -118,14 +390,85 @@ public:
 
 	//Takes the world position and sets it into context of the grid and
 	//returns a Node that as closest to the given point
-	FNavNode GetNodeFromPosition(FVector position, TArray<F_YLayer> grid);
+	FNavNode GetNodeFromPosition(FVector position) const;
+	//Constant time when the node closest to the position is free, otherwise the search of GetNodeFromPosition.
+	//(-1, -1, -1) when there is no free node
+	FIntVector ResolveNode(const FVector& position) const;
 
 	//Converts the position of a Node to world position
 	FVector GetWorldPositionFromNode(FNavNode node) const;
 
+	//Fractional grid position of a world position, node positions are whole numbers
+	FVector GetGridPositionFromWorld(const FVector& position) const;
+	FVector GetWorldPositionFromGridPosition(const FVector& gridPosition) const;
+
+	//Same overlap and trace checks that are used to generate the grid
+	bool IsOverlappingGeometry(const FVector& center, const FVector& extent);
+	bool IsConnectionFree(const FVector& start, const FVector& end) const;
+
+	//Index of a grid position inside of flat per node tables, like the landmark distances. Depends on the node layout
+	int GetNodeIndex(int x, int y, int z) const;
+	FIntVector GetNodeCoordinates(int index) const;
+	//Closest node to a world position, can be outside of the grid
+	FIntVector GetNodeCoordinatesFromWorld(const FVector& position) const;
+	//Size of the flat per node tables, bricked layouts round every axis up to whole bricks.
+	//Indices of the padding are outside of the grid, see IsValid
+	int GetNodeCount() const;
+	//Index of the neighbor of the node at index and position in the given direction (see GetNeighborOffset),
+	//without the divisions of GetNodeIndex as long as the neighbor is in the same brick
+	int GetNeighborIndex(int index, const FIntVector& position, int direction) const;
+
+	//Moves the flat per node tables, the node table included, into the new order right away
+	void SetNodeLayout(ENodeLayout layout);
+	//Runs the same random A* queries with every node layout and logs the time per query and the expansions per millisecond
+	UFUNCTION(CallInEditor, Category = "Height Navigation Volume")
+	void BenchmarkNodeLayout();
+
+	//Landmark Heuristic
+	//Picks landmarkCount nodes spread across the grid and stores the step distance from each of them to every node
+	void GenerateLandmarks();
+	//Breadth first search from one node over the neighbor connections, unreachable nodes keep MAX_uint16
+	void CalculateDistancesFromNode(int x, int y, int z, TArray<uint16>& distances);
+	//Hash over the blocked states and connection masks, used to check if the saved landmark tables, the path database
+	//and the baked navigation chunks still fit the grid
+	uint32 CalculateGridHash() const;
+
+	//Runs the same random queries with and without landmarks and logs the expanded nodes of both
+	UFUNCTION(CallInEditor, Category = "Height Navigation Volume|Landmarks")
+	void ReportLandmarkSavings();
+
 	FVector GetGridSize() const;
 
+	//Compression
+	//Replaces the node table with the compressed grid, see compressGrid
+	void CompressGrid();
+	//Writes the blocked states and connections of the nested grid into nodeFlags and frees navNodeGrid. Call with the write lock held
+	void BuildNodeFlags(const TArray<F_YLayer>& grid);
+	//Builds a compressed grid from the current grid, the accessors use it once it is moved into compressedGrid
+	void BuildCompressedGrid(FCompressedGrid& grid) const;
+	//Runs the same random queries on the node table and the compressed grid and logs the memory of both and the search times
+	UFUNCTION(CallInEditor, Category = "Height Navigation Volume|Compression")
+	void BenchmarkGridCompression();
+
+	//Path Database
+	//Generates the grid and bakes the first move tables of every free node, see FNavPathDatabase
+	UFUNCTION(CallInEditor, Category = "Height Navigation Volume|Path Database")
+	void BakePathDatabase();
+	//Runs the same random queries with A* and with the path database and logs the time per query of both
+	UFUNCTION(CallInEditor, Category = "Height Navigation Volume|Path Database")
+	void BenchmarkPathDatabase();
+
+	//Streaming
+	//Generates the grid and writes it to one file per chunk, see FNavGridStreaming. Needs all geometry loaded
+	UFUNCTION(CallInEditor, Category = "Height Navigation Volume|Streaming")
+	void BakeNavigationChunks();
+	//Frees the generated grid, the nodes are read from the resident chunks of gridStreaming
+	void InitializeStreamedGrid();
+	FNavGridStreaming& GetGridStreaming() { return gridStreaming; }
+	FRWLock& GetGridLock() const { return gridLock; }
+
 	void BeginPlay() override;
+	void EndPlay(const EEndPlayReason::Type endPlayReason) override;
 
 	/*
 	//TEST FUNCTIONS!!!!
@@ -148,12 +491,82 @@ public:
 	UPROPERTY(EditAnywhere, Category="Height Navigation Volume", meta=(Units="cm"), BlueprintReadOnly)
 	float distanceBetweenNodes = 800;
 
+	//Uses the distances to a couple of precomputed landmark nodes as heuristic, which is a lot tighter than the
+	//manhattan distance in maze like interiors. Costs landmarkCount * 2 bytes per node
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume|Landmarks", BlueprintReadOnly)
+	bool useLandmarkHeuristic = false;
+
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume|Landmarks", meta = (EditCondition = "useLandmarkHeuristic", ClampMin = 1, ClampMax = 16), BlueprintReadOnly)
+	int landmarkCount = 4;
+
+	//Straightens every path returned by GetPath using line of sight checks on the grid,
+	//movers don't have to look for shortcuts with physics traces while following them
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume", BlueprintReadOnly)
+	bool smoothPaths = true;
+
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume", BlueprintReadOnly)
+	EPathSearchMode searchMode = EPathSearchMode::AStar;
+
+	//Order of the flat per node tables (node table, clearance, landmarks, cost layers and the search state). Bricked keeps the
+	//neighbors of a node mostly on the same cache lines, Linear doesn't pad the tables. Used when the grid gets generated
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume", BlueprintReadOnly)
+	ENodeLayout nodeLayout = ENodeLayout::Bricked;
+
+	//Amount of resolution levels, every level halves distanceBetweenNodes but only inside of cells that intersect
+	//geometry. GetPath searches the multi resolution grid when this is greater than 1, without landmarks or smoothing.
+	//Agents wider than the finest cells and queries with a weighted cost profile still search the regular grid
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume", meta = (ClampMin = 1, ClampMax = 3), BlueprintReadOnly)
+	int resolutionLevels = 1;
+
+	//Finds the blocked nodes by collecting the collision geometry in the volume once (see FGridVoxelizer),
+	//instead of one overlap query per node
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume", BlueprintReadOnly)
+	bool voxelizeGeometry = true;
+
+	//How the connections between neighboring nodes are checked, everything but Traces needs voxelizeGeometry
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume", meta = (EditCondition = "voxelizeGeometry"), BlueprintReadOnly)
+	EEdgeValidation edgeValidation = EEdgeValidation::Occupancy;
+
+	UPROPERTY(VisibleAnywhere, Category = "Height Navigation Volume|Visualizer", BlueprintReadOnly)
+	TObjectPtr<UNavGridVisualizerComponent> gridVisualizer;
+
+	//Keeps the blocked states and connections in compressed bricks (see FCompressedGrid) instead of the node table after
+	//generation. Searches get a bit slower, for servers that are short on memory. Not used with streamNavigationData
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume|Compression", BlueprintReadOnly)
+	bool compressGrid = false;
+
+	//Answers GetPath with the baked first move tables (see BakePathDatabase) instead of searching.
+	//The tables know nothing about clearance, agents that need more than a free node (see GetRequiredClearance) still search
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume|Path Database", BlueprintReadOnly)
+	bool usePathDatabase = false;
+
+	//Volumes with more free nodes don't get a path database, building it takes one search per free node
+	//and the tables grow with the square of the free nodes before compression
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume|Path Database", meta = (ClampMin = 2), BlueprintReadOnly)
+	int pathDatabaseMaxNodes = 20000;
+
+	//Loads the baked chunks (see BakeNavigationChunks) as the levels around them stream in,
+	//instead of generating the whole grid on BeginPlay
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume|Streaming", BlueprintReadOnly)
+	bool streamNavigationData = false;
+
+	//Upper limit for the node data (connections, clearance and components) of the resident chunks in megabytes.
+	//The coarse layer and painted cost layers are not part of it
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume|Streaming", meta = (EditCondition = "streamNavigationData", ClampMin = 1), BlueprintReadOnly)
+	float streamingBudgetMB = 64;
+
+	//Counts how often every node gets expanded by GetPath, shown by the search heat mode of the grid visualizer
+	UPROPERTY(EditAnywhere, Category = "Height Navigation Volume|Visualizer", BlueprintReadWrite)
+	bool recordSearchHeat = false;
+
 protected:
 	UPROPERTY(EditInstanceOnly, Category = "Height Navigation Volume")
 	bool showDebugSettings = false;
 
 	//UPROPERTY(VisibleInstanceOnly, Category = "Height Navigation Volume", meta = (EditCondition = "showDebugSettings==true", EditConditionHides))
 	TArray<F_YLayer> navNodeGrid = TArray<F_YLayer>();
+	//GetNodeFlags of every node in GetNodeIndex order, padding is blocked. Replaces navNodeGrid once the connections are set up
+	TArray<uint8> nodeFlags;
 
 	UPROPERTY(VisibleInstanceOnly, Category = "Height Navigation Volume", meta = (EditCondition = "showDebugSettings==true", EditConditionHides))
 	FVector startPosition = FVector();
@@ -168,10 +581,72 @@ protected:
 	int yNodes{ 0 };
 	UPROPERTY(VisibleInstanceOnly, Category = "Height Navigation Volume", meta = (EditCondition = "showDebugSettings==true", EditConditionHides))
     int zNodes{ 0 };
+	//nodeLayout at the time the node count got initialized, the order every flat per node table is in right now
+	UPROPERTY(VisibleInstanceOnly, Category = "Height Navigation Volume", meta = (EditCondition = "showDebugSettings==true", EditConditionHides))
+	ENodeLayout tableLayout = ENodeLayout::Linear;
 
 	UPROPERTY(VisibleInstanceOnly, Category = "Height Navigation Volume", meta = (EditCondition = "showDebugSettings==true", EditConditionHides))
 	TArray<AHeightNavigationVolume*> overlappingVolumes = TArray<AHeightNavigationVolume*>();
 
+	//Amount of nodes taken out of the open list during the last GetPath call
+	UPROPERTY(VisibleInstanceOnly, Category = "Height Navigation Volume", meta = (EditCondition = "showDebugSettings==true", EditConditionHides))
+	int lastSearchExpansions = 0;
+
+	UPROPERTY(VisibleInstanceOnly, Category = "Height Navigation Volume", meta = (EditCondition = "showDebugSettings==true", EditConditionHides))
+	int lastSearchLineOfSightChecks = 0;
+
+	UPROPERTY(VisibleInstanceOnly, Category = "Height Navigation Volume|Landmarks", meta = (EditCondition = "showDebugSettings==true", EditConditionHides))
+	TArray<FIntVector> landmarks = TArray<FIntVector>();
+
+	//Step distances of every node for each landmark, landmark after landmark (landmark * nodeCount + nodeIndex).
+	//Saved with the volume, so the tables only have to be recalculated when the grid hash changes
+	UPROPERTY()
+	TArray<uint16> landmarkDistances = TArray<uint16>();
+
+	UPROPERTY()
+	uint32 landmarkGridHash = 0;
+
+	FMultiResolutionGrid multiResolutionGrid;
+
+	//Distance transform of the blocked nodes and of free nodes with a missing connection (1), 0 for blocked nodes and capped
+	//at 255. A node with clearance c >= 2 has roughly (c - 0.5) * distanceBetweenNodes of free space in every direction,
+	//clearance 1 only guarantees the box of the node. Empty while streaming, the resident chunks hold the clearance
+	UPROPERTY()
+	TArray<uint8> clearanceField = TArray<uint8>();
+
+	mutable TArray<uint16> searchHeat = TArray<uint16>();
+	mutable FCriticalSection searchHeatLock;
+
+	//Search states of finished queries, so every query doesn't have to allocate its own
+	TUniquePtr<FPathSearchScratch> AcquireSearchScratch() const;
+	void ReleaseSearchScratch(TUniquePtr<FPathSearchScratch> scratch) const;
+	mutable TArray<TUniquePtr<FPathSearchScratch>> searchScratchPool;
+	mutable FCriticalSection searchScratchLock;
+
+	//Saved with the volume, written by BakeNavigationChunks
+	UPROPERTY()
+	FNavGridCoarseLayer coarseLayer;
+
+	//Saved with the volume, written by BakePathDatabase
+	UPROPERTY()
+	FNavPathDatabase pathDatabase;
+
+	//Everything GetPath does after resolving the actors, with the search state of the caller. Needs the read lock
+	Get_Success FindPath(const FVector& start, const FVector& goal, float agentRadius, FPathSearchScratch& scratch, TArray<FVector>& path, int& expansions, int& lineOfSightChecks, TArray<int>* expandedNodes, const FNavCostProfile* costProfile = nullptr);
+	//Allocates the layer with the write lock on the first write. Game thread only, the bytes are written
+	//without the lock with relaxed stores, searches read them with relaxed loads
+	uint8* GetWritableCostLayer(ENavCostLayer layer);
+	//Same for GetPathToNearest
+	Get_Success FindPathToNearest(const FVector& start, TConstArrayView<FVector> goals, float agentRadius, FPathSearchScratch& scratch, TArray<FVector>& path, int& goalIndex, int& expansions, int& lineOfSightChecks, TArray<int>* expandedNodes);
+
+	//One byte per node and layer in GetNodeIndex order, empty until something gets painted
+	TArray<uint8> costLayers[int(ENavCostLayer::Count)];
+
+	FNavGridStreaming gridStreaming;
+	FCompressedGrid compressedGrid;
+	//Searches read the grid while streamed chunks get written on the game thread
+	mutable FRWLock gridLock;
+
 	//UPROPERTY(VisibleInstanceOnly, Category = "Height Navigation Volume", meta = (EditCondition = "showDebugSettings==true", EditConditionHides))
 	//int steps = 0;
 
@@ -0,0 +1,304 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiResolutionGrid.h"
+
+#include <queue>
+
+#include "Algo/Reverse.h"
+#include "GridVoxelizer.h"
+#include "HeightNavigationVolume.h"
+
+void FMultiResolutionGrid::Build(AHeightNavigationVolume* Volume, int ResolutionLevels, const FGridVoxelizer* Voxelizer)
+{
+	Reset();
+	if (!Volume || Volume->IsGridEmpty()) return;
+
+	const FVector GridSize = Volume->GetGridSize();
+	CoarseCount = FIntVector(GridSize.X, GridSize.Y, GridSize.Z);
+	Subdivisions = 1 << (FMath::Clamp(ResolutionLevels, 1, 3) - 1);
+
+	CoarseLeaves.Init(INDEX_NONE, CoarseCount.X * CoarseCount.Y * CoarseCount.Z);
+
+	//Coarse level first, only cells that intersect geometry get refined
+	for (int x = 0; x < CoarseCount.X; x++)
+	{
+		for (int y = 0; y < CoarseCount.Y; y++)
+		{
+			for (int z = 0; z < CoarseCount.Z; z++)
+			{
+				//Own x, y, z order like FindCell, the node index of the volume depends on its node layout
+				RefineCell(Volume, Voxelizer, FIntVector(x, y, z) * Subdivisions, Subdivisions, 0, (x * CoarseCount.Y + y) * CoarseCount.Z + z);
+			}
+		}
+	}
+
+	LinkCells(Volume, Voxelizer);
+
+	const int64 FinestCellCount = int64(CoarseLeaves.Num()) * Subdivisions * Subdivisions * Subdivisions;
+	UE_LOG(LogTemp, Log, TEXT("%s - Multi resolution grid: %d leaves (%d coarse cells, %d refined) instead of %lld cells at the finest level, %d cross level links"),
+		*Volume->GetName(), Cells.Num(), CoarseLeaves.Num(), RefinedOffsets.Num(), FinestCellCount, CrossLevelLinks);
+}
+
+void FMultiResolutionGrid::Reset()
+{
+	Cells.Empty();
+	CoarseLeaves.Empty();
+	RefinedOffsets.Empty();
+	RefinedLeaves.Empty();
+	CoarseCount = FIntVector::ZeroValue;
+	Subdivisions = 1;
+	CrossLevelLinks = 0;
+}
+
+void FMultiResolutionGrid::RefineCell(AHeightNavigationVolume* Volume, const FGridVoxelizer* Voxelizer, const FIntVector& Origin, int Size, int Level, int CoarseIndex)
+{
+	const FVector Center = GetCellCenter(*Volume, Origin, Size);
+	const float CellExtent = Volume->distanceBetweenNodes * Size / Subdivisions * 0.5f;
+	auto OverlapsGeometry = [Volume, Voxelizer, &Center](float Extent)
+	{
+		return Voxelizer ? Voxelizer->OverlapsBox(Center, Extent) : Volume->IsOverlappingGeometry(Center, FVector(Extent));
+	};
+	const bool Intersects = OverlapsGeometry(CellExtent);
+
+	if (Intersects && Size > 1)
+	{
+		if (Level == 0)
+		{
+			RefinedOffsets.Add(CoarseIndex, RefinedLeaves.Num());
+			RefinedLeaves.AddUninitialized(Subdivisions * Subdivisions * Subdivisions);
+		}
+
+		const int HalfSize = Size / 2;
+		for (int i = 0; i < 8; i++)
+		{
+			const FIntVector ChildOffset = FIntVector(i & 1, (i >> 1) & 1, (i >> 2) & 1) * HalfSize;
+			RefineCell(Volume, Voxelizer, Origin + ChildOffset, HalfSize, Level + 1, CoarseIndex);
+		}
+		return;
+	}
+
+	FCell Cell;
+	Cell.Origin = Origin;
+	Cell.Size = Size;
+	Cell.Level = Level;
+	Cell.Center = Center;
+	//Leaves at the finest level still intersect geometry, they use the same test as the regular grid
+	Cell.Blocked = Intersects && OverlapsGeometry(CellExtent * 0.5f);
+	const int CellIndex = Cells.Add(MoveTemp(Cell));
+
+	if (Level == 0)
+	{
+		CoarseLeaves[CoarseIndex] = CellIndex;
+		return;
+	}
+
+	const int Offset = RefinedOffsets[CoarseIndex];
+	const FIntVector CoarseOrigin = FIntVector(Origin.X / Subdivisions, Origin.Y / Subdivisions, Origin.Z / Subdivisions) * Subdivisions;
+	for (int x = 0; x < Size; x++)
+	{
+		for (int y = 0; y < Size; y++)
+		{
+			for (int z = 0; z < Size; z++)
+			{
+				const FIntVector Sub = Origin + FIntVector(x, y, z) - CoarseOrigin;
+				RefinedLeaves[Offset + (Sub.X * Subdivisions + Sub.Y) * Subdivisions + Sub.Z] = CellIndex;
+			}
+		}
+	}
+}
+
+int FMultiResolutionGrid::FindCell(const FIntVector& FinestPosition) const
+{
+	if (FinestPosition.X < 0 || FinestPosition.Y < 0 || FinestPosition.Z < 0) return INDEX_NONE;
+
+	const FIntVector Coarse = FIntVector(FinestPosition.X / Subdivisions, FinestPosition.Y / Subdivisions, FinestPosition.Z / Subdivisions);
+	if (Coarse.X >= CoarseCount.X || Coarse.Y >= CoarseCount.Y || Coarse.Z >= CoarseCount.Z) return INDEX_NONE;
+
+	const int CoarseIndex = (Coarse.X * CoarseCount.Y + Coarse.Y) * CoarseCount.Z + Coarse.Z;
+	if (CoarseLeaves[CoarseIndex] != INDEX_NONE) return CoarseLeaves[CoarseIndex];
+
+	const int* Offset = RefinedOffsets.Find(CoarseIndex);
+	if (!Offset) return INDEX_NONE;
+
+	const FIntVector Sub = FinestPosition - Coarse * Subdivisions;
+	return RefinedLeaves[*Offset + (Sub.X * Subdivisions + Sub.Y) * Subdivisions + Sub.Z];
+}
+
+FIntVector FMultiResolutionGrid::GetFinestPosition(const AHeightNavigationVolume& Volume, const FVector& Position) const
+{
+	//Node positions are the centers of the coarse cells
+	const FVector GridPosition = (Volume.GetGridPositionFromWorld(Position) + FVector(0.5f)) * Subdivisions;
+	return FIntVector(FMath::FloorToInt(GridPosition.X), FMath::FloorToInt(GridPosition.Y), FMath::FloorToInt(GridPosition.Z));
+}
+
+int FMultiResolutionGrid::FindCell(const AHeightNavigationVolume& Volume, const FVector& Position) const
+{
+	if (!IsBuilt()) return INDEX_NONE;
+	return FindCell(GetFinestPosition(Volume, Position));
+}
+
+int FMultiResolutionGrid::ResolveCell(const AHeightNavigationVolume& Volume, const FVector& Position) const
+{
+	if (!IsBuilt()) return INDEX_NONE;
+
+	const FIntVector Center = GetFinestPosition(Volume, Position);
+	const int Cell = FindCell(Center);
+	if (Cell != INDEX_NONE && !Cells[Cell].Blocked) return Cell;
+
+	//Shell by shell around the position, the first shell with a free leaf has the closest one in it
+	//(or one almost as close, leaves can be bigger than a shell)
+	int Closest = INDEX_NONE;
+	double ClosestDistance = DBL_MAX;
+	for (int Ring = 1; Ring <= MaxResolveDistance * Subdivisions && Closest == INDEX_NONE; Ring++)
+	{
+		for (int x = -Ring; x <= Ring; x++)
+		{
+			for (int y = -Ring; y <= Ring; y++)
+			{
+				for (int z = -Ring; z <= Ring; z++)
+				{
+					if (FMath::Max3(FMath::Abs(x), FMath::Abs(y), FMath::Abs(z)) != Ring) continue;
+
+					const int Neighbor = FindCell(Center + FIntVector(x, y, z));
+					if (Neighbor == INDEX_NONE || Cells[Neighbor].Blocked) continue;
+
+					const double Distance = FVector::DistSquared(Cells[Neighbor].Center, Position);
+					if (Distance < ClosestDistance)
+					{
+						ClosestDistance = Distance;
+						Closest = Neighbor;
+					}
+				}
+			}
+		}
+	}
+	return Closest;
+}
+
+float FMultiResolutionGrid::GetFinestCellSize(const AHeightNavigationVolume& Volume) const
+{
+	return Volume.distanceBetweenNodes / Subdivisions;
+}
+
+FVector FMultiResolutionGrid::GetCellCenter(const AHeightNavigationVolume& Volume, const FIntVector& Origin, int Size) const
+{
+	const FVector GridPosition = (FVector(Origin) + FVector(Size * 0.5f)) / Subdivisions - FVector(0.5f);
+	return Volume.GetWorldPositionFromGridPosition(GridPosition);
+}
+
+void FMultiResolutionGrid::LinkCells(AHeightNavigationVolume* Volume, const FGridVoxelizer* Voxelizer)
+{
+	const FIntVector Directions[6] = {
+		FIntVector(1, 0, 0), FIntVector(-1, 0, 0),
+		FIntVector(0, 1, 0), FIntVector(0, -1, 0),
+		FIntVector(0, 0, 1), FIntVector(0, 0, -1),
+	};
+
+	for (int i = 0; i < Cells.Num(); i++)
+	{
+		if (Cells[i].Blocked) continue;
+
+		for (const FIntVector& Direction : Directions)
+		{
+			const int Axis = Direction.X != 0 ? 0 : (Direction.Y != 0 ? 1 : 2);
+			const int AxisA = (Axis + 1) % 3;
+			const int AxisB = (Axis + 2) % 3;
+
+			//Every finest cell just outside of this face, bigger neighbors show up multiple times
+			for (int a = 0; a < Cells[i].Size; a++)
+			{
+				for (int b = 0; b < Cells[i].Size; b++)
+				{
+					FIntVector Outside = Cells[i].Origin;
+					Outside[Axis] += Direction[Axis] > 0 ? Cells[i].Size : -1;
+					Outside[AxisA] += a;
+					Outside[AxisB] += b;
+
+					//Links go both ways, so every pair only has to be checked from one side
+					const int Neighbor = FindCell(Outside);
+					if (Neighbor == INDEX_NONE || Neighbor <= i || Cells[Neighbor].Blocked) continue;
+					if (Cells[i].Links.Contains(Neighbor)) continue;
+					//Traces only for links the voxelizer can't answer
+					const FGridVoxelizer::EEdgeState State = Voxelizer ? Voxelizer->ClassifySegment(Cells[i].Center, Cells[Neighbor].Center) : FGridVoxelizer::EEdgeState::NeedsTrace;
+					if (State == FGridVoxelizer::EEdgeState::Blocked) continue;
+					if (State == FGridVoxelizer::EEdgeState::NeedsTrace && !Volume->IsConnectionFree(Cells[i].Center, Cells[Neighbor].Center)) continue;
+
+					Cells[i].Links.Add(Neighbor);
+					Cells[Neighbor].Links.Add(i);
+					if (Cells[i].Level != Cells[Neighbor].Level) CrossLevelLinks++;
+				}
+			}
+		}
+	}
+}
+
+bool FMultiResolutionGrid::FindPath(const AHeightNavigationVolume& Volume, const FVector& Start, const FVector& Goal, TArray<FVector>& Path, int& Expansions) const
+{
+	Path.Empty();
+	Expansions = 0;
+
+	const int StartCell = ResolveCell(Volume, Start);
+	const int GoalCell = ResolveCell(Volume, Goal);
+	if (StartCell == INDEX_NONE || GoalCell == INDEX_NONE) return false;
+
+	if (StartCell == GoalCell)
+	{
+		Path.Add(Goal);
+		return true;
+	}
+
+	struct FOpenEntry
+	{
+		float FCost;
+		int Index;
+		bool operator<(const FOpenEntry& Other) const { return FCost > Other.FCost; }
+	};
+
+	TArray<float> GCosts;
+	TArray<int> Parents;
+	TArray<bool> Closed;
+	GCosts.Init(FLT_MAX, Cells.Num());
+	Parents.Init(INDEX_NONE, Cells.Num());
+	Closed.Init(false, Cells.Num());
+
+	const FVector& GoalCenter = Cells[GoalCell].Center;
+	std::priority_queue<FOpenEntry> OpenQueue;
+	GCosts[StartCell] = 0;
+	Parents[StartCell] = StartCell;
+	OpenQueue.push({ float(FVector::Distance(Cells[StartCell].Center, GoalCenter)), StartCell });
+
+	while (!OpenQueue.empty())
+	{
+		const int Current = OpenQueue.top().Index;
+		OpenQueue.pop();
+		if (Closed[Current]) continue;
+		Closed[Current] = true;
+		Expansions++;
+
+		if (Current == GoalCell)
+		{
+			for (int Index = GoalCell; ; Index = Parents[Index])
+			{
+				Path.Add(Cells[Index].Center);
+				if (Parents[Index] == Index) break;
+			}
+			Algo::Reverse(Path);
+			Path.Add(Goal);
+			return true;
+		}
+
+		for (const int Link : Cells[Current].Links)
+		{
+			if (Closed[Link]) continue;
+
+			const float GNew = GCosts[Current] + FVector::Distance(Cells[Current].Center, Cells[Link].Center);
+			if (GNew >= GCosts[Link]) continue;
+
+			GCosts[Link] = GNew;
+			Parents[Link] = Current;
+			OpenQueue.push({ GNew + float(FVector::Distance(Cells[Link].Center, GoalCenter)), Link });
+		}
+	}
+	return false;
+}
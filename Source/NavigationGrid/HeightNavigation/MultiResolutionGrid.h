@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AHeightNavigationVolume;
+class FGridVoxelizer;
+
+/**
+ * Sparse grid with up to three resolution levels.
+ * The coarse level uses the distanceBetweenNodes of the volume, only coarse cells that intersect geometry get
+ * subdivided (halving the spacing per level). Every cell that is not subdivided any further is a leaf and
+ * leaves are connected through links, links between leaves of different sizes are the cross level links.
+ * Leaves have no clearance and no cost layers, the volume only searches here for agents that fit into the finest cells.
+ */
+class NAVIGATIONGRID_API FMultiResolutionGrid
+{
+public:
+	struct FCell
+	{
+		//Grid position of the min corner and the edge length, both in finest level units
+		FIntVector Origin = FIntVector::ZeroValue;
+		int Size = 1;
+		//0 is the coarse level
+		int Level = 0;
+		bool Blocked = false;
+		FVector Center = FVector::ZeroVector;
+		TArray<int> Links;
+	};
+
+	//Tests the cells and links against the shapes of the voxelizer when there is one, otherwise with overlap queries and traces
+	void Build(AHeightNavigationVolume* Volume, int ResolutionLevels, const FGridVoxelizer* Voxelizer = nullptr);
+	void Reset();
+
+	bool IsBuilt() const { return !Cells.IsEmpty(); }
+	//Edge length of the finest cells in world units
+	float GetFinestCellSize(const AHeightNavigationVolume& Volume) const;
+
+	//A* over the leaves using euclidean costs, path contains the leaf centers and ends with the goal position
+	bool FindPath(const AHeightNavigationVolume& Volume, const FVector& Start, const FVector& Goal, TArray<FVector>& Path, int& Expansions) const;
+
+	//Leaf containing the world position, INDEX_NONE when outside of the grid
+	int FindCell(const AHeightNavigationVolume& Volume, const FVector& Position) const;
+	//Free leaf closest to the position, like ResolveNode of the volume. Positions inside of geometry (a pawn touching
+	//a wall, an actor inside of its own collision) look up to MaxResolveDistance coarse cells around them,
+	//INDEX_NONE when there is no free leaf that close
+	int ResolveCell(const AHeightNavigationVolume& Volume, const FVector& Position) const;
+
+	static constexpr int MaxResolveDistance = 2;
+
+	const TArray<FCell>& GetCells() const { return Cells; }
+
+private:
+	void RefineCell(AHeightNavigationVolume* Volume, const FGridVoxelizer* Voxelizer, const FIntVector& Origin, int Size, int Level, int CoarseIndex);
+	int FindCell(const FIntVector& FinestPosition) const;
+	FIntVector GetFinestPosition(const AHeightNavigationVolume& Volume, const FVector& Position) const;
+	FVector GetCellCenter(const AHeightNavigationVolume& Volume, const FIntVector& Origin, int Size) const;
+	void LinkCells(AHeightNavigationVolume* Volume, const FGridVoxelizer* Voxelizer);
+
+	TArray<FCell> Cells;
+
+	//Leaf of each coarse cell, INDEX_NONE when the coarse cell got subdivided
+	TArray<int> CoarseLeaves;
+	//Offset into RefinedLeaves for every subdivided coarse cell, Subdivisions^3 leaf indices each
+	TMap<int, int> RefinedOffsets;
+	TArray<int> RefinedLeaves;
+
+	FIntVector CoarseCount = FIntVector::ZeroValue;
+	//Finest cells per coarse cell edge
+	int Subdivisions = 1;
+	int CrossLevelLinks = 0;
+};
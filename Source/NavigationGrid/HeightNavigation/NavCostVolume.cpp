@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavCostVolume.h"
+
+#include "Kismet/GameplayStatics.h"
+
+void ANavCostVolume::Apply()
+{
+    TArray<AActor*> navigationVolumes;
+    UGameplayStatics::GetAllActorsOfClass(this, AHeightNavigationVolume::StaticClass(), navigationVolumes);
+
+    for (AActor* actor : navigationVolumes)
+    {
+        AHeightNavigationVolume* volume = Cast<AHeightNavigationVolume>(actor);
+        if (volume->IsGridEmpty()) continue;
+        ApplyTo(*volume);
+    }
+}
+
+void ANavCostVolume::ApplyTo(AHeightNavigationVolume& volume)
+{
+    FPaintedNodes& painted = paintedNodes.FindOrAdd(&volume);
+    if (!painted.nodes.IsEmpty())
+    {
+        volume.ClearCostCells(painted.layer, painted.nodes);
+
+        //Other cost volumes on the same layer lost their cost where they overlap the cleared nodes
+        TArray<AActor*> costVolumes;
+        UGameplayStatics::GetAllActorsOfClass(this, StaticClass(), costVolumes);
+        for (AActor* actor : costVolumes)
+        {
+            const ANavCostVolume* other = Cast<ANavCostVolume>(actor);
+            if (other == this || other->layer != painted.layer) continue;
+            if (!other->GetBounds().GetBox().Intersect(painted.bounds)) continue;
+            volume.PaintCostVolume(other->layer, *other, other->cost);
+        }
+    }
+
+    volume.PaintCostVolume(layer, *this, cost, &painted.nodes);
+    painted.layer = layer;
+    painted.bounds = GetBounds().GetBox();
+}
+
+void ANavCostVolume::BeginPlay()
+{
+    Super::BeginPlay();
+    Apply();
+}
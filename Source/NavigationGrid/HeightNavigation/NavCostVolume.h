@@ -0,0 +1,46 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Volume.h"
+#include "HeightNavigationVolume.h"
+#include "NavCostVolume.generated.h"
+
+/**
+ * Paints a cost into one cost layer of every height navigation volume it overlaps, see FNavCostProfile.
+ * The navigation volumes repaint it whenever their grid gets generated, Apply repaints it after it got moved.
+ * Every repaint clears the nodes of the last one first.
+ */
+UCLASS()
+class NAVIGATIONGRID_API ANavCostVolume : public AVolume
+{
+	GENERATED_BODY()
+
+public:
+	//Paints the cost into the grids that are already generated
+	UFUNCTION(BlueprintCallable, CallInEditor, Category = "Nav Cost Volume")
+	void Apply();
+	//Clears what the last call painted into the volume and paints the current shape, layer and cost
+	void ApplyTo(AHeightNavigationVolume& volume);
+
+	void BeginPlay() override;
+
+	UPROPERTY(EditAnywhere, Category = "Nav Cost Volume", BlueprintReadWrite)
+	ENavCostLayer layer = ENavCostLayer::Danger;
+
+	//0 is no extra cost, 255 is the full weight of the layer
+	UPROPERTY(EditAnywhere, Category = "Nav Cost Volume", BlueprintReadWrite)
+	uint8 cost = 128;
+
+private:
+	struct FPaintedNodes
+	{
+		ENavCostLayer layer = ENavCostLayer::Count;
+		FBox bounds = FBox(ForceInit);
+		TArray<FIntVector> nodes;
+	};
+
+	//What the last ApplyTo painted into every navigation volume
+	TMap<TWeakObjectPtr<AHeightNavigationVolume>, FPaintedNodes> paintedNodes;
+};
@@ -0,0 +1,735 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavGridStreaming.h"
+
+#include <queue>
+
+#include "Algo/BinarySearch.h"
+#include "Algo/Reverse.h"
+#include "Async/Async.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HeightNavigationVolume.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Tasks/Task.h"
+
+namespace
+{
+	constexpr uint32 ChunkFileMagic = 0x4B43474E;
+	constexpr int32 ChunkFileVersion = 1;
+	constexpr uint8 BlockedNodeBit = 1 << 7;
+	constexpr uint16 NoComponent = MAX_uint16;
+	//Landscapes and other huge components would pull in most of the grid with a single level,
+	//paths load what they need of them
+	constexpr int32 MaxChunksPerComponent = 64;
+
+	//Same order as AHeightNavigationVolume::GetNeighbors
+	const FIntVector Directions[6] = {
+		FIntVector(1, 0, 0), FIntVector(-1, 0, 0),
+		FIntVector(0, 1, 0), FIntVector(0, -1, 0),
+		FIntVector(0, 0, 1), FIntVector(0, 0, -1),
+	};
+
+	bool IsInsideChunk(const FIntVector& Local, const FIntVector& Size)
+	{
+		return Local.X >= 0 && Local.Y >= 0 && Local.Z >= 0 && Local.X < Size.X && Local.Y < Size.Y && Local.Z < Size.Z;
+	}
+
+	//Flood fills the free nodes along the connections that stay inside of the chunk,
+	//components are numbered in chunk local x, y, z order of their first node. Returns the component count
+	int32 FindComponents(const TArray<uint8>& Flags, const FIntVector& Size, TArray<uint16>& Components)
+	{
+		Components.Init(NoComponent, Flags.Num());
+		int32 ComponentCount = 0;
+		TArray<int32> Stack;
+		for (int32 Seed = 0; Seed < Flags.Num(); Seed++)
+		{
+			if ((Flags[Seed] & BlockedNodeBit) || Components[Seed] != NoComponent) continue;
+
+			Components[Seed] = uint16(ComponentCount);
+			Stack.Add(Seed);
+			while (!Stack.IsEmpty())
+			{
+				const int32 Index = Stack.Pop(EAllowShrinking::No);
+				const FIntVector Local(Index / (Size.Y * Size.Z), (Index / Size.Z) % Size.Y, Index % Size.Z);
+				for (int32 Direction = 0; Direction < 6; Direction++)
+				{
+					if (!(Flags[Index] & (1 << Direction))) continue;
+
+					const FIntVector Neighbor = Local + Directions[Direction];
+					if (!IsInsideChunk(Neighbor, Size)) continue;
+
+					const int32 NeighborIndex = (Neighbor.X * Size.Y + Neighbor.Y) * Size.Z + Neighbor.Z;
+					if ((Flags[NeighborIndex] & BlockedNodeBit) || Components[NeighborIndex] != NoComponent) continue;
+					Components[NeighborIndex] = uint16(ComponentCount);
+					Stack.Add(NeighborIndex);
+				}
+			}
+			ComponentCount++;
+		}
+		return ComponentCount;
+	}
+}
+
+void FNavGridCoarseLayer::Reset()
+{
+	NodeCount = FIntVector::ZeroValue;
+	ChunkCount = FIntVector::ZeroValue;
+	GridHash = 0;
+	ComponentOffsets.Empty();
+	Anchors.Empty();
+	LinkOffsets.Empty();
+	Links.Empty();
+}
+
+FIntVector FNavGridCoarseLayer::GetChunkCoordinates(int32 ChunkIndex) const
+{
+	const int32 Z = ChunkIndex % ChunkCount.Z;
+	const int32 Y = (ChunkIndex / ChunkCount.Z) % ChunkCount.Y;
+	const int32 X = ChunkIndex / (ChunkCount.Z * ChunkCount.Y);
+	return FIntVector(X, Y, Z);
+}
+
+int32 FNavGridCoarseLayer::GetChunkOfComponent(int32 Component) const
+{
+	//Chunks without free nodes share their offset with the next chunk
+	return Algo::UpperBound(ComponentOffsets, Component) - 1;
+}
+
+bool FNavGridCoarseLayer::FindRoute(TConstArrayView<int32> StartComponents, TConstArrayView<int32> GoalComponents, TArray<int32>& Route) const
+{
+	Route.Reset();
+	if (StartComponents.IsEmpty() || GoalComponents.IsEmpty()) return false;
+
+	struct FOpenEntry
+	{
+		float FCost;
+		int32 Index;
+		bool operator<(const FOpenEntry& Other) const { return FCost > Other.FCost; }
+	};
+
+	auto Heuristic = [this, GoalComponents](int32 Component)
+	{
+		double Closest = DBL_MAX;
+		for (const int32 Goal : GoalComponents) Closest = FMath::Min(Closest, FVector::Distance(FVector(Anchors[Component]), FVector(Anchors[Goal])));
+		return float(Closest);
+	};
+
+	TArray<float> GCosts;
+	TArray<int32> Parents;
+	GCosts.Init(FLT_MAX, Anchors.Num());
+	Parents.Init(INDEX_NONE, Anchors.Num());
+
+	std::priority_queue<FOpenEntry> OpenQueue;
+	for (const int32 Start : StartComponents)
+	{
+		if (!Anchors.IsValidIndex(Start)) continue;
+		GCosts[Start] = 0;
+		Parents[Start] = Start;
+		OpenQueue.push({ Heuristic(Start), Start });
+	}
+
+	while (!OpenQueue.empty())
+	{
+		const FOpenEntry Current = OpenQueue.top();
+		OpenQueue.pop();
+		if (GoalComponents.Contains(Current.Index))
+		{
+			for (int32 Index = Current.Index; ; Index = Parents[Index])
+			{
+				Route.Add(Index);
+				if (Parents[Index] == Index) break;
+			}
+			Algo::Reverse(Route);
+			return true;
+		}
+
+		const FVector Anchor(Anchors[Current.Index]);
+		for (int32 Link = LinkOffsets[Current.Index]; Link < LinkOffsets[Current.Index + 1]; Link++)
+		{
+			const int32 Neighbor = Links[Link];
+			const float GNew = GCosts[Current.Index] + FVector::Distance(Anchor, FVector(Anchors[Neighbor]));
+			if (GNew >= GCosts[Neighbor]) continue;
+
+			GCosts[Neighbor] = GNew;
+			Parents[Neighbor] = Current.Index;
+			OpenQueue.push({ GNew + Heuristic(Neighbor), Neighbor });
+		}
+	}
+	return false;
+}
+
+FNavGridStreaming::~FNavGridStreaming()
+{
+	//The volume is already being destroyed, its searches are done
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+	FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+}
+
+bool FNavGridStreaming::Bake(const AHeightNavigationVolume& Volume, FNavGridCoarseLayer& Layer)
+{
+	Layer.Reset();
+	if (Volume.IsGridEmpty()) return false;
+
+	const FVector GridSize = Volume.GetGridSize();
+	Layer.NodeCount = FIntVector(GridSize.X, GridSize.Y, GridSize.Z);
+	Layer.ChunkCount = FIntVector(FMath::DivideAndRoundUp(Layer.NodeCount.X, ChunkSize),
+		FMath::DivideAndRoundUp(Layer.NodeCount.Y, ChunkSize),
+		FMath::DivideAndRoundUp(Layer.NodeCount.Z, ChunkSize));
+	Layer.GridHash = Volume.CalculateGridHash();
+
+	const int32 ChunkCount = Layer.ChunkCount.X * Layer.ChunkCount.Y * Layer.ChunkCount.Z;
+	Layer.ComponentOffsets.Reserve(ChunkCount + 1);
+
+	//Chunks of an older bake could be left over when the volume got smaller
+	const FString Directory = GetChunkDirectory(Volume);
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	//The links need the components of the neighboring chunks, so they get connected after every chunk is written
+	TArray<TArray<uint8>> ChunkFlags;
+	TArray<TArray<uint16>> ChunkComponents;
+	ChunkFlags.SetNum(ChunkCount);
+	ChunkComponents.SetNum(ChunkCount);
+
+	int64 FileBytes = 0;
+	int64 NodeBytes = 0;
+	for (int32 ChunkIndex = 0; ChunkIndex < ChunkCount; ChunkIndex++)
+	{
+		const FIntVector Chunk = Layer.GetChunkCoordinates(ChunkIndex);
+		const FIntVector Origin = Chunk * ChunkSize;
+		const FIntVector Size = GetChunkNodeCount(Layer, Chunk);
+		const FVector Center = FVector(Origin) + FVector(Size - FIntVector(1)) * 0.5f;
+
+		//Chunk local x, y, z order
+		TArray<uint8>& Flags = ChunkFlags[ChunkIndex];
+		TArray<uint8> Clearance;
+		Flags.Reserve(Size.X * Size.Y * Size.Z);
+		Clearance.Reserve(Size.X * Size.Y * Size.Z);
+		for (int x = Origin.X; x < Origin.X + Size.X; x++)
+		{
+			for (int y = Origin.Y; y < Origin.Y + Size.Y; y++)
+			{
+				for (int z = Origin.Z; z < Origin.Z + Size.Z; z++)
+				{
+					Flags.Add(Volume.GetNodeFlags(x, y, z));
+					Clearance.Add(Volume.GetClearance(x, y, z));
+				}
+			}
+		}
+
+		const int32 FirstComponent = Layer.Anchors.Num();
+		const int32 ComponentCount = FindComponents(Flags, Size, ChunkComponents[ChunkIndex]);
+		Layer.ComponentOffsets.Add(FirstComponent);
+		Layer.Anchors.AddUninitialized(ComponentCount);
+
+		TArray<double> AnchorDistances;
+		AnchorDistances.Init(DBL_MAX, ComponentCount);
+		for (int32 Index = 0; Index < Flags.Num(); Index++)
+		{
+			const uint16 Component = ChunkComponents[ChunkIndex][Index];
+			if (Component == NoComponent) continue;
+
+			const FIntVector Node = Origin + FIntVector(Index / (Size.Y * Size.Z), (Index / Size.Z) % Size.Y, Index % Size.Z);
+			const double Distance = FVector::DistSquared(FVector(Node), Center);
+			if (Distance >= AnchorDistances[Component]) continue;
+			AnchorDistances[Component] = Distance;
+			Layer.Anchors[FirstComponent + Component] = Node;
+		}
+
+		TArray<uint8> Bytes;
+		FMemoryWriter Writer(Bytes);
+		uint32 Magic = ChunkFileMagic;
+		int32 Version = ChunkFileVersion;
+		uint32 GridHash = Layer.GridHash;
+		FIntVector ChunkCoordinates = Chunk;
+		Writer << Magic << Version << GridHash << ChunkCoordinates << Flags << Clearance;
+
+		if (!FFileHelper::SaveArrayToFile(Bytes, *GetChunkFile(Directory, Chunk)))
+		{
+			UE_LOG(LogTemp, Error, TEXT("%s - Could not write the navigation chunk %s"), *Volume.GetName(), *GetChunkFile(Directory, Chunk));
+			Layer.Reset();
+			return false;
+		}
+		FileBytes += Bytes.Num();
+		NodeBytes += Flags.Num() * (sizeof(uint8) * 2 + sizeof(uint16));
+	}
+	Layer.ComponentOffsets.Add(Layer.Anchors.Num());
+
+	//Connections that leave a chunk link the component of the node to the one of its neighbor
+	Layer.LinkOffsets.Reserve(Layer.Anchors.Num() + 1);
+	for (int32 ChunkIndex = 0; ChunkIndex < ChunkCount; ChunkIndex++)
+	{
+		const FIntVector Chunk = Layer.GetChunkCoordinates(ChunkIndex);
+		const FIntVector Origin = Chunk * ChunkSize;
+		const FIntVector Size = GetChunkNodeCount(Layer, Chunk);
+		const TArray<uint8>& Flags = ChunkFlags[ChunkIndex];
+
+		TArray<TArray<int32>> ComponentLinks;
+		ComponentLinks.SetNum(Layer.ComponentOffsets[ChunkIndex + 1] - Layer.ComponentOffsets[ChunkIndex]);
+		for (int32 Index = 0; Index < Flags.Num(); Index++)
+		{
+			const uint16 Component = ChunkComponents[ChunkIndex][Index];
+			if (Component == NoComponent) continue;
+
+			const FIntVector Local(Index / (Size.Y * Size.Z), (Index / Size.Z) % Size.Y, Index % Size.Z);
+			for (int32 Direction = 0; Direction < 6; Direction++)
+			{
+				if (!(Flags[Index] & (1 << Direction)) || IsInsideChunk(Local + Directions[Direction], Size)) continue;
+
+				const FIntVector Neighbor = Origin + Local + Directions[Direction];
+				const FIntVector NeighborChunk(Neighbor.X / ChunkSize, Neighbor.Y / ChunkSize, Neighbor.Z / ChunkSize);
+				const FIntVector NeighborSize = GetChunkNodeCount(Layer, NeighborChunk);
+				const FIntVector NeighborLocal = Neighbor - NeighborChunk * ChunkSize;
+				const int32 NeighborChunkIndex = Layer.GetChunkIndex(NeighborChunk);
+				const uint16 NeighborComponent = ChunkComponents[NeighborChunkIndex][(NeighborLocal.X * NeighborSize.Y + NeighborLocal.Y) * NeighborSize.Z + NeighborLocal.Z];
+				if (NeighborComponent == NoComponent) continue;
+				ComponentLinks[Component].AddUnique(Layer.ComponentOffsets[NeighborChunkIndex] + NeighborComponent);
+			}
+		}
+		for (const TArray<int32>& Links : ComponentLinks)
+		{
+			Layer.LinkOffsets.Add(Layer.Links.Num());
+			Layer.Links.Append(Links);
+		}
+	}
+	Layer.LinkOffsets.Add(Layer.Links.Num());
+
+	UE_LOG(LogTemp, Log, TEXT("%s - Baked %d navigation chunks with %d components to %s (%.2f MB on disk, %.2f MB of node data when everything is resident)"),
+		*Volume.GetName(), ChunkCount, Layer.Anchors.Num(), *Directory, FileBytes / (1024.f * 1024.f), NodeBytes / (1024.f * 1024.f));
+	return true;
+}
+
+bool FNavGridStreaming::Start(AHeightNavigationVolume& InVolume, const FNavGridCoarseLayer& CoarseLayer, float BudgetMegabytes)
+{
+	Stop();
+
+	const FVector GridSize = InVolume.GetGridSize();
+	if (!CoarseLayer.IsBaked() || CoarseLayer.NodeCount != FIntVector(GridSize.X, GridSize.Y, GridSize.Z)) return false;
+
+	UWorld* World = InVolume.GetWorld();
+	if (!World) return false;
+
+	InVolume.InitializeStreamedGrid();
+	{
+		//Searches on worker threads read the chunks with the read lock of the grid and request them with the lock
+		FWriteScopeLock GridWriteLock(InVolume.GetGridLock());
+		FScopeLock ScopeLock(&Lock);
+		Volume = &InVolume;
+		Layer = CoarseLayer;
+		Directory = GetChunkDirectory(InVolume);
+		Chunks.Init(FChunk(), Layer.ComponentOffsets.Num() - 1);
+		ResidentBytes = 0;
+		BudgetBytes = int64(BudgetMegabytes * 1024 * 1024);
+		Generation++;
+		Active = true;
+	}
+
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddRaw(this, &FNavGridStreaming::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddRaw(this, &FNavGridStreaming::OnLevelRemoved);
+	TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FNavGridStreaming::Tick));
+
+	//Levels that are already there won't be added again
+	for (ULevel* Level : World->GetLevels())
+	{
+		if (Level && Level->bIsVisible) OnLevelAdded(Level, World);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("%s - Streaming %d navigation chunks from %s with a budget of %.1f MB"),
+		*InVolume.GetName(), Chunks.Num(), *Directory, BudgetMegabytes);
+	return true;
+}
+
+void FNavGridStreaming::Stop()
+{
+	if (!Active) return;
+
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+	LevelAddedHandle.Reset();
+	LevelRemovedHandle.Reset();
+	LevelChunks.Empty();
+	FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+	TickerHandle.Reset();
+	FinishedLoads.Empty();
+	ReleasedChunks.Empty();
+
+	AHeightNavigationVolume* Owner = Volume.Get();
+	if (Owner) Owner->GetGridLock().WriteLock();
+	{
+		FScopeLock ScopeLock(&Lock);
+		Active = false;
+		Generation++;
+		Chunks.Empty();
+		ResidentBytes = 0;
+		Volume.Reset();
+	}
+	if (Owner) Owner->GetGridLock().WriteUnlock();
+}
+
+uint8 FNavGridStreaming::GetNodeFlags(int32 X, int32 Y, int32 Z) const
+{
+	int32 ChunkIndex;
+	const int32 LocalIndex = GetLocalIndex(FIntVector(X, Y, Z), ChunkIndex);
+	const TArray<uint8>& Flags = Chunks[ChunkIndex].Data.Flags;
+	return Flags.IsEmpty() ? BlockedNodeBit : Flags[LocalIndex];
+}
+
+uint8 FNavGridStreaming::GetClearance(int32 X, int32 Y, int32 Z) const
+{
+	int32 ChunkIndex;
+	const int32 LocalIndex = GetLocalIndex(FIntVector(X, Y, Z), ChunkIndex);
+	const TArray<uint8>& Clearance = Chunks[ChunkIndex].Data.Clearance;
+	return Clearance.IsEmpty() ? 0 : Clearance[LocalIndex];
+}
+
+bool FNavGridStreaming::FindRoute(const FIntVector& Start, const FIntVector& Goal, TArray<int32>& Route) const
+{
+	Route.Reset();
+	if (!Active) return false;
+
+	auto GetComponents = [this](const FIntVector& Node, TArray<int32, TInlineAllocator<8>>& Components)
+	{
+		int32 ChunkIndex;
+		const int32 LocalIndex = GetLocalIndex(Node, ChunkIndex);
+		const TArray<uint16>& NodeComponents = Chunks[ChunkIndex].Data.Components;
+		if (!NodeComponents.IsEmpty())
+		{
+			const uint16 Component = NodeComponents[LocalIndex];
+			if (Component != NoComponent)
+			{
+				Components.Add(Layer.ComponentOffsets[ChunkIndex] + Component);
+				return;
+			}
+		}
+
+		//Blocked nodes get resolved to the closest free node, which can be in any of the components
+		for (int32 Component = Layer.ComponentOffsets[ChunkIndex]; Component < Layer.ComponentOffsets[ChunkIndex + 1]; Component++)
+		{
+			Components.Add(Component);
+		}
+	};
+
+	const FIntVector Clamp = Layer.NodeCount - FIntVector(1);
+	TArray<int32, TInlineAllocator<8>> StartComponents;
+	TArray<int32, TInlineAllocator<8>> GoalComponents;
+	GetComponents(FIntVector(FMath::Clamp(Start.X, 0, Clamp.X), FMath::Clamp(Start.Y, 0, Clamp.Y), FMath::Clamp(Start.Z, 0, Clamp.Z)), StartComponents);
+	GetComponents(FIntVector(FMath::Clamp(Goal.X, 0, Clamp.X), FMath::Clamp(Goal.Y, 0, Clamp.Y), FMath::Clamp(Goal.Z, 0, Clamp.Z)), GoalComponents);
+	return Layer.FindRoute(StartComponents, GoalComponents, Route);
+}
+
+bool FNavGridStreaming::RequestRoute(TConstArrayView<int32> Route)
+{
+	TArray<int32, TInlineAllocator<16>> ChunkIndices;
+	for (const int32 Component : Route) ChunkIndices.AddUnique(Layer.GetChunkOfComponent(Component));
+	return RequestChunks(ChunkIndices);
+}
+
+int32 FNavGridStreaming::GetLocalIndex(const FIntVector& Node, int32& ChunkIndex) const
+{
+	const FIntVector Chunk(Node.X / ChunkSize, Node.Y / ChunkSize, Node.Z / ChunkSize);
+	const FIntVector Local = Node - Chunk * ChunkSize;
+	const FIntVector Size = GetChunkNodeCount(Layer, Chunk);
+	ChunkIndex = Layer.GetChunkIndex(Chunk);
+	return (Local.X * Size.Y + Local.Y) * Size.Z + Local.Z;
+}
+
+int32 FNavGridStreaming::GetChunkIndexOfNode(const FIntVector& Node) const
+{
+	if (!Layer.IsBaked()) return INDEX_NONE;
+
+	const FIntVector Clamped(FMath::Clamp(Node.X, 0, Layer.NodeCount.X - 1),
+		FMath::Clamp(Node.Y, 0, Layer.NodeCount.Y - 1),
+		FMath::Clamp(Node.Z, 0, Layer.NodeCount.Z - 1));
+	return Layer.GetChunkIndex(FIntVector(Clamped.X / ChunkSize, Clamped.Y / ChunkSize, Clamped.Z / ChunkSize));
+}
+
+FString FNavGridStreaming::GetChunkDirectory(const AHeightNavigationVolume& Volume)
+{
+	const UWorld* World = Volume.GetWorld();
+	const FString Map = World ? UWorld::RemovePIEPrefix(FPackageName::GetShortName(World->GetOutermost()->GetName())) : TEXT("None");
+	return FPaths::ProjectContentDir() / TEXT("NavGrid") / Map / Volume.GetName();
+}
+
+FString FNavGridStreaming::GetChunkFile(const FString& Directory, const FIntVector& Chunk)
+{
+	return Directory / FString::Printf(TEXT("%d_%d_%d.navchunk"), Chunk.X, Chunk.Y, Chunk.Z);
+}
+
+FIntVector FNavGridStreaming::GetChunkNodeCount(const FNavGridCoarseLayer& Layer, const FIntVector& Chunk)
+{
+	const FIntVector Origin = Chunk * ChunkSize;
+	return FIntVector(FMath::Min(ChunkSize, Layer.NodeCount.X - Origin.X),
+		FMath::Min(ChunkSize, Layer.NodeCount.Y - Origin.Y),
+		FMath::Min(ChunkSize, Layer.NodeCount.Z - Origin.Z));
+}
+
+bool FNavGridStreaming::RequestChunks(TConstArrayView<int32> ChunkIndices)
+{
+	FScopeLock ScopeLock(&Lock);
+	if (!Active) return false;
+
+	bool AllResident = true;
+	for (const int32 ChunkIndex : ChunkIndices)
+	{
+		if (!Chunks.IsValidIndex(ChunkIndex))
+		{
+			AllResident = false;
+			continue;
+		}
+
+		Chunks[ChunkIndex].LastUsed = ++UseCounter;
+		if (Chunks[ChunkIndex].State == EChunkState::Resident) continue;
+		AllResident = false;
+		RequestChunk(ChunkIndex);
+	}
+	return AllResident;
+}
+
+void FNavGridStreaming::RequestChunk(int32 ChunkIndex)
+{
+	FChunk& Chunk = Chunks[ChunkIndex];
+	if (Chunk.State != EChunkState::Unloaded) return;
+	Chunk.State = EChunkState::Loading;
+
+	const FIntVector Coordinates = Layer.GetChunkCoordinates(ChunkIndex);
+	const FString File = GetChunkFile(Directory, Coordinates);
+	const FIntVector Size = GetChunkNodeCount(Layer, Coordinates);
+	const uint32 LoadGeneration = Generation;
+	const uint32 GridHash = Layer.GridHash;
+	UE::Tasks::Launch(UE_SOURCE_LOCATION, [WeakVolume = Volume, File, Size, ChunkIndex, LoadGeneration, GridHash]
+	{
+		FChunkData Data;
+		int32 ComponentCount = 0;
+		TArray<uint8> Bytes;
+		if (FFileHelper::LoadFileToArray(Bytes, *File, FILEREAD_Silent))
+		{
+			FMemoryReader Reader(Bytes);
+			uint32 Magic = 0;
+			int32 Version = 0;
+			uint32 FileHash = 0;
+			FIntVector Chunk;
+			Reader << Magic << Version << FileHash << Chunk;
+			if (!Reader.IsError() && Magic == ChunkFileMagic && Version == ChunkFileVersion && FileHash == GridHash)
+			{
+				Reader << Data.Flags << Data.Clearance;
+			}
+			if (Reader.IsError() || Data.Flags.Num() != Size.X * Size.Y * Size.Z || Data.Clearance.Num() != Data.Flags.Num())
+			{
+				Data = FChunkData();
+			}
+			else
+			{
+				ComponentCount = FindComponents(Data.Flags, Size, Data.Components);
+			}
+		}
+
+		//The grid is only written on the game thread
+		AsyncTask(ENamedThreads::GameThread, [WeakVolume, ChunkIndex, LoadGeneration, Data = MoveTemp(Data), ComponentCount]() mutable
+		{
+			if (AHeightNavigationVolume* Owner = WeakVolume.Get())
+			{
+				Owner->GetGridStreaming().FinishLoad(ChunkIndex, LoadGeneration, MoveTemp(Data), ComponentCount);
+			}
+		});
+	});
+}
+
+void FNavGridStreaming::FinishLoad(int32 ChunkIndex, uint32 LoadGeneration, FChunkData&& Data, int32 ComponentCount)
+{
+	if (!Active || LoadGeneration != Generation) return;
+	FinishedLoads.Add({ ChunkIndex, LoadGeneration, MoveTemp(Data), ComponentCount });
+}
+
+void FNavGridStreaming::ReleaseChunk(int32 ChunkIndex)
+{
+	FScopeLock ScopeLock(&Lock);
+	FChunk& Chunk = Chunks[ChunkIndex];
+	if (Chunk.State != EChunkState::Resident) return;
+	Chunk.State = EChunkState::Unloaded;
+	ResidentBytes -= Chunk.Bytes;
+	Chunk.Bytes = 0;
+	ReleasedChunks.Add(ChunkIndex);
+}
+
+bool FNavGridStreaming::Tick(float DeltaTime)
+{
+	ApplyPendingChunks();
+	return true;
+}
+
+void FNavGridStreaming::ApplyPendingChunks()
+{
+	AHeightNavigationVolume* Owner = Volume.Get();
+	if (!Owner || (FinishedLoads.IsEmpty() && ReleasedChunks.IsEmpty())) return;
+
+	TArray<FFinishedLoad> Loads = MoveTemp(FinishedLoads);
+	TArray<int32> Freed = MoveTemp(ReleasedChunks);
+	TArray<int32> Applied;
+	{
+		FScopeLock ScopeLock(&Lock);
+		for (int32 LoadIndex = 0; LoadIndex < Loads.Num(); LoadIndex++)
+		{
+			FFinishedLoad& Load = Loads[LoadIndex];
+			if (Load.Generation != Generation || !Chunks.IsValidIndex(Load.ChunkIndex) || Chunks[Load.ChunkIndex].State != EChunkState::Loading) continue;
+
+			//The routes over the coarse layer only hold when the chunk splits into the same components
+			const FIntVector Chunk = Layer.GetChunkCoordinates(Load.ChunkIndex);
+			if (Load.Data.Flags.IsEmpty() || Load.ComponentCount != Layer.ComponentOffsets[Load.ChunkIndex + 1] - Layer.ComponentOffsets[Load.ChunkIndex])
+			{
+				Chunks[Load.ChunkIndex].State = EChunkState::Missing;
+				UE_LOG(LogTemp, Warning, TEXT("%s - Navigation chunk %s is missing or stale, bake the navigation chunks again"),
+					*Owner->GetName(), *GetChunkFile(Directory, Chunk));
+				continue;
+			}
+
+			//Chunks of this batch are still loading, so they can't evict each other
+			const int64 Bytes = Load.Data.GetAllocatedSize();
+			if (!MakeRoom(Bytes, Freed))
+			{
+				Chunks[Load.ChunkIndex].State = EChunkState::Unloaded;
+				UE_LOG(LogTemp, Warning, TEXT("%s - Navigation chunk %s does not fit into the streaming budget (%.2f of %.2f MB resident)"),
+					*Owner->GetName(), *Chunk.ToString(), ResidentBytes / (1024.f * 1024.f), BudgetBytes / (1024.f * 1024.f));
+				continue;
+			}
+			ResidentBytes += Bytes;
+			Chunks[Load.ChunkIndex].Bytes = Bytes;
+			Applied.Add(LoadIndex);
+		}
+	}
+
+	//Searches on worker threads hold the read lock of the grid and then request chunks with the lock,
+	//so the grid lock is never taken with the lock held. Released chunks first, one of them can be loaded again
+	//in the same frame. The old data is only moved out here and freed after the lock
+	TArray<FChunkData> OldData;
+	OldData.Reserve(Freed.Num());
+	{
+		FWriteScopeLock GridWriteLock(Owner->GetGridLock());
+		for (const int32 ChunkIndex : Freed) OldData.Add(MoveTemp(Chunks[ChunkIndex].Data));
+		for (const int32 LoadIndex : Applied) Chunks[Loads[LoadIndex].ChunkIndex].Data = MoveTemp(Loads[LoadIndex].Data);
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	for (const int32 LoadIndex : Applied) Chunks[Loads[LoadIndex].ChunkIndex].State = EChunkState::Resident;
+}
+
+bool FNavGridStreaming::MakeRoom(int64 Bytes, TArray<int32>& Evicted)
+{
+	if (Bytes > BudgetBytes) return false;
+
+	while (ResidentBytes + Bytes > BudgetBytes)
+	{
+		int32 Victim = INDEX_NONE;
+		for (int32 i = 0; i < Chunks.Num(); i++)
+		{
+			if (Chunks[i].State != EChunkState::Resident) continue;
+			if (Victim == INDEX_NONE) { Victim = i; continue; }
+
+			//Chunks of loaded levels are needed more likely than the ones a path asked for once
+			const bool Referenced = Chunks[i].LevelRefs > 0;
+			const bool VictimReferenced = Chunks[Victim].LevelRefs > 0;
+			if (Referenced != VictimReferenced)
+			{
+				if (!Referenced) Victim = i;
+				continue;
+			}
+			if (Chunks[i].LastUsed < Chunks[Victim].LastUsed) Victim = i;
+		}
+		if (Victim == INDEX_NONE) return false;
+
+		Chunks[Victim].State = EChunkState::Unloaded;
+		ResidentBytes -= Chunks[Victim].Bytes;
+		Chunks[Victim].Bytes = 0;
+		Evicted.Add(Victim);
+	}
+	return true;
+}
+
+void FNavGridStreaming::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	AHeightNavigationVolume* Owner = Volume.Get();
+	if (!Level || !Owner || World != Owner->GetWorld() || LevelChunks.Contains(Level)) return;
+
+	TArray<int32> ChunkIndices;
+	CollectLevelChunks(*Level, ChunkIndices);
+	{
+		FScopeLock ScopeLock(&Lock);
+		for (const int32 ChunkIndex : ChunkIndices) Chunks[ChunkIndex].LevelRefs++;
+	}
+	RequestChunks(ChunkIndices);
+	LevelChunks.Add(Level, MoveTemp(ChunkIndices));
+}
+
+void FNavGridStreaming::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	TArray<int32> ChunkIndices;
+	if (!Level || !LevelChunks.RemoveAndCopyValue(Level, ChunkIndices)) return;
+
+	//Chunks that are still loading stay until they get evicted, like the ones paths asked for
+	TArray<int32> Released;
+	{
+		FScopeLock ScopeLock(&Lock);
+		for (const int32 ChunkIndex : ChunkIndices)
+		{
+			if (--Chunks[ChunkIndex].LevelRefs == 0) Released.Add(ChunkIndex);
+		}
+	}
+	for (const int32 ChunkIndex : Released) ReleaseChunk(ChunkIndex);
+}
+
+void FNavGridStreaming::CollectLevelChunks(const ULevel& Level, TArray<int32>& ChunkIndices) const
+{
+	//The persistent level is there for the whole game, paths load the chunks it needs
+	if (Level.IsPersistentLevel()) return;
+
+	const AHeightNavigationVolume* Owner = Volume.Get();
+	TSet<int32> Collected;
+	for (const AActor* Actor : Level.Actors)
+	{
+		if (!Actor || Actor->IsA<AHeightNavigationVolume>()) continue;
+
+		TInlineComponentArray<UPrimitiveComponent*> Primitives(Actor);
+		for (const UPrimitiveComponent* Primitive : Primitives)
+		{
+			//Only colliding components change the grid
+			if (!Primitive->IsRegistered() || !Primitive->IsCollisionEnabled()) continue;
+
+			const FBox Bounds = Primitive->Bounds.GetBox();
+			FVector Min(DBL_MAX);
+			FVector Max(-DBL_MAX);
+			for (int32 Corner = 0; Corner < 8; Corner++)
+			{
+				const FVector Position((Corner & 1) ? Bounds.Max.X : Bounds.Min.X, (Corner & 2) ? Bounds.Max.Y : Bounds.Min.Y, (Corner & 4) ? Bounds.Max.Z : Bounds.Min.Z);
+				const FVector GridPosition = Owner->GetGridPositionFromWorld(Position);
+				Min = Min.ComponentMin(GridPosition);
+				Max = Max.ComponentMax(GridPosition);
+			}
+			if (Max.X < 0 || Max.Y < 0 || Max.Z < 0) continue;
+			if (Min.X > Layer.NodeCount.X - 1 || Min.Y > Layer.NodeCount.Y - 1 || Min.Z > Layer.NodeCount.Z - 1) continue;
+
+			const FIntVector First = Layer.GetChunkCoordinates(GetChunkIndexOfNode(FIntVector(FMath::FloorToInt(Min.X), FMath::FloorToInt(Min.Y), FMath::FloorToInt(Min.Z))));
+			const FIntVector Last = Layer.GetChunkCoordinates(GetChunkIndexOfNode(FIntVector(FMath::CeilToInt(Max.X), FMath::CeilToInt(Max.Y), FMath::CeilToInt(Max.Z))));
+			const FIntVector Span = Last - First + FIntVector(1);
+			if (Span.X * Span.Y * Span.Z > MaxChunksPerComponent) continue;
+
+			for (int x = First.X; x <= Last.X; x++)
+			{
+				for (int y = First.Y; y <= Last.Y; y++)
+				{
+					for (int z = First.Z; z <= Last.Z; z++)
+					{
+						Collected.Add(Layer.GetChunkIndex(FIntVector(x, y, z)));
+					}
+				}
+			}
+		}
+	}
+	ChunkIndices = Collected.Array();
+}
@@ -0,0 +1,192 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+#include "Containers/Ticker.h"
+#include "NavGridStreaming.generated.h"
+
+class AHeightNavigationVolume;
+class ULevel;
+class UWorld;
+
+/**
+ * Always resident summary of a baked grid. Every chunk of FNavGridStreaming::ChunkSize^3 nodes is split into
+ * components, the free nodes that are connected inside of the chunk, and paths get routed over those.
+ * Saved with the volume, so paths can be routed across chunks that are not loaded.
+ */
+USTRUCT()
+struct NAVIGATIONGRID_API FNavGridCoarseLayer
+{
+	GENERATED_BODY()
+
+	//Node count of the grid the chunks were baked from
+	UPROPERTY()
+	FIntVector NodeCount = FIntVector::ZeroValue;
+
+	UPROPERTY()
+	FIntVector ChunkCount = FIntVector::ZeroValue;
+
+	//Grid hash at bake time, chunk files with a different hash are stale
+	UPROPERTY()
+	uint32 GridHash = 0;
+
+	//First component of every chunk, one more entry than chunks. The components of a chunk are numbered
+	//in chunk local x, y, z order of their first node
+	UPROPERTY()
+	TArray<int32> ComponentOffsets;
+
+	//Node of every component closest to the center of its chunk
+	UPROPERTY()
+	TArray<FIntVector> Anchors;
+
+	//First entry in Links of every component, one more entry than components
+	UPROPERTY()
+	TArray<int32> LinkOffsets;
+
+	//Components of the neighboring chunks that some node of the component is connected to
+	UPROPERTY()
+	TArray<int32> Links;
+
+	bool IsBaked() const { return !ComponentOffsets.IsEmpty(); }
+	void Reset();
+
+	int32 GetChunkIndex(const FIntVector& Chunk) const { return (Chunk.X * ChunkCount.Y + Chunk.Y) * ChunkCount.Z + Chunk.Z; }
+	FIntVector GetChunkCoordinates(int32 ChunkIndex) const;
+	int32 GetChunkOfComponent(int32 Component) const;
+
+	//A* over the components using the anchors, Route goes from one of the start components to one of the goal components
+	bool FindRoute(TConstArrayView<int32> StartComponents, TConstArrayView<int32> GoalComponents, TArray<int32>& Route) const;
+};
+
+/**
+ * Streams the connectivity and clearance of a baked grid chunk by chunk.
+ * Bake writes one file per chunk. At runtime every node is blocked until its chunk got loaded on a worker thread,
+ * either because a streaming level that overlaps it got added to the world (World Partition cells are streaming
+ * levels too) or because a path needs it. Levels that get removed release their chunks. The node data of the
+ * resident chunks is kept below a memory budget, the least recently used chunks get evicted first.
+ * Loaded, evicted and released chunks are applied once per frame with a single write lock of the grid.
+ */
+class NAVIGATIONGRID_API FNavGridStreaming
+{
+public:
+	static constexpr int32 ChunkSize = 16;
+
+	~FNavGridStreaming();
+
+	//Editor only, the grid of the volume has to be generated with all geometry loaded
+	static bool Bake(const AHeightNavigationVolume& Volume, FNavGridCoarseLayer& Layer);
+
+	//False when the coarse layer does not fit the volume anymore. BudgetMegabytes limits the node data of the resident chunks
+	bool Start(AHeightNavigationVolume& Volume, const FNavGridCoarseLayer& CoarseLayer, float BudgetMegabytes);
+	void Stop();
+	bool IsActive() const { return Active; }
+
+	//Need the read lock of the grid. Nodes of chunks that are not resident are blocked and have no clearance
+	uint8 GetNodeFlags(int32 X, int32 Y, int32 Z) const;
+	uint8 GetClearance(int32 X, int32 Y, int32 Z) const;
+
+	//Needs the read lock of the grid. Route over the components from the one of Start to the one of Goal,
+	//every component of their chunks is tried while the chunk is not resident
+	bool FindRoute(const FIntVector& Start, const FIntVector& Goal, TArray<int32>& Route) const;
+
+	//Thread safe. Marks the chunks as used and requests every chunk that is not resident,
+	//returns true when all of them are resident
+	bool RequestChunks(TConstArrayView<int32> ChunkIndices);
+	//Same for the chunks of a route
+	bool RequestRoute(TConstArrayView<int32> Route);
+
+	const FNavGridCoarseLayer& GetCoarseLayer() const { return Layer; }
+
+	//Content/NavGrid/<Map>/<Volume>, so the chunks get packaged with the game
+	static FString GetChunkDirectory(const AHeightNavigationVolume& Volume);
+
+private:
+	enum class EChunkState : uint8
+	{
+		Unloaded,
+		Loading,
+		Resident,
+		//File missing or baked for another grid, not requested again
+		Missing,
+	};
+
+	//Chunk local x, y, z order, empty while the chunk is not resident
+	struct FChunkData
+	{
+		//Same bits as AHeightNavigationVolume::GetNodeFlags
+		TArray<uint8> Flags;
+		TArray<uint8> Clearance;
+		//Component of every node inside of the chunk, MAX_uint16 for blocked nodes
+		TArray<uint16> Components;
+
+		int64 GetAllocatedSize() const { return Flags.GetAllocatedSize() + Clearance.GetAllocatedSize() + Components.GetAllocatedSize(); }
+	};
+
+	struct FChunk
+	{
+		EChunkState State = EChunkState::Unloaded;
+		//Loaded levels that overlap the chunk
+		int32 LevelRefs = 0;
+		uint64 LastUsed = 0;
+		int64 Bytes = 0;
+		//Written with the write lock of the grid, everything above with the lock
+		FChunkData Data;
+	};
+
+	struct FFinishedLoad
+	{
+		int32 ChunkIndex = INDEX_NONE;
+		uint32 Generation = 0;
+		FChunkData Data;
+		int32 ComponentCount = 0;
+	};
+
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+	void CollectLevelChunks(const ULevel& Level, TArray<int32>& ChunkIndices) const;
+
+	static FString GetChunkFile(const FString& Directory, const FIntVector& Chunk);
+	static FIntVector GetChunkNodeCount(const FNavGridCoarseLayer& Layer, const FIntVector& Chunk);
+	//Index of the node inside of FChunkData
+	int32 GetLocalIndex(const FIntVector& Node, int32& ChunkIndex) const;
+	//Nodes outside of the grid count to the closest chunk
+	int32 GetChunkIndexOfNode(const FIntVector& Node) const;
+
+	//Call with the lock held
+	void RequestChunk(int32 ChunkIndex);
+	//Game thread, after the file got read on a worker thread. Queued until the next Tick
+	void FinishLoad(int32 ChunkIndex, uint32 LoadGeneration, FChunkData&& Data, int32 ComponentCount);
+	//Game thread, the data gets freed in the next Tick
+	void ReleaseChunk(int32 ChunkIndex);
+	bool Tick(float DeltaTime);
+	//Applies the finished loads and frees the released and evicted chunks of the frame
+	void ApplyPendingChunks();
+	//Call with the lock held. Evicts the least recently used chunks, the ones without level refs first.
+	//The data of the evicted chunks still has to be freed, false when Bytes don't fit at all
+	bool MakeRoom(int64 Bytes, TArray<int32>& Evicted);
+
+	//Written with the lock held and only dereferenced on the game thread
+	TWeakObjectPtr<AHeightNavigationVolume> Volume;
+	std::atomic<bool> Active = false;
+	//Written in Start and Stop with the write lock of the grid and the lock held
+	FString Directory;
+	FNavGridCoarseLayer Layer;
+	TArray<FChunk> Chunks;
+	//Game thread only
+	TMap<TWeakObjectPtr<ULevel>, TArray<int32>> LevelChunks;
+	TArray<FFinishedLoad> FinishedLoads;
+	TArray<int32> ReleasedChunks;
+	FTSTicker::FDelegateHandle TickerHandle;
+
+	FCriticalSection Lock;
+	uint64 UseCounter = 0;
+	int64 ResidentBytes = 0;
+	int64 BudgetBytes = 0;
+	//Loads that finish after Stop are dropped
+	uint32 Generation = 0;
+
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+};
@@ -0,0 +1,284 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavGridVisualizerComponent.h"
+
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "HeightNavigationVolume.h"
+#include "Materials/MaterialInterface.h"
+#include "UObject/ConstructorHelpers.h"
+
+UNavGridVisualizerComponent::UNavGridVisualizerComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	static ConstructorHelpers::FObjectFinder<UStaticMesh> CubeMesh(TEXT("/Engine/BasicShapes/Cube.Cube"));
+	Mesh = CubeMesh.Object;
+}
+
+void UNavGridVisualizerComponent::OnComponentDestroyed(bool bDestroyingHierarchy)
+{
+	Clear();
+	Super::OnComponentDestroyed(bDestroyingHierarchy);
+}
+
+void UNavGridVisualizerComponent::Refresh()
+{
+	const AHeightNavigationVolume* Volume = Cast<AHeightNavigationVolume>(GetOwner());
+	if (!Volume || Volume->IsGridEmpty() || !Mesh)
+	{
+		Clear();
+		return;
+	}
+
+	const FVector GridSize = Volume->GetGridSize();
+	const FIntVector NewNodeCount(GridSize.X, GridSize.Y, GridSize.Z);
+	const FIntVector NewChunkCount = FIntVector::DivideAndRoundUp(NewNodeCount, ChunkSize);
+	if (NewNodeCount != NodeCount || NewChunkCount != ChunkCount)
+	{
+		Clear();
+		NodeCount = NewNodeCount;
+		ChunkCount = NewChunkCount;
+	}
+
+	const int NumChunks = ChunkCount.X * ChunkCount.Y * ChunkCount.Z;
+	ChunkComponents.SetNum(NumChunks);
+	ChunkHashes.SetNumZeroed(NumChunks);
+
+	if (Mode == EGridVisualizerMode::Component) CalculateComponentIds(*Volume);
+	if (Mode == EGridVisualizerMode::SearchHeat) Volume->CopySearchHeat(SearchHeat);
+
+	//Hashing the chunks is cheap compared to touching the instances, so only changed chunks get rebuilt
+	TArray<FChunkData> Chunks;
+	Chunks.SetNum(NumChunks);
+	const uint32 SettingsHash = GetSettingsHash();
+	ParallelFor(NumChunks, [&](int32 ChunkIndex)
+	{
+		BuildChunk(*Volume, ChunkIndex, SettingsHash, Chunks[ChunkIndex]);
+	});
+
+	int RebuiltChunks = 0;
+	for (int ChunkIndex = 0; ChunkIndex < NumChunks; ChunkIndex++)
+	{
+		FChunkData& Chunk = Chunks[ChunkIndex];
+		if (!Chunk.Changed) continue;
+		ChunkHashes[ChunkIndex] = Chunk.Hash;
+		RebuiltChunks++;
+
+		TObjectPtr<UInstancedStaticMeshComponent>& Component = ChunkComponents[ChunkIndex];
+		if (Chunk.Transforms.IsEmpty())
+		{
+			if (Component) Component->ClearInstances();
+			continue;
+		}
+
+		if (!Component)
+		{
+			Component = NewObject<UInstancedStaticMeshComponent>(GetOwner(), NAME_None, RF_Transient);
+			Component->SetupAttachment(this);
+			Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+			Component->SetCastShadow(false);
+			Component->SetCanEverAffectNavigation(false);
+			Component->NumCustomDataFloats = 3;
+			Component->RegisterComponent();
+		}
+		Component->SetStaticMesh(Mesh);
+		if (Material) Component->SetMaterial(0, Material);
+		Component->SetCullDistances(0, FMath::RoundToInt(CullDistance));
+		Component->LDMaxDrawDistance = CullDistance;
+		Component->SetCachedMaxDrawDistance(CullDistance);
+
+		Component->ClearInstances();
+		Component->AddInstances(Chunk.Transforms, false, true);
+		for (int i = 0; i < Chunk.Colors.Num(); i++)
+		{
+			const float CustomData[3] = { Chunk.Colors[i].R, Chunk.Colors[i].G, Chunk.Colors[i].B };
+			Component->SetCustomData(i, MakeArrayView(CustomData, 3));
+		}
+		Component->MarkRenderStateDirty();
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("%s - Grid visualizer: rebuilt %d of %d chunks, %d instances"),
+		*Volume->GetName(), RebuiltChunks, NumChunks, GetInstanceCount());
+}
+
+void UNavGridVisualizerComponent::Clear()
+{
+	for (UInstancedStaticMeshComponent* Component : ChunkComponents)
+	{
+		if (Component) Component->DestroyComponent();
+	}
+	ChunkComponents.Empty();
+	ChunkHashes.Empty();
+	ComponentIds.Empty();
+	SearchHeat.Empty();
+	ChunkCount = FIntVector::ZeroValue;
+	NodeCount = FIntVector::ZeroValue;
+}
+
+void UNavGridVisualizerComponent::MarkAllDirty()
+{
+	for (uint32& Hash : ChunkHashes) Hash = 0;
+}
+
+int UNavGridVisualizerComponent::GetInstanceCount() const
+{
+	int Count = 0;
+	for (const UInstancedStaticMeshComponent* Component : ChunkComponents)
+	{
+		if (Component) Count += Component->GetInstanceCount();
+	}
+	return Count;
+}
+
+void UNavGridVisualizerComponent::BuildChunk(const AHeightNavigationVolume& Volume, int ChunkIndex, uint32 SettingsHash, FChunkData& Chunk) const
+{
+	const FIntVector Chunk3D(ChunkIndex / (ChunkCount.Y * ChunkCount.Z), (ChunkIndex / ChunkCount.Z) % ChunkCount.Y, ChunkIndex % ChunkCount.Z);
+	const FIntVector Min = Chunk3D * ChunkSize;
+	const FIntVector Max(FMath::Min(Min.X + ChunkSize, NodeCount.X), FMath::Min(Min.Y + ChunkSize, NodeCount.Y), FMath::Min(Min.Z + ChunkSize, NodeCount.Z));
+
+	//First pass only hashes, most chunks stay the same between two refreshes
+	uint32 Hash = HashCombineFast(SettingsHash, ChunkIndex);
+	for (int x = Min.X; x < Max.X; x++)
+	{
+		for (int y = Min.Y; y < Max.Y; y++)
+		{
+			for (int z = Min.Z; z < Max.Z; z++)
+			{
+				FLinearColor Color;
+				if (!GetNodeColor(Volume, x, y, z, Color)) continue;
+				Hash = HashCombineFast(Hash, HashCombineFast(Volume.GetNodeIndex(x, y, z), GetTypeHash(Color)));
+			}
+		}
+	}
+	//0 marks chunks that were never built
+	Chunk.Hash = Hash != 0 ? Hash : 1;
+	Chunk.Changed = Chunk.Hash != ChunkHashes[ChunkIndex];
+	if (!Chunk.Changed) return;
+
+	const FVector Scale(Volume.distanceBetweenNodes * NodeScale / 100.f);
+	const FQuat Rotation = Volume.GetActorQuat();
+	for (int x = Min.X; x < Max.X; x++)
+	{
+		for (int y = Min.Y; y < Max.Y; y++)
+		{
+			for (int z = Min.Z; z < Max.Z; z++)
+			{
+				FLinearColor Color;
+				if (!GetNodeColor(Volume, x, y, z, Color)) continue;
+				Chunk.Transforms.Emplace(Rotation, Volume.GetWorldPositionFromGridPosition(FVector(x, y, z)), Scale);
+				Chunk.Colors.Add(Color);
+			}
+		}
+	}
+}
+
+bool UNavGridVisualizerComponent::GetNodeColor(const AHeightNavigationVolume& Volume, int x, int y, int z, FLinearColor& Color) const
+{
+	if (!IsInsideSlice(x, y, z)) return false;
+
+	const bool Blocked = Volume.IsNodeBlocked(x, y, z);
+	switch (Mode)
+	{
+	case EGridVisualizerMode::Blocked:
+		if (!Blocked && !ShowFreeNodes) return false;
+		Color = Blocked ? FLinearColor::Red : FLinearColor::Green;
+		return true;
+	case EGridVisualizerMode::Component:
+	{
+		if (Blocked) return false;
+		const int32 Id = ComponentIds.IsValidIndex(Volume.GetNodeIndex(x, y, z)) ? ComponentIds[Volume.GetNodeIndex(x, y, z)] : INDEX_NONE;
+		if (Id == INDEX_NONE) return false;
+		Color = FLinearColor::MakeRandomSeededColor(Id);
+		return true;
+	}
+	case EGridVisualizerMode::Clearance:
+		if (Blocked) return false;
+		Color = FLinearColor::LerpUsingHSV(FLinearColor::Red, FLinearColor::Green,
+			FMath::Clamp(float(Volume.GetClearance(x, y, z)) / MaxClearance, 0.f, 1.f));
+		return true;
+	case EGridVisualizerMode::SearchHeat:
+	{
+		const int Index = Volume.GetNodeIndex(x, y, z);
+		const uint16 Heat = SearchHeat.IsValidIndex(Index) ? SearchHeat[Index] : 0;
+		if (Heat == 0) return false;
+		//Logarithmic, a few hot spots would make everything else look the same otherwise
+		Color = FLinearColor::LerpUsingHSV(FLinearColor::Yellow, FLinearColor::Red, FMath::Clamp(FMath::Loge(float(Heat)) / FMath::Loge(float(MAX_uint16)), 0.f, 1.f));
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool UNavGridVisualizerComponent::IsInsideSlice(int x, int y, int z) const
+{
+	int Coordinate;
+	switch (SliceAxis)
+	{
+	case EGridSliceAxis::X: Coordinate = x; break;
+	case EGridSliceAxis::Y: Coordinate = y; break;
+	case EGridSliceAxis::Z: Coordinate = z; break;
+	default: return true;
+	}
+	return Coordinate >= SliceIndex && Coordinate < SliceIndex + SliceThickness;
+}
+
+void UNavGridVisualizerComponent::CalculateComponentIds(const AHeightNavigationVolume& Volume)
+{
+	//Flood fill over the neighbor connections
+	ComponentIds.Init(INDEX_NONE, Volume.GetNodeCount());
+	TArray<int> Queue;
+	int32 NextId = 0;
+	for (int Seed = 0; Seed < ComponentIds.Num(); Seed++)
+	{
+		if (ComponentIds[Seed] != INDEX_NONE) continue;
+		const FIntVector SeedPosition = Volume.GetNodeCoordinates(Seed);
+		//Bricked layouts have padding indices outside of the grid
+		if (!Volume.IsValid(SeedPosition.X, SeedPosition.Y, SeedPosition.Z)) continue;
+		if (Volume.IsNodeBlocked(SeedPosition.X, SeedPosition.Y, SeedPosition.Z)) continue;
+
+		Queue.Reset();
+		Queue.Add(Seed);
+		ComponentIds[Seed] = NextId;
+		for (int Head = 0; Head < Queue.Num(); Head++)
+		{
+			const FIntVector Position = Volume.GetNodeCoordinates(Queue[Head]);
+			const uint8 Connections = Volume.GetConnectionMask(Position.X, Position.Y, Position.Z);
+			for (int32 Direction = 0; Direction < 6; Direction++)
+			{
+				if (!(Connections & (1 << Direction))) continue;
+				const FIntVector Neighbor = Position + AHeightNavigationVolume::GetNeighborOffset(Direction);
+				const int NeighborIndex = Volume.GetNodeIndex(Neighbor.X, Neighbor.Y, Neighbor.Z);
+				if (ComponentIds[NeighborIndex] != INDEX_NONE) continue;
+				ComponentIds[NeighborIndex] = NextId;
+				Queue.Add(NeighborIndex);
+			}
+		}
+		NextId++;
+	}
+}
+
+uint32 UNavGridVisualizerComponent::GetSettingsHash() const
+{
+	uint32 Hash = GetTypeHash(Mode);
+	Hash = HashCombineFast(Hash, GetTypeHash(ShowFreeNodes));
+	Hash = HashCombineFast(Hash, GetTypeHash(NodeScale));
+	Hash = HashCombineFast(Hash, GetTypeHash(CullDistance));
+	Hash = HashCombineFast(Hash, GetTypeHash(SliceAxis));
+	Hash = HashCombineFast(Hash, GetTypeHash(SliceIndex));
+	Hash = HashCombineFast(Hash, GetTypeHash(SliceThickness));
+	Hash = HashCombineFast(Hash, GetTypeHash(MaxClearance));
+	Hash = HashCombineFast(Hash, GetTypeHash(Mesh.Get()));
+	Hash = HashCombineFast(Hash, GetTypeHash(Material.Get()));
+	//Moving the volume moves every node
+	if (const AActor* Owner = GetOwner())
+	{
+		Hash = HashCombineFast(Hash, GetTypeHash(Owner->GetActorLocation()));
+		Hash = HashCombineFast(Hash, GetTypeHash(Owner->GetActorRotation().Euler()));
+		Hash = HashCombineFast(Hash, GetTypeHash(Owner->GetActorScale3D()));
+	}
+	return Hash;
+}
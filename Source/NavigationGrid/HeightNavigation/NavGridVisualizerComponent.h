@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+#include "NavGridVisualizerComponent.generated.h"
+
+class AHeightNavigationVolume;
+class UInstancedStaticMeshComponent;
+class UMaterialInterface;
+class UStaticMesh;
+
+UENUM(BlueprintType)
+enum class EGridVisualizerMode : uint8
+{
+	Blocked		UMETA(DisplayName = "Blocked"),				//Blocked nodes red, free nodes green when ShowFreeNodes is set
+	Component	UMETA(DisplayName = "Connected Component"),	//Every group of free nodes that are connected with each other gets its own color
+	Clearance	UMETA(DisplayName = "Clearance"),			//Red without clearance up to green at MaxClearance
+	SearchHeat	UMETA(DisplayName = "Search Heat Map"),		//How often searches expanded a node while recordSearchHeat is on
+};
+
+UENUM(BlueprintType)
+enum class EGridSliceAxis : uint8
+{
+	None,
+	X,
+	Y,
+	Z,
+};
+
+/**
+ * Shows the grid of the owning Height Navigation Volume with one instanced static mesh per chunk of nodes,
+ * instead of one debug box per node. Refresh only rebuilds chunks whose content or settings changed, the
+ * renderer culls whole chunks by distance. The color of every instance goes into PerInstanceCustomData 0-2,
+ * so the material has to read it from there.
+ */
+UCLASS(ClassGroup = "Navigation Grid", meta = (BlueprintSpawnableComponent))
+class NAVIGATIONGRID_API UNavGridVisualizerComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+public:
+	UNavGridVisualizerComponent();
+
+	//Rebuilds every chunk that changed since the last refresh
+	UFUNCTION(BlueprintCallable, Category = "Navigation Grid Visualizer")
+	void Refresh();
+	//Removes every instance and chunk
+	UFUNCTION(BlueprintCallable, Category = "Navigation Grid Visualizer")
+	void Clear();
+	//The next refresh rebuilds every chunk, for changes that do not show up in the chunk content
+	void MarkAllDirty();
+	bool IsShown() const { return !ChunkComponents.IsEmpty(); }
+
+	int GetInstanceCount() const;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Navigation Grid Visualizer")
+	EGridVisualizerMode Mode = EGridVisualizerMode::Blocked;
+
+	//Free nodes in the blocked mode, most of the time this is the majority of the grid
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Navigation Grid Visualizer")
+	bool ShowFreeNodes = false;
+
+	//Size of the boxes relative to distanceBetweenNodes
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Navigation Grid Visualizer", meta = (ClampMin = 0.01, ClampMax = 1))
+	float NodeScale = 0.25f;
+
+	//Nodes per chunk edge
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Navigation Grid Visualizer", meta = (ClampMin = 4, ClampMax = 64))
+	int ChunkSize = 16;
+
+	//Chunks and instances further away from the camera are not drawn, 0 draws everything
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Navigation Grid Visualizer", meta = (Units = "cm", ClampMin = 0))
+	float CullDistance = 50000.f;
+
+	//Only shows the nodes between SliceIndex and SliceIndex + SliceThickness along the axis of the grid
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Navigation Grid Visualizer|Slice")
+	EGridSliceAxis SliceAxis = EGridSliceAxis::None;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Navigation Grid Visualizer|Slice", meta = (ClampMin = 0, EditCondition = "SliceAxis != EGridSliceAxis::None"))
+	int SliceIndex = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Navigation Grid Visualizer|Slice", meta = (ClampMin = 1, EditCondition = "SliceAxis != EGridSliceAxis::None"))
+	int SliceThickness = 1;
+
+	//Clearance that counts as fully green
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Navigation Grid Visualizer", meta = (ClampMin = 1))
+	int MaxClearance = 8;
+
+	UPROPERTY(EditAnywhere, Category = "Navigation Grid Visualizer")
+	TObjectPtr<UStaticMesh> Mesh;
+
+	//Needs to read the color from PerInstanceCustomData 0-2
+	UPROPERTY(EditAnywhere, Category = "Navigation Grid Visualizer")
+	TObjectPtr<UMaterialInterface> Material;
+
+protected:
+	virtual void OnComponentDestroyed(bool bDestroyingHierarchy) override;
+
+private:
+	struct FChunkData
+	{
+		uint32 Hash = 0;
+		bool Changed = false;
+		TArray<FTransform> Transforms;
+		TArray<FLinearColor> Colors;
+	};
+
+	//Runs in parallel, only reads the volume
+	void BuildChunk(const AHeightNavigationVolume& Volume, int ChunkIndex, uint32 SettingsHash, FChunkData& Chunk) const;
+	//Color of the node, false when the node is not shown
+	bool GetNodeColor(const AHeightNavigationVolume& Volume, int x, int y, int z, FLinearColor& Color) const;
+	bool IsInsideSlice(int x, int y, int z) const;
+	void CalculateComponentIds(const AHeightNavigationVolume& Volume);
+	uint32 GetSettingsHash() const;
+
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<UInstancedStaticMeshComponent>> ChunkComponents;
+	//Content hash every chunk was built with
+	TArray<uint32> ChunkHashes;
+	FIntVector ChunkCount = FIntVector::ZeroValue;
+	FIntVector NodeCount = FIntVector::ZeroValue;
+
+	//Connected component of every node, INDEX_NONE for blocked nodes
+	TArray<int32> ComponentIds;
+	//Copied once per refresh, the volume guards the original with a lock
+	TArray<uint16> SearchHeat;
+};
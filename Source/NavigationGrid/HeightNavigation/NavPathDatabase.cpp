@@ -0,0 +1,221 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavPathDatabase.h"
+
+#include "Async/ParallelFor.h"
+#include "HeightNavigationVolume.h"
+
+namespace
+{
+	//Goal is the start or can't be reached from it
+	constexpr uint8 AnyMove = 0xFF;
+
+	FIntVector GetNodeCount(const AHeightNavigationVolume& Volume)
+	{
+		const FVector GridSize = Volume.GetGridSize();
+		return FIntVector(int32(GridSize.X), int32(GridSize.Y), int32(GridSize.Z));
+	}
+
+	//Free node index of every node in x, y, z order and the free neighbor in each direction of every free node
+	int32 CollectFreeNodes(const AHeightNavigationVolume& Volume, const FIntVector& NodeCount, TArray<int32>& FreeIndices, TArray<int32>& Neighbors)
+	{
+		FreeIndices.Init(INDEX_NONE, NodeCount.X * NodeCount.Y * NodeCount.Z);
+		TArray<FIntVector> FreeNodes;
+		for (int32 X = 0; X < NodeCount.X; X++)
+		{
+			for (int32 Y = 0; Y < NodeCount.Y; Y++)
+			{
+				for (int32 Z = 0; Z < NodeCount.Z; Z++)
+				{
+					if (Volume.IsNodeBlocked(X, Y, Z)) continue;
+					FreeIndices[(X * NodeCount.Y + Y) * NodeCount.Z + Z] = FreeNodes.Num();
+					FreeNodes.Emplace(X, Y, Z);
+				}
+			}
+		}
+
+		Neighbors.Init(INDEX_NONE, FreeNodes.Num() * 6);
+		for (int32 Index = 0; Index < FreeNodes.Num(); Index++)
+		{
+			const FIntVector& Node = FreeNodes[Index];
+			const uint8 Connections = Volume.GetConnectionMask(Node.X, Node.Y, Node.Z);
+			for (int32 Direction = 0; Direction < 6; Direction++)
+			{
+				if (!(Connections & (1 << Direction))) continue;
+				const FIntVector Neighbor = Node + AHeightNavigationVolume::GetNeighborOffset(Direction);
+				Neighbors[Index * 6 + Direction] = FreeIndices[(Neighbor.X * NodeCount.Y + Neighbor.Y) * NodeCount.Z + Neighbor.Z];
+			}
+		}
+		return FreeNodes.Num();
+	}
+}
+
+bool FNavPathDatabase::Build(const AHeightNavigationVolume& Volume, int32 MaxFreeNodes, FNavPathDatabase& Database)
+{
+	Database.Reset();
+	if (Volume.IsGridEmpty()) return false;
+
+	const FIntVector Count = GetNodeCount(Volume);
+	TArray<int32> FreeIndices;
+	TArray<int32> Neighbors;
+	const int32 FreeCount = CollectFreeNodes(Volume, Count, FreeIndices, Neighbors);
+	if (FreeCount == 0 || FreeCount > MaxFreeNodes) return false;
+
+	//Every row only depends on the neighbor table, so the rows get built in parallel
+	TArray<TArray<uint32>> Rows;
+	Rows.SetNum(FreeCount);
+	ParallelFor(FreeCount, [FreeCount, &Neighbors, &Rows](int32 Start)
+	{
+		TArray<uint8> FirstMoves;
+		FirstMoves.Init(AnyMove, FreeCount);
+		TBitArray<> Visited(false, FreeCount);
+		TArray<int32> Queue;
+		Queue.Reserve(FreeCount);
+
+		//Every node reached through a node inherits its first move
+		Visited[Start] = true;
+		Queue.Add(Start);
+		for (int32 Head = 0; Head < Queue.Num(); Head++)
+		{
+			const int32 Current = Queue[Head];
+			for (int32 Direction = 0; Direction < 6; Direction++)
+			{
+				const int32 Neighbor = Neighbors[Current * 6 + Direction];
+				if (Neighbor == INDEX_NONE || Visited[Neighbor]) continue;
+				Visited[Neighbor] = true;
+				FirstMoves[Neighbor] = Current == Start ? uint8(Direction) : FirstMoves[Current];
+				Queue.Add(Neighbor);
+			}
+		}
+
+		//The first run always starts at goal 0, so leading goals without a move belong to it
+		TArray<uint32>& Row = Rows[Start];
+		for (int32 Goal = 0; Goal < FreeCount; Goal++)
+		{
+			const uint8 Move = FirstMoves[Goal];
+			if (Move == AnyMove) continue;
+			if (Row.IsEmpty()) Row.Add(Move);
+			else if ((Row.Last() & 7) != Move) Row.Add(uint32(Goal) << 3 | Move);
+		}
+	});
+
+	int32 RunCount = 0;
+	for (const TArray<uint32>& Row : Rows) RunCount += Row.Num();
+
+	Database.NodeCount = Count;
+	Database.GridHash = Volume.CalculateGridHash();
+	Database.RowOffsets.Reserve(FreeCount + 1);
+	Database.Runs.Reserve(RunCount);
+	for (const TArray<uint32>& Row : Rows)
+	{
+		Database.RowOffsets.Add(Database.Runs.Num());
+		Database.Runs.Append(Row);
+	}
+	Database.RowOffsets.Add(Database.Runs.Num());
+	return true;
+}
+
+void FNavPathDatabase::Reset()
+{
+	NodeCount = FIntVector::ZeroValue;
+	GridHash = 0;
+	RowOffsets.Empty();
+	Runs.Empty();
+	Unbind();
+}
+
+bool FNavPathDatabase::Bind(const AHeightNavigationVolume& Volume)
+{
+	Unbind();
+	if (!IsBaked() || Volume.IsGridEmpty()) return false;
+	if (GetNodeCount(Volume) != NodeCount || Volume.CalculateGridHash() != GridHash) return false;
+
+	TArray<int32> Neighbors;
+	const int32 FreeCount = CollectFreeNodes(Volume, NodeCount, FreeIndices, Neighbors);
+	if (FreeCount != GetFreeNodeCount())
+	{
+		Unbind();
+		return false;
+	}
+
+	//Flood fill, goals in another component have no move stored
+	Components.Init(INDEX_NONE, FreeCount);
+	TArray<int32> Queue;
+	Queue.Reserve(FreeCount);
+	int32 ComponentCount = 0;
+	for (int32 Seed = 0; Seed < FreeCount; Seed++)
+	{
+		if (Components[Seed] != INDEX_NONE) continue;
+
+		Components[Seed] = ComponentCount;
+		Queue.Reset();
+		Queue.Add(Seed);
+		for (int32 Head = 0; Head < Queue.Num(); Head++)
+		{
+			for (int32 Direction = 0; Direction < 6; Direction++)
+			{
+				const int32 Neighbor = Neighbors[Queue[Head] * 6 + Direction];
+				if (Neighbor == INDEX_NONE || Components[Neighbor] != INDEX_NONE) continue;
+				Components[Neighbor] = ComponentCount;
+				Queue.Add(Neighbor);
+			}
+		}
+		ComponentCount++;
+	}
+	return true;
+}
+
+void FNavPathDatabase::Unbind()
+{
+	FreeIndices.Empty();
+	Components.Empty();
+}
+
+bool FNavPathDatabase::FindPath(const AHeightNavigationVolume& Volume, const FIntVector& Start, const FIntVector& Goal, TArray<FIntVector>& PathNodes) const
+{
+	PathNodes.Reset();
+	if (!IsBound()) return false;
+
+	const int32 StartIndex = GetFreeIndex(Start);
+	const int32 GoalIndex = GetFreeIndex(Goal);
+	if (StartIndex == INDEX_NONE || GoalIndex == INDEX_NONE || Components[StartIndex] != Components[GoalIndex]) return false;
+
+	//A shortest path never visits more nodes than there are free nodes, anything longer is a broken table
+	FIntVector Current = Start;
+	int32 CurrentIndex = StartIndex;
+	PathNodes.Add(Current);
+	while (CurrentIndex != GoalIndex)
+	{
+		if (PathNodes.Num() > GetFreeNodeCount()) return false;
+
+		//The grid can change after Bind, a stale move must not lead through a wall
+		const FIntVector Next = Current + AHeightNavigationVolume::GetNeighborOffset(GetFirstMove(CurrentIndex, GoalIndex));
+		if (!Volume.IsConnected(Current.X, Current.Y, Current.Z, Next.X, Next.Y, Next.Z)) return false;
+		Current = Next;
+		CurrentIndex = GetFreeIndex(Current);
+		if (CurrentIndex == INDEX_NONE) return false;
+		PathNodes.Add(Current);
+	}
+	return true;
+}
+
+int32 FNavPathDatabase::GetFreeIndex(const FIntVector& Node) const
+{
+	if (Node.X < 0 || Node.Y < 0 || Node.Z < 0 || Node.X >= NodeCount.X || Node.Y >= NodeCount.Y || Node.Z >= NodeCount.Z) return INDEX_NONE;
+	return FreeIndices[(Node.X * NodeCount.Y + Node.Y) * NodeCount.Z + Node.Z];
+}
+
+uint8 FNavPathDatabase::GetFirstMove(int32 Start, int32 Goal) const
+{
+	//Last run of the row that starts at or before the goal
+	int32 Low = RowOffsets[Start];
+	int32 High = RowOffsets[Start + 1] - 1;
+	while (Low < High)
+	{
+		const int32 Middle = (Low + High + 1) / 2;
+		if (int32(Runs[Middle] >> 3) <= Goal) Low = Middle;
+		else High = Middle - 1;
+	}
+	return uint8(Runs[Low] & 7);
+}
@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NavPathDatabase.generated.h"
+
+class AHeightNavigationVolume;
+
+/**
+ * Compressed path database for small grids: the first move of a shortest path from every free node to every other
+ * free node. Every start node has one row with the moves to all goals in x, y, z order, stored as runs of the same
+ * move. The start itself and goals it can't reach take any move, so they just extend the run before them.
+ * A path is a chain of lookups, one binary search in the row of the current node per step, no search over the grid.
+ * Saved with the volume, baked in the editor.
+ */
+USTRUCT()
+struct NAVIGATIONGRID_API FNavPathDatabase
+{
+	GENERATED_BODY()
+
+	//Node count of the grid the database was baked from
+	UPROPERTY()
+	FIntVector NodeCount = FIntVector::ZeroValue;
+
+	//Grid hash at bake time, a database with a different hash doesn't fit the grid anymore
+	UPROPERTY()
+	uint32 GridHash = 0;
+
+	//First run of every row in Runs, one more entry than free nodes
+	UPROPERTY()
+	TArray<int32> RowOffsets;
+
+	//First goal of the run (as free node index) << 3 | direction in the order of GetNeighbors
+	UPROPERTY()
+	TArray<uint32> Runs;
+
+	//Editor only, one breadth first search per free node, spread over the worker threads.
+	//False when the grid has more than MaxFreeNodes free nodes
+	static bool Build(const AHeightNavigationVolume& Volume, int32 MaxFreeNodes, FNavPathDatabase& Database);
+
+	bool IsBaked() const { return !RowOffsets.IsEmpty(); }
+	void Reset();
+
+	//Prepares the lookups for the current grid of the volume, false when the database was baked for another grid
+	bool Bind(const AHeightNavigationVolume& Volume);
+	void Unbind();
+	bool IsBound() const { return !FreeIndices.IsEmpty(); }
+
+	//Every node from start to goal, false when the goal can't be reached or a stored move is not a connection of Volume
+	bool FindPath(const AHeightNavigationVolume& Volume, const FIntVector& Start, const FIntVector& Goal, TArray<FIntVector>& PathNodes) const;
+
+	int32 GetFreeNodeCount() const { return FMath::Max(RowOffsets.Num() - 1, 0); }
+	int64 GetAllocatedSize() const { return RowOffsets.GetAllocatedSize() + Runs.GetAllocatedSize(); }
+
+private:
+	int32 GetFreeIndex(const FIntVector& Node) const;
+	uint8 GetFirstMove(int32 Start, int32 Goal) const;
+
+	//Not saved, filled by Bind
+	//Free node index of every node in x, y, z order, INDEX_NONE for blocked nodes
+	TArray<int32> FreeIndices;
+	//Connected component of every free node, goals in another component are the ones without a stored move
+	TArray<int32> Components;
+};
@@ -3,46 +3,45 @@
 
 #include "MoveToLocationOrActor3D.h"
 
-#include "VectorTypes.h"
-#include "HeightNavigation/HeightNavigationVolume.h"
+#include "Engine/Engine.h"
+#if WITH_EDITOR
+#include "Editor.h"
+#endif
+
 
 void UMoveToActorOrLocation3D::Stop3DMovement(APawn* WorldContext)
 {
 	if (!WorldContext->IsValidLowLevel()) return;
 
-	//auto it = MoveToLocationOrActor3DStatics::CurrentMovingPawns.find(WorldContext);
-	for(auto it : MoveToLocationOrActor3DStatics::CurrentMovingPawns)
-	{
-		if (!it.first) return;
+	UNavigationAgentSubsystem* AgentSubsystem = UNavigationAgentSubsystem::Get(WorldContext);
+	if (!AgentSubsystem) return;
 
-		if (it.first == WorldContext)
-		{
-			if (!it.second) return;
-			it.second->Output = EMoveOutputPins::OnCanceled;
+	const FNavAgentHandle Handle = AgentSubsystem->FindAgent(WorldContext);
+	if (!AgentSubsystem->GetLatentAction(Handle)) return;
+
+	AgentSubsystem->CancelAgent(WorldContext);
 #if WITH_EDITOR
-			GEditor->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
-				TEXT("Latent Action Movement Stopped for ") + WorldContext->GetName());
+	GEngine->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
+		TEXT("Latent Action Movement Stopped for ") + WorldContext->GetName());
 #endif
-		}
-	}
 }
 
 #pragma region AsyncAction
-UMoveToLocationOrActor3D* UMoveToLocationOrActor3D::MoveToLocationOrActor3D(APawn* WorldContext, FVector Location)
+UMoveToLocationOrActor3D* UMoveToLocationOrActor3D::MoveToLocationOrActor3D(APawn* WorldContext, FVector Location, AActor* TargetActor, const FNavCostProfile& CostProfile)
 {
 	UMoveToLocationOrActor3D* Action = NewObject<UMoveToLocationOrActor3D>();
 	Action->MovingTarget = WorldContext;
 	Action->LocationToMoveTo = Location;
+	Action->ActorToMoveTo = TargetActor;
+	Action->CostProfile = CostProfile;
 
-	auto iterator = MoveToLocationOrActor3DStatics::CurrentMovingObjects.find(WorldContext);
-
-	if(iterator != MoveToLocationOrActor3DStatics::CurrentMovingObjects.end())
+	//Cancels any other movement of this pawn
+	if (UNavigationAgentSubsystem* AgentSubsystem = UNavigationAgentSubsystem::Get(WorldContext))
 	{
-		iterator->second->CancelMovement();
-		MoveToLocationOrActor3DStatics::CurrentMovingObjects.erase(iterator);
+		Action->AgentHandle = AgentSubsystem->RegisterAsyncAction(WorldContext, Action);
 	}
-
-	MoveToLocationOrActor3DStatics::CurrentMovingObjects.try_emplace(WorldContext, Action);
+	//Keeps the action alive until it finishes, the subsystem only knows it weakly
+	Action->RegisterWithGameInstance(WorldContext);
 
 	return Action;
 }
@@ -60,12 +59,17 @@ void UMoveToLocationOrActor3D::Activate()
 	}
 #endif
 
-	if(!World)
+	UNavigationAgentSubsystem* AgentSubsystem = UNavigationAgentSubsystem::Get(MovingTarget);
+	if(!World || !AgentSubsystem || !AgentHandle.IsSet())
 	{
 		OnFailed.Broadcast();
 		FinishMovement();
 		return;
 	}
+
+	//Does not tick until the subsystem reports that the path is there
+	if (IsValid(ActorToMoveTo)) AgentSubsystem->RequestPursuit(AgentHandle, ActorToMoveTo, CostProfile);
+	else AgentSubsystem->RequestMove(AgentHandle, LocationToMoveTo, CostProfile);
 }
 
 void UMoveToLocationOrActor3D::CancelMovement()
@@ -74,6 +78,26 @@ void UMoveToLocationOrActor3D::CancelMovement()
 	FinishMovement();
 }
 
+void UMoveToLocationOrActor3D::OnMoveStateChanged(ENavAgentMoveState State)
+{
+	switch (State)
+	{
+	case ENavAgentMoveState::Moving:
+		IsMoving = true;
+		return;
+	case ENavAgentMoveState::Completed:
+		OnFinish.Broadcast();
+		FinishMovement();
+		return;
+	case ENavAgentMoveState::Failed:
+		OnFailed.Broadcast();
+		FinishMovement();
+		return;
+	default:
+	{}
+	}
+}
+
 void UMoveToLocationOrActor3D::Tick(float DeltaTime)
 {
 	if (!MovingTarget || !World) return;
@@ -83,12 +107,19 @@ void UMoveToLocationOrActor3D::Tick(float DeltaTime)
 
 void UMoveToLocationOrActor3D::UpdateMove(float DeltaTime)
 {
-
+	//The subsystem moves the pawn, this only exposes the direction to blueprints
+	const UNavigationAgentSubsystem* AgentSubsystem = UNavigationAgentSubsystem::Get(MovingTarget);
+	CurrentMoveDirection = AgentSubsystem ? AgentSubsystem->GetMoveDirection(AgentHandle) : FVector::Zero();
 }
 
 void UMoveToLocationOrActor3D::FinishMovement()
 {
-	MoveToLocationOrActor3DStatics::CurrentMovingObjects.erase(MovingTarget);
+	if (UNavigationAgentSubsystem* AgentSubsystem = UNavigationAgentSubsystem::Get(MovingTarget))
+	{
+		AgentSubsystem->UnregisterAgent(AgentHandle);
+	}
+	AgentHandle.Reset();
+	IsMoving = false;
 	MovingTarget = nullptr;
 	World = nullptr;
 	SetReadyToDestroy();
@@ -97,7 +128,7 @@ void UMoveToLocationOrActor3D::FinishMovement()
 
 #pragma region LatentAction
 void UMoveToActorOrLocation3D::MoveToActorOrLocation3D(APawn* WorldContext, FLatentActionInfo LatentInfo,
-	EMoveInputPins InputPins, EMoveOutputPins& OutputPins, FVector MoveLocation, FVector& CurrentMoveDirection)
+	EMoveInputPins InputPins, EMoveOutputPins& OutputPins, FVector MoveLocation, FVector& CurrentMoveDirection, AActor* TargetActor)
 {
 	UWorld* World = GEngine->GetWorldFromContextObject(WorldContext, EGetWorldErrorMode::ReturnNull);
 
@@ -126,10 +157,9 @@ void UMoveToActorOrLocation3D::MoveToActorOrLocation3D(APawn* WorldContext, FLat
 		//Cancel any existing action
 
 		//Even though this instance is getting created with new, I do not have to worry about deleting it, Unreal does it for me
-		FLatentMoveToActorOrLocation3D* Action = new FLatentMoveToActorOrLocation3D(LatentInfo, OutputPins, WorldContext, MoveLocation, CurrentMoveDirection);
+		//Registers itself with the agent subsystem
+		FLatentMoveToActorOrLocation3D* Action = new FLatentMoveToActorOrLocation3D(LatentInfo, OutputPins, WorldContext, MoveLocation, CurrentMoveDirection, TargetActor);
 		LatentActionManager.AddNewAction(LatentInfo.CallbackTarget, LatentInfo.UUID, Action);
-
-		MoveToLocationOrActor3DStatics::CurrentMovingPawns.Add({ WorldContext, Action });
 	}
 	default:
 		{}
@@ -148,27 +178,9 @@ void FLatentMoveToActorOrLocation3D::UpdateOperation(FLatentResponse& Response)
 	case EMoveOutputPins::OnCompleted:
 	case EMoveOutputPins::OnFailed:
 	{
-		std::pair<APawn*, FLatentMoveToActorOrLocation3D*>* PairToRemove = nullptr;
-			for(std::pair<APawn*, FLatentMoveToActorOrLocation3D*> pair : MoveToLocationOrActor3DStatics::CurrentMovingPawns)
-			{
-				if (pair.first == MovementTarget && pair.second->LatentActionInfo.UUID == LatentActionInfo.UUID)
-				{
-					PairToRemove = &pair;
-					break;
-				}
-			}
-			if (PairToRemove)
-			{
-				MoveToLocationOrActor3DStatics::CurrentMovingPawns.Remove(*PairToRemove);
-			}
-			else
-			{
-#if WITH_EDITOR
-				GEditor->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
-					TEXT("Latent Action Movement 3D - Finishing up action but it was never added to existing actions?"));
-#endif
-				UE_LOG(LogTemp, Warning, TEXT("Latent Action Movement 3D - Finishing up action but it was never added to existing actions?"));
-			}
+		//Canceled actions were already removed by the cancel, the handle is stale then
+		if (AgentSubsystem.IsValid()) AgentSubsystem->UnregisterAgent(AgentHandle);
+		AgentHandle.Reset();
 
 		Response.FinishAndTriggerIf(true, ResponseLatentInfo);
 		return;
@@ -177,219 +189,48 @@ void FLatentMoveToActorOrLocation3D::UpdateOperation(FLatentResponse& Response)
 	{}
 	}
 
-	if(IsFirstCall)
+	if (!AgentSubsystem.IsValid())
 	{
-		GetNewPath();
-		if(Path.IsEmpty() && Output != EMoveOutputPins::OnCompleted)
-		{
-			Output = EMoveOutputPins::OnFailed;
-#if WITH_EDITOR
-			GEditor->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red, 
-				TEXT("Latent Move To Actor or Location Failed - No path available!"));
-#endif
-			UE_LOG(LogTemp, Error, TEXT("Latent Move To Actor or Location Failed - No path available!"));
-			return;
-		}
-
-		IsFirstCall = false;
-		Output = EMoveOutputPins::OnStarted;
-		Response.TriggerLink(ResponseLatentInfo);
+		Output = EMoveOutputPins::OnFailed;
+		UE_LOG(LogTemp, Error, TEXT("Latent Move To Actor or Location Failed - No navigation agent subsystem available!"));
 		return;
 	}
 
-	if(UE::Geometry::Distance(MoveLocation, MovementTarget->GetActorLocation()) <= ClosenessThreshold) //Done moving?
+	if(IsFirstCall)
 	{
-		Output = EMoveOutputPins::OnCompleted; //Will get completed during next cycle at the  start of the function
-		return;
+		if (TargetActor.IsValid()) AgentSubsystem->RequestPursuit(AgentHandle, TargetActor.Get());
+		else AgentSubsystem->RequestMove(AgentHandle, MoveLocation);
+		IsFirstCall = false;
 	}
 
-	//Standard Move behavior
-	if (PathIndex + 1 != Path.Num()) UpdateDirectPath(Response.ElapsedTime());
-
-	if (!PathValidationCheck(0))
+	//The outputs get fired during the next cycle at the start of the function
+	switch (AgentSubsystem->GetMoveState(AgentHandle))
 	{
-		Output = EMoveOutputPins::OnFailed;
-#if WITH_EDITOR
-		GEditor->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
-			TEXT("Latent Move To Actor or Location Failed - Path went missing during execution!"));
-		DrawDebugBox(MovementTarget->GetWorld(), MoveLocation, FVector(50, 50, 50), FColor::Black, false, 10, 0, 25);
-		DrawDebugBox(MovementTarget->GetWorld(), MoveLocation, FVector(150, 150, 150), FColor::Black, false, 10, 0, 25);
-		DrawDebugBox(MovementTarget->GetWorld(), MoveLocation, FVector(300, 300,300), FColor::Black, false, 10, 0, 25);
-#endif
-		UE_LOG(LogTemp, Error, TEXT("Latent Move To Actor or Location Failed - Path went missing during execution!"));
-
+	case ENavAgentMoveState::PathPending:
 		return;
-	}
-
-	UpdateMovement();
-
-	Output = EMoveOutputPins::OnMove;
-	Response.TriggerLink(ResponseLatentInfo);
-}
-
-void FLatentMoveToActorOrLocation3D::GetNewPath()
-{
-	//Check if position has a straight path
-	FHitResult HitResult;
-	MovementTarget->GetWorld()->LineTraceSingleByChannel(HitResult, MovementTarget->GetActorLocation(), MoveLocation, ECC_Visibility);
-
-	if(!HitResult.bBlockingHit)
-	{
-		Path.Empty();
-		Path.Add(MoveLocation);
-		PathIndex = 0;
+	case ENavAgentMoveState::Completed:
+		Output = EMoveOutputPins::OnCompleted;
 		return;
-	}
-
-	//Check for Nav Grid
-	AHeightNavigationVolume* NavGrid = AHeightNavigationVolume::EvaluateNavGrid(MovementTarget, MovementTarget->GetActorLocation(), MoveLocation);
-	if(!NavGrid)
-	{
-#if WITH_EDITOR
-		GEditor->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
-			TEXT("Positions do not fit into any one Height Navigation Volume."));
-#endif
-		UE_LOG(LogTemp, Error, TEXT("Positions do not fit into any one Height Navigation Volume."));
+	case ENavAgentMoveState::Failed:
 		Output = EMoveOutputPins::OnFailed;
 		return;
-	}
-
-	//Generate a path through Nav Grid
-	Get_Success success = Get_Success::Failed;
-	NavGrid->GetPath(MovementTarget->GetActorLocation(), nullptr, MoveLocation, nullptr, success, Path);
-
-#if WITH_EDITOR
-	for(int i = 0; i < Path.Num()-2; ++i)
-	{
-		DrawDebugLine(MovementTarget->GetWorld(), Path[i], Path[i+1], FColor::Cyan, false, 5);
-	}
-#endif
-
-	if (Path.IsEmpty()) Output = EMoveOutputPins::OnCompleted;
-}
-
-void FLatentMoveToActorOrLocation3D::UpdateMovement()
-{
-	CurrentMoveDirection = DirectionToLocation(Path[PathIndex]);
-	MoveInDirection(CurrentMoveDirection);
-	
-
-	//is close enough to move to next point?
-	if ((MovementTarget->GetActorLocation() - Path[PathIndex]).Length() >= ClosenessThreshold) return;
-
-	//Is there a next possible point?
-	if (PathIndex + 1 >= Path.Num()) return;
-
-	//set next possible point
-	PathIndex++;
-}
-
-void FLatentMoveToActorOrLocation3D::UpdateDirectPath(float DeltaTime)
-{
-	//Timer
-	CurrentInterval += DeltaTime;
-	if (CurrentInterval < Interval) return;
-	CurrentInterval -= Interval;
-
-
-	//Do we need to check for a direct path or are we almost at our goal
-	if (PathIndex + 2 >= Path.Num()) return;
-
-	//Evaluate the next position to check
-	IndexToCheck += 2;
-	if (IndexToCheck >= Path.Num())
-	{
-		IndexToCheck = PathIndex;
+	case ENavAgentMoveState::Canceled:
+		Output = EMoveOutputPins::OnCanceled;
 		return;
+	default:
+	{}
 	}
 
-	//Check if we have a direct path to the goal location and set it accordingly
-	{
-		if (HasDirectAccessToLocation(MoveLocation))
-		{
-			Path.Empty();
-			PathIndex = 0;
-			Path.Add(MoveLocation);
-			return;
-		}
-	}
-
-	//Check if we have a direct path to any previous location
-	//this check should be run over multiple frames
-	{
-		if (HasDirectAccessToLocation(Path[IndexToCheck]))
-		{
-			PathIndex = IndexToCheck;
-			return;
-		}
-	}
-}
-
-bool FLatentMoveToActorOrLocation3D::HasDirectAccessToLocation(const FVector& Location, bool ShowLines) const
-{
-	FHitResult HitResultTop(ForceInit);
-	FHitResult HitResultBot(ForceInit);
-	FHitResult HitResultLeft(ForceInit);
-	FHitResult HitResultRight(ForceInit);
-
-	UWorld* world = MovementTarget->GetWorld();
-	FVector Origin;
-	FVector BoxExtent;
-	MovementTarget->GetActorBounds(true, Origin, BoxExtent);
-
-	world->LineTraceSingleByChannel(HitResultTop, MovementTarget->GetActorLocation() + (MovementTarget->GetActorUpVector() * BoxExtent.Z * 1.5f), Location, ECC_Visibility);
-	world->LineTraceSingleByChannel(HitResultBot, MovementTarget->GetActorLocation() - (MovementTarget->GetActorUpVector() * BoxExtent.Z * 1.5f), Location, ECC_Visibility);
-	world->LineTraceSingleByChannel(HitResultLeft, MovementTarget->GetActorLocation() - (MovementTarget->GetActorRightVector() * BoxExtent.X * 1.5f), Location, ECC_Visibility);
-	world->LineTraceSingleByChannel(HitResultRight, MovementTarget->GetActorLocation() + (MovementTarget->GetActorRightVector() * BoxExtent.X * 1.5f), Location, ECC_Visibility);
-
-#if WITH_EDITOR
-	if(ShowLines)
-	{
-		DrawDebugLine(MovementTarget->GetWorld(), MovementTarget->GetActorLocation() + (MovementTarget->GetActorUpVector() * BoxExtent.Z * 1.5f), Location, HitResultTop.bBlockingHit ? FColor::Red : FColor::Green, false, Interval);
-		DrawDebugLine(MovementTarget->GetWorld(), MovementTarget->GetActorLocation() - (MovementTarget->GetActorUpVector() * BoxExtent.Z * 1.5f), Location, HitResultBot.bBlockingHit ? FColor::Red : FColor::Green, false, Interval);
-		DrawDebugLine(MovementTarget->GetWorld(), MovementTarget->GetActorLocation() - (MovementTarget->GetActorRightVector() * BoxExtent.X * 1.5f), Location, HitResultLeft.bBlockingHit ? FColor::Red : FColor::Green, false, Interval);
-		DrawDebugLine(MovementTarget->GetWorld(), MovementTarget->GetActorLocation() + (MovementTarget->GetActorRightVector() * BoxExtent.X * 1.5f), Location, HitResultRight.bBlockingHit ? FColor::Red : FColor::Green, false, Interval);
-	}
-#endif
-
-	return !HitResultTop.bBlockingHit && !HitResultBot.bBlockingHit && !HitResultLeft.bBlockingHit && !HitResultRight.bBlockingHit;
-}
-
-void FLatentMoveToActorOrLocation3D::MoveInDirection(FVector Direction)
-{
-	MovementTarget->AddMovementInput(Direction);
-}
-
-bool FLatentMoveToActorOrLocation3D::PathValidationCheck(int Try)
-{
-	Try++;
-	bool Valid = false;
-
-	if (!Path.IsEmpty()) Valid = true;
-
-	if(!Valid)
+	//First update with a path
+	if(!HasStarted)
 	{
-		GetNewPath();
-#if WITH_EDITOR
-		GEditor->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
-			TEXT("Tried to receive a new path to target location. Try ") + FString::SanitizeFloat(Try) + TEXT(" ."));
-#endif
-		UE_LOG(LogTemp, Error, TEXT("Tried to receive a new path to target location. Try %d."), Try);
+		HasStarted = true;
+		Response.TriggerLink(ResponseLatentInfo);
+		return;
 	}
 
-	if (Try >= 3) return Valid;
-	return Valid ? true : PathValidationCheck(Try);
-}
-
-FVector FLatentMoveToActorOrLocation3D::DirectionToLocation(FVector Location)
-{
-	return DirectionToLocation(MovementTarget->GetActorLocation(), Location);
-}
-
-FVector FLatentMoveToActorOrLocation3D::DirectionToLocation(FVector StartLocation, FVector Location)
-{
-	FVector Direction = Location - StartLocation;
-	Direction.Normalize();
-	return Direction;
+	CurrentMoveDirection = AgentSubsystem->GetMoveDirection(AgentHandle);
+	Output = EMoveOutputPins::OnMove;
+	Response.TriggerLink(ResponseLatentInfo);
 }
 #pragma endregion
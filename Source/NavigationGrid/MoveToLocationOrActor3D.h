@@ -3,10 +3,10 @@
 #pragma once
 
 #include "CoreMinimal.h"
-#include <map>
 #include "Delegates/DelegateCombinations.h"
 #include "LatentActions.h"
 #include "Kismet/BlueprintAsyncActionBase.h"
+#include "NavigationAgentSubsystem.h"
 #include "MoveToLocationOrActor3D.generated.h"
 
 
@@ -19,8 +19,8 @@ class UMoveToLocationOrActor3D : public UBlueprintAsyncActionBase, public FTicka
 	GENERATED_BODY()
 
 public:
-	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContext", BlueprintInternalUseOnly = "true"), Category = "Navigation Grid")
-	static UMoveToLocationOrActor3D* MoveToLocationOrActor3D(APawn* WorldContext, FVector Location);
+	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContext", BlueprintInternalUseOnly = "true", AutoCreateRefTerm = "CostProfile"), Category = "Navigation Grid")
+	static UMoveToLocationOrActor3D* MoveToLocationOrActor3D(APawn* WorldContext, FVector Location, AActor* TargetActor, const FNavCostProfile& CostProfile);
 
 	//Should fire every tick right after the move command has been given
 	UPROPERTY(BlueprintReadOnly, Category= "Move to Location or Actor 3D", BlueprintAssignable)
@@ -43,15 +43,35 @@ public:
 	UPROPERTY(BlueprintReadOnly, Category = "Move to Location or Actor 3D")
 	FVector LocationToMoveTo = FVector::Zero();
 
+	//When set the pawn follows this actor instead of moving to LocationToMoveTo
+	UPROPERTY(BlueprintReadOnly, Category = "Move to Location or Actor 3D")
+	TObjectPtr<AActor> ActorToMoveTo = nullptr;
+
+	//Weights of the cost layers of the volume, unweighted by default
+	UPROPERTY(BlueprintReadOnly, Category = "Move to Location or Actor 3D")
+	FNavCostProfile CostProfile;
+
+	//Direction the pawn is currently moving towards, this is a local value and does not show the final location
+	UPROPERTY(BlueprintReadOnly, Category = "Move to Location or Actor 3D")
+	FVector CurrentMoveDirection = FVector::Zero();
+
 
 public:
 	UFUNCTION(BlueprintCallable, Category = "Move to Location or Actor 3D")
 	void CancelMovement();
 
+	//Called by the navigation agent subsystem, fires the pins
+	void OnMoveStateChanged(ENavAgentMoveState State);
+
 	virtual void Tick(float DeltaTime) override;
+	//Only ticks while actually moving, not while the path is still being searched
 	virtual ETickableTickType GetTickableTickType() const override
 	{
-		return ETickableTickType::Always;
+		return ETickableTickType::Conditional;
+	}
+	virtual bool IsTickable() const override
+	{
+		return IsMoving;
 	}
 	virtual TStatId GetStatId() const override
 	{
@@ -76,6 +96,9 @@ private:
 	TObjectPtr<APawn> MovingTarget;
 	UPROPERTY()
 	TObjectPtr<UWorld> World;
+
+	FNavAgentHandle AgentHandle;
+	bool IsMoving = false;
 };
 #pragma endregion
 
@@ -119,11 +142,12 @@ public:
 	 *@param OutputPins				Variable to hold the different output pins
 	 *@param MoveLocation			Variable to hold the location the context object is supposed to be moved to
 	 *@param CurrentMoveDirection	Gives the current direction the context is moving towards, this is a local value and does not show the final location
+	 *@param TargetActor			Optional actor to follow instead of moving to MoveLocation, the path gets updated while the actor moves
 	 */
 	UFUNCTION(BlueprintCallable, meta=(WorldContext = "WorldContext", Latent, LatentInfo = "LatentInfo", 
 		ExpandEnumAsExecs = "InputPins,OutputPins"), Category = "Move to Actor or Location 3D")
 	static void MoveToActorOrLocation3D(APawn* WorldContext, FLatentActionInfo LatentInfo, EMoveInputPins InputPins, 
-		EMoveOutputPins& OutputPins, FVector MoveLocation, FVector& CurrentMoveDirection);
+		EMoveOutputPins& OutputPins, FVector MoveLocation, FVector& CurrentMoveDirection, AActor* TargetActor = nullptr);
 
 	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContext"))
 	static void Stop3DMovement(APawn* WorldContext);
@@ -137,10 +161,15 @@ public:
 
 	FVector MoveLocation = FVector::Zero();
 
+	//Followed instead of MoveLocation when set
+	TWeakObjectPtr<AActor> TargetActor;
+
 public:
 	FVector& CurrentMoveDirection;
 
 	bool IsFirstCall = true;
+	//OnStarted fires once the path is there
+	bool HasStarted = false;
 
 public:
 	FLatentActionInfo LatentActionInfo;
@@ -148,48 +177,32 @@ public:
 	EMoveOutputPins& Output;
 
 	FLatentMoveToActorOrLocation3D(FLatentActionInfo& LatentInfo, EMoveOutputPins& OutputPins, APawn* WorldContext,
-		FVector MoveLocation, FVector& CurrentMoveDirection)
-			: MovementTarget(WorldContext), MoveLocation(MoveLocation), CurrentMoveDirection(CurrentMoveDirection), LatentActionInfo(LatentInfo), Output(OutputPins)
+		FVector MoveLocation, FVector& CurrentMoveDirection, AActor* TargetActor = nullptr)
+			: MovementTarget(WorldContext), MoveLocation(MoveLocation), TargetActor(TargetActor), CurrentMoveDirection(CurrentMoveDirection), LatentActionInfo(LatentInfo), Output(OutputPins)
 	{
 		Output = EMoveOutputPins::OnStarted;
 		IsFirstCall = true;
 		CurrentMoveDirection = FVector::Zero();
-	}
 
-	virtual void UpdateOperation(FLatentResponse& Response) override;
+		AgentSubsystem = UNavigationAgentSubsystem::Get(WorldContext);
+		if (AgentSubsystem.IsValid())
+		{
+			AgentHandle = AgentSubsystem->RegisterLatentAction(WorldContext, this);
+		}
+	}
 
-	void GetNewPath();
+	virtual ~FLatentMoveToActorOrLocation3D() override
+	{
+		//Stale handles are ignored, so this is fine after a cancel already removed the entry
+		if (AgentSubsystem.IsValid()) AgentSubsystem->UnregisterAgent(AgentHandle);
+	}
 
 	/*
-	 *Uses the PathIndex to move to locations. The MoveLocation has no relevance for this
-	 *function because this one uses the path, the GetNewPath() method retrieves the path using
-	 *the move location. Moves the target using control inputs, I bet there are better ways but this works for me
+	 *Requests the path on the first call, after that it only reads the state of the agent from the
+	 *navigation agent subsystem. The subsystem does the actual path following for all agents at once.
 	 *
 	 **/
-	void UpdateMovement();
-
-	void MoveInDirection(FVector Direction);
-
-	bool PathValidationCheck(int Try);
-
-	//Receive the normalised direction to the given target location (Base is MovementTarget->ActorLocation)
-	FVector DirectionToLocation(FVector Location);
-	static FVector DirectionToLocation(FVector StartLocation, FVector Location);
-
-	/**
-	 * Checks 2 positions, the goal position and one position before it.
-	 * With each call the position gets put further and further away until it is the end where it gets reset
-	 * to a couple positions in front of the current location.
-	 *
-	 * Does nothing when to close to the goal.
-	 *
-	 * Runs every couple milliseconds.
-	 *
-	 * @param DeltaTime		Required to increase the timer
-	 */
-	void UpdateDirectPath(float DeltaTime);
-
-	bool HasDirectAccessToLocation(const FVector& Location, bool ShowLines = true) const;
+	virtual void UpdateOperation(FLatentResponse& Response) override;
 
 #if WITH_EDITOR
 	virtual FString GetDescription() const override
@@ -200,30 +213,7 @@ public:
 #endif
 
 protected:
-	TArray<FVector> Path = TArray<FVector>();
-
-	int PathIndex = 0;
-
-	float ClosenessThreshold = 50.f;
-
-
-#pragma region DirectPathLoop
-
-	float Interval = 0.3f;
-	float CurrentInterval = 0.3f;
-	int IndexToCheck = 0;
-
-#pragma endregion
-
+	FNavAgentHandle AgentHandle;
+	TWeakObjectPtr<UNavigationAgentSubsystem> AgentSubsystem;
 };
-#pragma endregion
-
-
-namespace MoveToLocationOrActor3DStatics
-{
-	//This Array will limit the amount of actions to one per object so that the same
-	//Action will not get called on the same target twice.
-	static std::map<APawn*, UMoveToLocationOrActor3D*> CurrentMovingObjects = std::map<APawn*, UMoveToLocationOrActor3D*>();
-
-	static TArray<std::pair<APawn*, FLatentMoveToActorOrLocation3D*>> CurrentMovingPawns;
-}
\ No newline at end of file
+#pragma endregion
\ No newline at end of file
@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavDebugDraw.h"
+
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarDebugLevel(
+	TEXT("NavGrid.DebugLevel"),
+	1,
+	TEXT("Debug drawing of the navigation grid. 0: off, 1: paths and failed moves, 2: + shortcut probes, 3: + grid generation."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarDebugMaxLinesPerFrame(
+	TEXT("NavGrid.DebugMaxLinesPerFrame"),
+	20000,
+	TEXT("Maximum amount of debug lines the navigation grid draws per frame, the rest is dropped."),
+	ECVF_Default);
+
+#if ENABLE_DRAW_DEBUG
+static uint64 LinesFrame = 0;
+static int32 LinesThisFrame = 0;
+#endif
+
+FNavDebugDraw::FNavDebugDraw(const UWorld* World, ENavDebugLevel Level)
+	: World(World)
+{
+#if ENABLE_DRAW_DEBUG
+	Enabled = World && IsInGameThread() && IsEnabled(Level);
+#endif
+}
+
+FNavDebugDraw::~FNavDebugDraw()
+{
+	Flush();
+}
+
+bool FNavDebugDraw::IsEnabled(ENavDebugLevel Level)
+{
+#if ENABLE_DRAW_DEBUG
+	return Level == ENavDebugLevel::None || CVarDebugLevel.GetValueOnGameThread() >= int32(Level);
+#else
+	return false;
+#endif
+}
+
+void FNavDebugDraw::Line(const FVector& Start, const FVector& End, const FColor& Color, float LifeTime, float Thickness)
+{
+#if ENABLE_DRAW_DEBUG
+	if (!Enabled) return;
+
+	if (LinesFrame != GFrameCounter)
+	{
+		LinesFrame = GFrameCounter;
+		LinesThisFrame = 0;
+	}
+	if (LinesThisFrame >= CVarDebugMaxLinesPerFrame.GetValueOnGameThread()) return;
+	LinesThisFrame++;
+
+	Lines.Emplace(Start, End, FLinearColor(Color), LifeTime, Thickness, SDPG_World);
+#endif
+}
+
+void FNavDebugDraw::Box(const FVector& Center, const FVector& Extent, const FColor& Color, float LifeTime, float Thickness)
+{
+#if ENABLE_DRAW_DEBUG
+	if (!Enabled) return;
+
+	//Same 12 edges DrawDebugBox uses
+	const FVector Corners[8] = {
+		Center + FVector(Extent.X, Extent.Y, Extent.Z),
+		Center + FVector(Extent.X, -Extent.Y, Extent.Z),
+		Center + FVector(-Extent.X, -Extent.Y, Extent.Z),
+		Center + FVector(-Extent.X, Extent.Y, Extent.Z),
+		Center + FVector(Extent.X, Extent.Y, -Extent.Z),
+		Center + FVector(Extent.X, -Extent.Y, -Extent.Z),
+		Center + FVector(-Extent.X, -Extent.Y, -Extent.Z),
+		Center + FVector(-Extent.X, Extent.Y, -Extent.Z),
+	};
+	for (int32 i = 0; i < 4; i++)
+	{
+		Line(Corners[i], Corners[(i + 1) % 4], Color, LifeTime, Thickness);
+		Line(Corners[i + 4], Corners[(i + 1) % 4 + 4], Color, LifeTime, Thickness);
+		Line(Corners[i], Corners[i + 4], Color, LifeTime, Thickness);
+	}
+#endif
+}
+
+void FNavDebugDraw::Flush()
+{
+#if ENABLE_DRAW_DEBUG
+	if (Lines.IsEmpty()) return;
+
+	//Lines with a lifetime go to the persistent batcher, like DrawDebugLine does it
+	ULineBatchComponent* LineBatcher = Lines[0].RemainingLifeTime > 0.f ? World->PersistentLineBatcher : World->LineBatcher;
+	if (LineBatcher) LineBatcher->DrawLines(Lines);
+	Lines.Reset();
+#endif
+}
@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/LineBatchComponent.h"
+
+class UWorld;
+
+//NavGrid.DebugLevel, every level also draws everything of the levels below
+enum class ENavDebugLevel : uint8
+{
+	None = 0,		//Always drawn, for explicit requests like ShowGrid
+	Paths = 1,		//Found paths and failed moves
+	Probes = 2,		//Shortcut probes of the agents
+	Grid = 3,		//Blocked nodes and edges while generating the grid
+};
+
+/**
+ * Collects debug lines and hands them to the line batcher of the world in one go when it goes out of scope.
+ * Nothing is collected when NavGrid.DebugLevel is below the level of the batch, and all batches of a frame
+ * together stop at NavGrid.DebugMaxLinesPerFrame. Compiled out together with the engine debug drawing.
+ * Game thread only.
+ */
+class NAVIGATIONGRID_API FNavDebugDraw
+{
+public:
+	FNavDebugDraw(const UWorld* World, ENavDebugLevel Level = ENavDebugLevel::None);
+	~FNavDebugDraw();
+
+	static bool IsEnabled(ENavDebugLevel Level);
+
+	bool IsEnabled() const { return Enabled; }
+	void Line(const FVector& Start, const FVector& End, const FColor& Color, float LifeTime, float Thickness = 0.f);
+	void Box(const FVector& Center, const FVector& Extent, const FColor& Color, float LifeTime, float Thickness = 0.f);
+	void Flush();
+
+private:
+	const UWorld* World = nullptr;
+	bool Enabled = false;
+#if ENABLE_DRAW_DEBUG
+	TArray<FBatchedLine> Lines;
+#endif
+};
@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavPolyline.h"
+
+FNavPolyline::FNavPolyline(const FVector& Start, TArrayView<const FVector> Path)
+{
+	Points.Reserve(Path.Num() + 1);
+	Points.Add(FVector3f(Start));
+	for (const FVector& Point : Path)
+	{
+		//Duplicates would give zero length segments without a direction
+		if (!FVector3f(Point).Equals(Points.Last())) Points.Add(FVector3f(Point));
+	}
+
+	const int32 SegmentCount = Points.Num() - 1;
+	Directions.Reserve(SegmentCount);
+	Lengths.Reserve(SegmentCount);
+	Distances.Reserve(SegmentCount);
+	for (int32 i = 0; i < SegmentCount; i++)
+	{
+		const FVector3f Segment = Points[i + 1] - Points[i];
+		const float Length = Segment.Length();
+		Directions.Add(Segment / Length);
+		Lengths.Add(Length);
+		Distances.Add(TotalLength);
+		TotalLength += Length;
+	}
+}
+
+int32 FNavPolyline::FindSegment(float Distance, int32 HintSegment) const
+{
+	int32 Segment = FMath::Clamp(HintSegment, 0, FMath::Max(NumSegments() - 1, 0));
+	while (Segment + 1 < NumSegments() && Distances[Segment + 1] <= Distance) Segment++;
+	return Segment;
+}
+
+FVector3f FNavPolyline::GetLocationAtDistance(float Distance, int32 HintSegment) const
+{
+	if (NumSegments() == 0) return Points.IsEmpty() ? FVector3f::ZeroVector : Points[0];
+	if (Distance >= TotalLength) return Points.Last();
+
+	const int32 Segment = FindSegment(Distance, HintSegment);
+	return Points[Segment] + Directions[Segment] * FMath::Max(Distance - Distances[Segment], 0.f);
+}
@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Immutable path used by the movement manager. Besides the points it stores the direction, length and the
+ * distance from the start for every segment, so following it only needs a few multiply adds per update.
+ * Polylines are shared between all agents that follow the same route.
+ */
+struct NAVIGATIONGRID_API FNavPolyline
+{
+	//First point is where the path was requested from, the last one is the goal
+	TArray<FVector3f> Points;
+	//Per segment, segment i goes from Points[i] to Points[i + 1]
+	TArray<FVector3f> Directions;
+	TArray<float> Lengths;
+	//Distance from the first point to the start of every segment
+	TArray<float> Distances;
+	float TotalLength = 0.f;
+
+	FNavPolyline() = default;
+	FNavPolyline(const FVector& Start, TArrayView<const FVector> Path);
+
+	int32 NumSegments() const { return Lengths.Num(); }
+
+	//Distance along the segment of the position projected onto it, not clamped
+	float ProjectOntoSegment(int32 Segment, const FVector3f& Position) const
+	{
+		return FVector3f::DotProduct(Position - Points[Segment], Directions[Segment]);
+	}
+
+	//Walks forward from the hint segment, returns the segment containing the distance
+	int32 FindSegment(float Distance, int32 HintSegment = 0) const;
+	FVector3f GetLocationAtDistance(float Distance, int32 HintSegment = 0) const;
+};
+
+typedef TSharedPtr<const FNavPolyline, ESPMode::ThreadSafe> FNavPolylinePtr;
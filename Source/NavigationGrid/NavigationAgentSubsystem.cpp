@@ -0,0 +1,1355 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavigationAgentSubsystem.h"
+
+#include "Algo/BinarySearch.h"
+#include "Async/ParallelFor.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PawnMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "MoveToLocationOrActor3D.h"
+#include "NavDebugDraw.h"
+#include "Tasks/Task.h"
+
+static TAutoConsoleVariable<int32> CVarParallelMovement(
+	TEXT("NavGrid.ParallelMovement"),
+	1,
+	TEXT("Updates the path following of all moving agents in parallel once there are at least NavGrid.ParallelMovementMinAgents agents."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarShortcutProbesPerFrame(
+	TEXT("NavGrid.ShortcutProbesPerFrame"),
+	32,
+	TEXT("Maximum amount of shortcut probes (4 async line traces each) that get submitted per frame, the rest waits for the next frames."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarAvoidance(
+	TEXT("NavGrid.Avoidance"),
+	1,
+	TEXT("Moving agents avoid each other instead of only following their paths."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarAvoidanceRange(
+	TEXT("NavGrid.AvoidanceRange"),
+	400.f,
+	TEXT("Agents closer than this are considered for avoidance, also the cell size of the avoidance hash."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarAvoidanceTimeHorizon(
+	TEXT("NavGrid.AvoidanceTimeHorizon"),
+	1.f,
+	TEXT("Seconds ahead collisions with other agents are avoided."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarAvoidanceMaxNeighbors(
+	TEXT("NavGrid.AvoidanceMaxNeighbors"),
+	10,
+	TEXT("Closest agents taken into account for avoidance."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarCorridorRadius(
+	TEXT("NavGrid.CorridorRadius"),
+	100.f,
+	TEXT("How far agents may leave their path to avoid each other."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarMaxReplansPerFrame(
+	TEXT("NavGrid.MaxReplansPerFrame"),
+	4,
+	TEXT("Maximum amount of agents that replan their path per frame, the rest waits for the next frames."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarReplanBackoff(
+	TEXT("NavGrid.ReplanBackoff"),
+	0.25f,
+	TEXT("Delay before the second replan of an agent in seconds, doubles with every further attempt."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarReplanMaxBackoff(
+	TEXT("NavGrid.ReplanMaxBackoff"),
+	4.f,
+	TEXT("Longest delay between two replans of an agent in seconds."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarMaxReplanAttempts(
+	TEXT("NavGrid.MaxReplanAttempts"),
+	3,
+	TEXT("Replans in a row without a path before the movement fails."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarStuckTime(
+	TEXT("NavGrid.StuckTime"),
+	2.f,
+	TEXT("Seconds without progress along the path before an agent replans."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarRepairRange(
+	TEXT("NavGrid.RepairRange"),
+	2000.f,
+	TEXT("Paths are only repaired locally when the next free waypoint is closer than this, otherwise the whole path is searched again."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarRepairMaxExpansions(
+	TEXT("NavGrid.RepairMaxExpansions"),
+	2048,
+	TEXT("Expanded nodes after which a local path repair on the game thread gives up and the whole path is searched again on the workers."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarPursuitUpdatesPerFrame(
+	TEXT("NavGrid.PursuitUpdatesPerFrame"),
+	8,
+	TEXT("Maximum amount of pursuing agents that update their path to a moved target per frame."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPursuitMaxDetour(
+	TEXT("NavGrid.PursuitMaxDetour"),
+	2.f,
+	TEXT("Extended pursuit paths that are longer than this times the direct distance to the target get searched again completely."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarParallelMovementMinAgents(
+	TEXT("NavGrid.ParallelMovementMinAgents"),
+	64,
+	TEXT("Minimum amount of moving agents before the movement update is split across worker threads."),
+	ECVF_Default);
+
+#pragma region Registry
+FNavAgentRegistry::~FNavAgentRegistry()
+{
+	Empty();
+	for (std::atomic<FAgentSlot*>& Page : Pages)
+	{
+		delete[] Page.exchange(nullptr);
+	}
+}
+
+FNavAgentHandle FNavAgentRegistry::Add(APawn* Pawn)
+{
+	check(IsInGameThread());
+
+	//A pawn only ever has one entry, the caller is supposed to cancel the old movement first
+	if (const int32* ExistingSlot = PawnToSlot.Find(Pawn))
+	{
+		FNavAgentHandle Existing;
+		Existing.Index = *ExistingSlot;
+		Existing.Generation = GetSlot(*ExistingSlot)->Generation.load(std::memory_order_relaxed);
+		Remove(Existing);
+	}
+
+	int32 Index;
+	if (!FreeSlots.IsEmpty())
+	{
+		Index = FreeSlots.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		Index = NumSlots;
+		const int32 PageIndex = Index / SlotsPerPage;
+		if (!ensureMsgf(PageIndex < MaxPages, TEXT("Navigation agent registry is full"))) return FNavAgentHandle();
+
+		if (Pages[PageIndex].load(std::memory_order_relaxed) == nullptr)
+		{
+			Pages[PageIndex].store(new FAgentSlot[SlotsPerPage], std::memory_order_release);
+		}
+		NumSlots++;
+	}
+
+	FAgentSlot* Slot = GetSlot(Index);
+	Slot->Pawn = Pawn;
+	Slot->PawnKey = Pawn;
+	Slot->LatentAction = nullptr;
+	Slot->AsyncAction.Reset();
+	PawnToSlot.Add(Pawn, Index);
+
+	FNavAgentHandle Handle;
+	Handle.Index = Index;
+	Handle.Generation = Slot->Generation.load(std::memory_order_relaxed);
+	return Handle;
+}
+
+void FNavAgentRegistry::Remove(const FNavAgentHandle& Handle)
+{
+	check(IsInGameThread());
+
+	FAgentSlot* Slot = GetSlot(Handle);
+	if (!Slot) return;
+
+	PawnToSlot.Remove(Slot->PawnKey);
+	Slot->Pawn.Reset();
+	Slot->PawnKey = TObjectKey<APawn>();
+	Slot->LatentAction = nullptr;
+	Slot->AsyncAction.Reset();
+	//Invalidates every handle to this slot, workers see this without a lock
+	Slot->Generation.fetch_add(1, std::memory_order_release);
+	FreeSlots.Add(Handle.Index);
+}
+
+void FNavAgentRegistry::Empty()
+{
+	for (const TPair<TObjectKey<APawn>, int32>& Pair : PawnToSlot)
+	{
+		FAgentSlot* Slot = GetSlot(Pair.Value);
+		Slot->Pawn.Reset();
+		Slot->PawnKey = TObjectKey<APawn>();
+		Slot->LatentAction = nullptr;
+		Slot->AsyncAction.Reset();
+		Slot->Generation.fetch_add(1, std::memory_order_release);
+		FreeSlots.Add(Pair.Value);
+	}
+	PawnToSlot.Empty();
+}
+
+FNavAgentHandle FNavAgentRegistry::Find(const APawn* Pawn) const
+{
+	const int32* Index = PawnToSlot.Find(Pawn);
+	if (!Index) return FNavAgentHandle();
+
+	FNavAgentHandle Handle;
+	Handle.Index = *Index;
+	Handle.Generation = GetSlot(*Index)->Generation.load(std::memory_order_relaxed);
+	return Handle;
+}
+
+bool FNavAgentRegistry::IsValid(const FNavAgentHandle& Handle) const
+{
+	const FAgentSlot* Slot = GetSlot(Handle.Index);
+	return Slot && Slot->Generation.load(std::memory_order_acquire) == Handle.Generation;
+}
+
+FNavAgentRegistry::FAgentSlot* FNavAgentRegistry::GetSlot(const FNavAgentHandle& Handle)
+{
+	return IsValid(Handle) ? GetSlot(Handle.Index) : nullptr;
+}
+
+const FNavAgentRegistry::FAgentSlot* FNavAgentRegistry::GetSlot(const FNavAgentHandle& Handle) const
+{
+	return IsValid(Handle) ? GetSlot(Handle.Index) : nullptr;
+}
+
+FNavAgentRegistry::FAgentSlot* FNavAgentRegistry::GetSlot(int32 Index) const
+{
+	if (Index < 0 || Index >= SlotsPerPage * MaxPages) return nullptr;
+
+	FAgentSlot* Page = Pages[Index / SlotsPerPage].load(std::memory_order_acquire);
+	return Page ? &Page[Index % SlotsPerPage] : nullptr;
+}
+#pragma endregion
+
+#pragma region Subsystem
+UNavigationAgentSubsystem* UNavigationAgentSubsystem::Get(const UObject* WorldContext)
+{
+	const UWorld* World = WorldContext ? WorldContext->GetWorld() : nullptr;
+	return World ? World->GetSubsystem<UNavigationAgentSubsystem>() : nullptr;
+}
+
+void UNavigationAgentSubsystem::Deinitialize()
+{
+	//The path tasks access the registry
+	UE::Tasks::Wait(PathTasks);
+	PathTasks.Empty();
+	QueuedPathRequests.Empty();
+	PathResults.Empty();
+	PathRequestVolumes.Empty();
+	QueuedProbes.Empty();
+	SubmittedProbes.Empty();
+	RouteCache.Empty();
+	ReplanQueue.Empty();
+
+	while (!DenseHandles.IsEmpty())
+	{
+		RemoveMovingAgent(DenseHandles.Num() - 1);
+	}
+	Registry.Empty();
+	Super::Deinitialize();
+}
+
+FNavAgentHandle UNavigationAgentSubsystem::RegisterLatentAction(APawn* Pawn, FLatentMoveToActorOrLocation3D* Action)
+{
+	CancelAgent(Pawn);
+
+	const FNavAgentHandle Handle = Registry.Add(Pawn);
+	if (FNavAgentRegistry::FAgentSlot* Slot = Registry.GetSlot(Handle))
+	{
+		Slot->LatentAction = Action;
+	}
+	return Handle;
+}
+
+FNavAgentHandle UNavigationAgentSubsystem::RegisterAsyncAction(APawn* Pawn, UMoveToLocationOrActor3D* Action)
+{
+	CancelAgent(Pawn);
+
+	const FNavAgentHandle Handle = Registry.Add(Pawn);
+	if (FNavAgentRegistry::FAgentSlot* Slot = Registry.GetSlot(Handle))
+	{
+		Slot->AsyncAction = Action;
+	}
+	return Handle;
+}
+
+void UNavigationAgentSubsystem::UnregisterAgent(const FNavAgentHandle& Handle)
+{
+	const int32 DenseIndex = GetDenseIndex(Handle);
+	if (DenseIndex != INDEX_NONE) RemoveMovingAgent(DenseIndex);
+
+	Registry.Remove(Handle);
+}
+
+void UNavigationAgentSubsystem::CancelAgent(const APawn* Pawn)
+{
+	const FNavAgentHandle Handle = Registry.Find(Pawn);
+	const FNavAgentRegistry::FAgentSlot* Slot = Registry.GetSlot(Handle);
+	if (!Slot) return;
+
+	FLatentMoveToActorOrLocation3D* LatentAction = Slot->LatentAction;
+	UMoveToLocationOrActor3D* AsyncAction = Slot->AsyncAction.Get();
+	UnregisterAgent(Handle);
+
+	//The latent action finishes itself during its next update
+	if (LatentAction) LatentAction->Output = EMoveOutputPins::OnCanceled;
+	if (AsyncAction) AsyncAction->CancelMovement();
+}
+
+FLatentMoveToActorOrLocation3D* UNavigationAgentSubsystem::GetLatentAction(const FNavAgentHandle& Handle) const
+{
+	const FNavAgentRegistry::FAgentSlot* Slot = Registry.GetSlot(Handle);
+	return Slot ? Slot->LatentAction : nullptr;
+}
+
+UMoveToLocationOrActor3D* UNavigationAgentSubsystem::GetAsyncAction(const FNavAgentHandle& Handle) const
+{
+	const FNavAgentRegistry::FAgentSlot* Slot = Registry.GetSlot(Handle);
+	return Slot ? Slot->AsyncAction.Get() : nullptr;
+}
+#pragma endregion
+
+#pragma region Movement
+void UNavigationAgentSubsystem::RequestMove(const FNavAgentHandle& Handle, const FVector& Location, const FNavCostProfile& CostProfile)
+{
+	FNavAgentRegistry::FAgentSlot* Slot = Registry.GetSlot(Handle);
+	APawn* Pawn = Slot ? Slot->Pawn.Get() : nullptr;
+	if (!IsValid(Pawn)) return;
+
+	const FVector Start = Pawn->GetActorLocation();
+	const int32 DenseIndex = Slot->DenseIndex != INDEX_NONE ? Slot->DenseIndex : AddMovingAgent(Handle, Pawn);
+	MoveLocations[DenseIndex] = Location;
+	CostProfiles[DenseIndex] = CostProfile;
+	PawnLocations[DenseIndex] = Start;
+	MoveDirections[DenseIndex] = FVector::ZeroVector;
+	MoveStates[DenseIndex] = ENavAgentMoveState::PathPending;
+	PathRequestIds[DenseIndex] = ++NextPathRequestId;
+	NavGrids[DenseIndex] = nullptr;
+	PursuitTargets[DenseIndex] = nullptr;
+	PursuitDirty[DenseIndex] = false;
+	ReplanPending[DenseIndex] = false;
+	ReplanAttempts[DenseIndex] = 0;
+
+	//Traces and finding the volume stay on the game thread, only the search itself runs async.
+	//Weighted profiles always search, a free line can still cross costly cells
+	FHitResult HitResult;
+	if (!CostProfile.IsWeighted()) GetWorld()->LineTraceSingleByChannel(HitResult, Start, Location, ECC_Visibility);
+
+	if (!CostProfile.IsWeighted() && !HitResult.bBlockingHit)
+	{
+		SetPath(DenseIndex, MakeShared<FNavPolyline, ESPMode::ThreadSafe>(Start, MakeArrayView(&Location, 1)));
+		SmoothedPaths[DenseIndex] = true;
+		MoveStates[DenseIndex] = ENavAgentMoveState::Moving;
+		return;
+	}
+
+	AHeightNavigationVolume* NavGrid = AHeightNavigationVolume::EvaluateNavGrid(Pawn, Start, Location);
+	if (!NavGrid)
+	{
+#if WITH_EDITOR
+		GEngine->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
+			TEXT("Positions do not fit into any one Height Navigation Volume."));
+#endif
+		UE_LOG(LogTemp, Error, TEXT("Positions do not fit into any one Height Navigation Volume."));
+		SetPath(DenseIndex, nullptr);
+		MoveStates[DenseIndex] = ENavAgentMoveState::Failed;
+		return;
+	}
+
+	//Someone else is already following this route
+	const FRouteKey RouteKey = MakeRouteKey(DenseIndex, NavGrid, Start, Pawn->GetSimpleCollisionRadius());
+	if (const TWeakPtr<const FNavPolyline, ESPMode::ThreadSafe>* CachedRoute = RouteCache.Find(RouteKey))
+	{
+		if (FNavPolylinePtr Route = CachedRoute->Pin())
+		{
+			NavGrids[DenseIndex] = NavGrid;
+			SetPath(DenseIndex, MoveTemp(Route));
+			SmoothedPaths[DenseIndex] = IsSmoothedRoute(DenseIndex, NavGrid);
+			MoveStates[DenseIndex] = ENavAgentMoveState::Moving;
+			return;
+		}
+	}
+
+	LaunchPathRequest(DenseIndex, NavGrid, Start);
+}
+
+void UNavigationAgentSubsystem::RequestPursuit(const FNavAgentHandle& Handle, AActor* Target, const FNavCostProfile& CostProfile)
+{
+	if (!IsValid(Target)) return;
+
+	RequestMove(Handle, Target->GetActorLocation(), CostProfile);
+	const int32 DenseIndex = GetDenseIndex(Handle);
+	if (DenseIndex == INDEX_NONE || MoveStates[DenseIndex] == ENavAgentMoveState::Failed) return;
+
+	PursuitTargets[DenseIndex] = Target;
+	PursuitCells[DenseIndex] = GetPursuitCell(DenseIndex, MoveLocations[DenseIndex]);
+}
+
+void UNavigationAgentSubsystem::LaunchPathRequest(int32 DenseIndex, AHeightNavigationVolume* NavGrid, const FVector& Start)
+{
+	const FNavAgentHandle Handle = DenseHandles[DenseIndex];
+	const uint32 RequestId = ++NextPathRequestId;
+	PathRequestIds[DenseIndex] = RequestId;
+	NavGrids[DenseIndex] = NavGrid;
+
+	const float AgentRadius = DensePawns[DenseIndex]->GetSimpleCollisionRadius();
+
+	FPathRequest& Request = QueuedPathRequests.AddDefaulted_GetRef();
+	Request.Handle = Handle;
+	Request.RequestId = RequestId;
+	Request.NavGrid = NavGrid;
+	Request.RouteKey = MakeRouteKey(DenseIndex, NavGrid, Start, AgentRadius);
+	Request.Start = Start;
+	Request.Location = MoveLocations[DenseIndex];
+	Request.AgentRadius = AgentRadius;
+	Request.CostProfile = CostProfiles[DenseIndex];
+	PathRequestVolumes.Add(NavGrid);
+}
+
+UNavigationAgentSubsystem::FRouteKey UNavigationAgentSubsystem::MakeRouteKey(int32 DenseIndex, const AHeightNavigationVolume* NavGrid, const FVector& Start, float AgentRadius) const
+{
+	FRouteKey RouteKey;
+	RouteKey.NavGrid = NavGrid;
+	RouteKey.Start = NavGrid->GetNodeCoordinatesFromWorld(Start);
+	RouteKey.Goal = NavGrid->GetNodeCoordinatesFromWorld(MoveLocations[DenseIndex]);
+	RouteKey.Clearance = NavGrid->GetRequiredClearance(AgentRadius);
+	//Unweighted profiles all search the same way
+	if (CostProfiles[DenseIndex].IsWeighted()) RouteKey.CostProfile = CostProfiles[DenseIndex];
+	return RouteKey;
+}
+
+bool UNavigationAgentSubsystem::IsSmoothedRoute(int32 DenseIndex, const AHeightNavigationVolume* NavGrid) const
+{
+	if (CostProfiles[DenseIndex].IsWeighted()) return false;
+	return NavGrid->smoothPaths || NavGrid->searchMode == EPathSearchMode::LazyThetaStar;
+}
+
+void UNavigationAgentSubsystem::FlushPathRequests()
+{
+	if (QueuedPathRequests.IsEmpty()) return;
+
+	//One task per volume, GetPaths spreads the requests over the workers and shares the setup between them
+	TMap<AHeightNavigationVolume*, TArray<FPathRequest>> Batches;
+	for (FPathRequest& Request : QueuedPathRequests)
+	{
+		Batches.FindOrAdd(Request.NavGrid).Add(MoveTemp(Request));
+	}
+	QueuedPathRequests.Reset();
+
+	for (TPair<AHeightNavigationVolume*, TArray<FPathRequest>>& Batch : Batches)
+	{
+		PathTasks.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, NavGrid = Batch.Key, Requests = MoveTemp(Batch.Value)]
+		{
+			//Agents that got canceled in the meantime do not need a path anymore
+			TArray<FNavPathQuery> Queries;
+			TArray<int32> QueryRequests;
+			for (int32 i = 0; i < Requests.Num(); i++)
+			{
+				if (!Registry.IsValid(Requests[i].Handle)) continue;
+				FNavPathQuery& Query = Queries.AddDefaulted_GetRef();
+				Query.start = Requests[i].Start;
+				Query.goal = Requests[i].Location;
+				Query.agentRadius = Requests[i].AgentRadius;
+				Query.costProfile = Requests[i].CostProfile;
+				QueryRequests.Add(i);
+			}
+
+			TArray<FNavPathQueryResult> QueryResults;
+			NavGrid->GetPaths(Queries, QueryResults);
+
+			const bool Smoothed = NavGrid->smoothPaths || NavGrid->searchMode == EPathSearchMode::LazyThetaStar;
+			int32 NextQuery = 0;
+			for (int32 i = 0; i < Requests.Num(); i++)
+			{
+				const FPathRequest& Request = Requests[i];
+				FPathResult Result;
+				Result.Handle = Request.Handle;
+				Result.RequestId = Request.RequestId;
+				Result.NavGrid = NavGrid;
+				Result.RouteKey = Request.RouteKey;
+				Result.Smoothed = Smoothed && !Request.CostProfile.IsWeighted();
+
+				if (NextQuery < QueryRequests.Num() && QueryRequests[NextQuery] == i)
+				{
+					const FNavPathQueryResult& QueryResult = QueryResults[NextQuery++];
+					Result.Success = QueryResult.result == Get_Success::Success;
+					Result.Pending = QueryResult.result == Get_Success::Pending;
+					if (Result.Success || Result.Pending) Result.Path = MakeShared<FNavPolyline, ESPMode::ThreadSafe>(Request.Start, QueryResult.path);
+				}
+				PathResults.Enqueue(MoveTemp(Result));
+			}
+		}));
+	}
+}
+
+void UNavigationAgentSubsystem::ProcessPathResults()
+{
+	FPathResult Result;
+	while (PathResults.Dequeue(Result))
+	{
+		PathRequestVolumes.RemoveSingleSwap(Result.NavGrid, EAllowShrinking::No);
+
+		const int32 DenseIndex = GetDenseIndex(Result.Handle);
+		if (DenseIndex == INDEX_NONE || PathRequestIds[DenseIndex] != Result.RequestId) continue;
+
+		//Replans keep following the old path until the new one is there
+		const bool Replanning = MoveStates[DenseIndex] == ENavAgentMoveState::Moving;
+		if (!Replanning && MoveStates[DenseIndex] != ENavAgentMoveState::PathPending) continue;
+		ReplanPending[DenseIndex] = false;
+
+		//Replans count as attempts, so chunks that never load still fail the move eventually
+		if (Result.Pending)
+		{
+			SetPath(DenseIndex, Result.Path);
+			SmoothedPaths[DenseIndex] = false;
+			PendingRoutes[DenseIndex] = true;
+			MoveStates[DenseIndex] = ENavAgentMoveState::Moving;
+			ScheduleReplan(DenseIndex);
+			ReplanTimes[DenseIndex] = FMath::Max(ReplanTimes[DenseIndex], GetWorld()->GetTimeSeconds() + CVarReplanBackoff.GetValueOnGameThread());
+			continue;
+		}
+
+		if (Replanning && !Result.Success)
+		{
+			ScheduleReplan(DenseIndex);
+			continue;
+		}
+
+		SetPath(DenseIndex, Result.Path);
+		SmoothedPaths[DenseIndex] = Result.Smoothed;
+		if (Result.Success)
+		{
+			ReplanAttempts[DenseIndex] = 0;
+			FNavDebugDraw DebugDraw(GetWorld(), ENavDebugLevel::Paths);
+			for (int i = 1; i < Result.Path->Points.Num() - 2; ++i)
+			{
+				DebugDraw.Line(FVector(Result.Path->Points[i]), FVector(Result.Path->Points[i + 1]), FColor::Cyan, 5);
+			}
+			RouteCache.Add(Result.RouteKey, Result.Path);
+			MoveStates[DenseIndex] = ENavAgentMoveState::Moving;
+			continue;
+		}
+
+		MoveStates[DenseIndex] = ENavAgentMoveState::Failed;
+#if WITH_EDITOR
+		GEngine->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
+			TEXT("Move To Actor or Location 3D Failed - No path available!"));
+#endif
+		UE_LOG(LogTemp, Error, TEXT("Move To Actor or Location 3D Failed - No path available!"));
+	}
+
+	PathTasks.RemoveAllSwap([](const UE::Tasks::FTask& Task) { return Task.IsCompleted(); }, EAllowShrinking::No);
+
+	//Routes nobody follows anymore
+	if (RouteCache.Num() > 2 * DenseHandles.Num() + 64)
+	{
+		for (auto It = RouteCache.CreateIterator(); It; ++It)
+		{
+			if (!It.Value().IsValid()) It.RemoveCurrent();
+		}
+	}
+}
+
+void UNavigationAgentSubsystem::NotifyStateChanges()
+{
+	//Notifying can finish the node, which removes the agent from the arrays, so collect everything first
+	TArray<TPair<TWeakObjectPtr<UMoveToLocationOrActor3D>, ENavAgentMoveState>, TInlineAllocator<16>> Changes;
+	for (int32 i = 0; i < DenseHandles.Num(); i++)
+	{
+		if (MoveStates[i] == ReportedStates[i]) continue;
+		ReportedStates[i] = MoveStates[i];
+
+		if (UMoveToLocationOrActor3D* AsyncAction = GetAsyncAction(DenseHandles[i]))
+		{
+			Changes.Emplace(AsyncAction, MoveStates[i]);
+		}
+	}
+
+	for (const TPair<TWeakObjectPtr<UMoveToLocationOrActor3D>, ENavAgentMoveState>& Change : Changes)
+	{
+		if (Change.Key.IsValid()) Change.Key->OnMoveStateChanged(Change.Value);
+	}
+}
+
+ENavAgentMoveState UNavigationAgentSubsystem::GetMoveState(const FNavAgentHandle& Handle) const
+{
+	//Handles become invalid when the agent got canceled
+	if (!Registry.IsValid(Handle)) return ENavAgentMoveState::Canceled;
+
+	const int32 DenseIndex = GetDenseIndex(Handle);
+	return DenseIndex != INDEX_NONE ? MoveStates[DenseIndex] : ENavAgentMoveState::Idle;
+}
+
+FVector UNavigationAgentSubsystem::GetMoveDirection(const FNavAgentHandle& Handle) const
+{
+	const int32 DenseIndex = GetDenseIndex(Handle);
+	return DenseIndex != INDEX_NONE ? MoveDirections[DenseIndex] : FVector::ZeroVector;
+}
+
+int32 UNavigationAgentSubsystem::GetDenseIndex(const FNavAgentHandle& Handle) const
+{
+	const FNavAgentRegistry::FAgentSlot* Slot = Registry.GetSlot(Handle);
+	return Slot ? Slot->DenseIndex : INDEX_NONE;
+}
+
+int32 UNavigationAgentSubsystem::AddMovingAgent(const FNavAgentHandle& Handle, APawn* Pawn)
+{
+	const int32 DenseIndex = DenseHandles.Add(Handle);
+	DensePawns.Add(Pawn);
+	MoveStates.Add(ENavAgentMoveState::Idle);
+	ReportedStates.Add(ENavAgentMoveState::Idle);
+	PathRequestIds.Add(0);
+	MoveLocations.Add(FVector::ZeroVector);
+	PawnLocations.Add(Pawn->GetActorLocation());
+	MoveDirections.Add(FVector::ZeroVector);
+	ClosenessThresholds.Add(50.f);
+	CostProfiles.Add(FNavCostProfile());
+	Paths.Add(nullptr);
+	NavGrids.Add(nullptr);
+	ReplanPending.Add(false);
+	ReplanAttempts.Add(0);
+	ReplanTimes.Add(0.0);
+	StuckTimers.Add(0.f);
+	StuckProgress.Add(0.f);
+	PursuitTargets.Add(nullptr);
+	PursuitCells.Add(FIntVector::ZeroValue);
+	PursuitDirty.Add(false);
+	PathSegments.Add(0);
+	PathProgress.Add(0.f);
+	SmoothedPaths.Add(false);
+	PendingRoutes.Add(false);
+	PathVersions.Add(0);
+	//Random start, so the probes of agents that started together do not line up
+	ShortcutTimers.Add(FMath::FRand() * ShortcutInterval);
+	ShortcutIndices.Add(0);
+	PendingProbes.Add(0);
+
+	Registry.GetSlot(Handle)->DenseIndex = DenseIndex;
+	return DenseIndex;
+}
+
+void UNavigationAgentSubsystem::RemoveMovingAgent(int32 DenseIndex)
+{
+	//The last agent takes the place of the removed one
+	const int32 LastIndex = DenseHandles.Num() - 1;
+	if (DenseIndex != LastIndex)
+	{
+		if (FNavAgentRegistry::FAgentSlot* MovedSlot = Registry.GetSlot(DenseHandles[LastIndex]))
+		{
+			MovedSlot->DenseIndex = DenseIndex;
+		}
+	}
+	if (FNavAgentRegistry::FAgentSlot* Slot = Registry.GetSlot(DenseHandles[DenseIndex]))
+	{
+		Slot->DenseIndex = INDEX_NONE;
+	}
+
+	DenseHandles.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	DensePawns.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	MoveStates.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	ReportedStates.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PathRequestIds.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	MoveLocations.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PawnLocations.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	MoveDirections.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	ClosenessThresholds.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	CostProfiles.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	Paths.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	NavGrids.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	ReplanPending.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	ReplanAttempts.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	ReplanTimes.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	StuckTimers.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	StuckProgress.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PursuitTargets.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PursuitCells.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PursuitDirty.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PathSegments.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PathProgress.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	SmoothedPaths.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PendingRoutes.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PathVersions.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	ShortcutTimers.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	ShortcutIndices.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PendingProbes.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+}
+
+void UNavigationAgentSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	//Requests made since the last update, all the ones of this update get flushed at the end of it
+	FlushPathRequests();
+	ProcessPathResults();
+
+	const int32 NumAgents = DenseHandles.Num();
+	if (NumAgents == 0) return;
+
+	//Gather everything that needs the pawns up front, the update itself only touches the arrays
+	PawnVelocities.SetNumUninitialized(NumAgents, EAllowShrinking::No);
+	AgentRadii.SetNumUninitialized(NumAgents, EAllowShrinking::No);
+	MaxSpeeds.SetNumUninitialized(NumAgents, EAllowShrinking::No);
+	for (int32 i = 0; i < NumAgents; i++)
+	{
+		const APawn* Pawn = DensePawns[i];
+		if (!IsValid(Pawn))
+		{
+			if (MoveStates[i] == ENavAgentMoveState::Moving || MoveStates[i] == ENavAgentMoveState::PathPending)
+			{
+				MoveStates[i] = ENavAgentMoveState::Failed;
+			}
+			PawnVelocities[i] = FVector::ZeroVector;
+			AgentRadii[i] = 0.f;
+			MaxSpeeds[i] = 0.f;
+			continue;
+		}
+		PawnLocations[i] = Pawn->GetActorLocation();
+		PawnVelocities[i] = Pawn->GetVelocity();
+		AgentRadii[i] = Pawn->GetSimpleCollisionRadius();
+		const UPawnMovementComponent* Movement = Pawn->GetMovementComponent();
+		MaxSpeeds[i] = Movement ? Movement->GetMaxSpeed() : 0.f;
+	}
+
+	AvoidanceSettings.Enabled = CVarAvoidance.GetValueOnGameThread() != 0;
+	AvoidanceSettings.Range = FMath::Max(CVarAvoidanceRange.GetValueOnGameThread(), 1.f);
+	AvoidanceSettings.TimeHorizon = FMath::Max(CVarAvoidanceTimeHorizon.GetValueOnGameThread(), KINDA_SMALL_NUMBER);
+	AvoidanceSettings.MaxNeighbors = CVarAvoidanceMaxNeighbors.GetValueOnGameThread();
+	AvoidanceSettings.CorridorRadius = CVarCorridorRadius.GetValueOnGameThread();
+	AvoidanceSettings.DeltaTime = DeltaTime;
+	if (AvoidanceSettings.Enabled) BuildAvoidanceHash();
+
+	UpdatePursuitTargets();
+	ConsumeShortcutProbes();
+
+	//Physics queries and path requests stay on the game thread
+	const float StuckTime = CVarStuckTime.GetValueOnGameThread();
+	for (int32 i = 0; i < NumAgents; i++)
+	{
+		if (MoveStates[i] != ENavAgentMoveState::Moving) continue;
+
+		if (!SmoothedPaths[i] && !CostProfiles[i].IsWeighted() && Paths[i].IsValid() && PathSegments[i] + 1 < Paths[i]->NumSegments()) UpdateDirectPath(i, DeltaTime);
+
+		//Stuck, usually blocked by other agents or geometry the grid does not know about
+		if (PathProgress[i] > StuckProgress[i] + 1.f)
+		{
+			StuckProgress[i] = PathProgress[i];
+			StuckTimers[i] = 0.f;
+		}
+		else
+		{
+			StuckTimers[i] += DeltaTime;
+		}
+
+		if (ReplanPending[i]) continue;
+		if (!Paths[i].IsValid() || IsNextWaypointBlocked(i) || StuckTimers[i] > StuckTime)
+		{
+			StuckTimers[i] = 0.f;
+			ScheduleReplan(i);
+		}
+	}
+
+	ProcessReplans();
+	ProcessPursuits();
+	FlushPathRequests();
+
+	SubmitShortcutProbes();
+
+	const bool bParallel = CVarParallelMovement.GetValueOnGameThread() != 0 && NumAgents >= CVarParallelMovementMinAgents.GetValueOnGameThread();
+	ParallelFor(NumAgents, [this](int32 i)
+	{
+		UpdateAgent(i);
+	}, bParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+
+	for (int32 i = 0; i < NumAgents; i++)
+	{
+		if (MoveStates[i] != ENavAgentMoveState::Moving) continue;
+		DensePawns[i]->AddMovementInput(MoveDirections[i]);
+	}
+
+	NotifyStateChanges();
+}
+
+void UNavigationAgentSubsystem::UpdateAgent(int32 DenseIndex)
+{
+	if (MoveStates[DenseIndex] != ENavAgentMoveState::Moving) return;
+
+	const FVector& Location = PawnLocations[DenseIndex];
+	const float Threshold = ClosenessThresholds[DenseIndex];
+	if (FVector::Distance(MoveLocations[DenseIndex], Location) <= Threshold) //Done moving?
+	{
+		MoveStates[DenseIndex] = ENavAgentMoveState::Completed;
+		MoveDirections[DenseIndex] = FVector::ZeroVector;
+		return;
+	}
+
+	const FNavPolyline* Path = Paths[DenseIndex].Get();
+	if (!Path) return;
+	if (Path->NumSegments() == 0)
+	{
+		MoveDirections[DenseIndex] = PendingRoutes[DenseIndex] ? FVector::ZeroVector : (MoveLocations[DenseIndex] - Location).GetSafeNormal();
+		return;
+	}
+
+	//Skip every segment whose end the agent is already close to
+	const FVector3f Location3f(Location);
+	int32 Segment = PathSegments[DenseIndex];
+	float Along = Path->ProjectOntoSegment(Segment, Location3f);
+	while (Segment + 1 < Path->NumSegments() && Along >= Path->Lengths[Segment] - Threshold)
+	{
+		Segment++;
+		Along = Path->ProjectOntoSegment(Segment, Location3f);
+	}
+	PathSegments[DenseIndex] = Segment;
+
+	const float Progress = FMath::Max(PathProgress[DenseIndex], Path->Distances[Segment] + FMath::Clamp(Along, 0.f, Path->Lengths[Segment]));
+	PathProgress[DenseIndex] = Progress;
+
+	//Pending routes end where the checked part ends, the goal is not known to be reachable in a straight line from there
+	if (PendingRoutes[DenseIndex] && Progress + Threshold >= Path->TotalLength)
+	{
+		MoveDirections[DenseIndex] = FVector::ZeroVector;
+		return;
+	}
+
+	//Steer towards a point slightly ahead on the path, at the end straight to the goal, pursued targets move within their cell
+	const FVector3f Target = Progress + Threshold < Path->TotalLength ? Path->GetLocationAtDistance(Progress + Threshold, Segment) : FVector3f(MoveLocations[DenseIndex]);
+	MoveDirections[DenseIndex] = FVector(Target - Location3f).GetSafeNormal();
+
+	if (AvoidanceSettings.Enabled) SolveAvoidance(DenseIndex);
+}
+
+void UNavigationAgentSubsystem::BuildAvoidanceHash()
+{
+	AvoidanceCells.Reset();
+	AvoidanceNext.SetNumUninitialized(DenseHandles.Num(), EAllowShrinking::No);
+
+	//Every agent with a pawn is an obstacle, even when it is not moving itself
+	for (int32 i = 0; i < DenseHandles.Num(); i++)
+	{
+		AvoidanceNext[i] = INDEX_NONE;
+		if (AgentRadii[i] <= 0.f) continue;
+
+		const FIntVector Cell = FIntVector((PawnLocations[i] / AvoidanceSettings.Range).GridSnap(1.0));
+		int32& Head = AvoidanceCells.FindOrAdd(Cell, INDEX_NONE);
+		AvoidanceNext[i] = Head;
+		Head = i;
+	}
+}
+
+//Reciprocal velocity obstacles (van den Berg et al. 2011) for spheres.
+//Each neighbor adds a half space of allowed velocities, the preferred velocity gets projected onto all of them in turn
+//instead of solving the linear program exactly, which is good enough for a handful of neighbors
+void UNavigationAgentSubsystem::SolveAvoidance(int32 DenseIndex)
+{
+	const float MaxSpeed = MaxSpeeds[DenseIndex];
+	if (MaxSpeed <= 0.f) return;
+
+	const FVector& Location = PawnLocations[DenseIndex];
+	const FVector& CurrentVelocity = PawnVelocities[DenseIndex];
+	const float Radius = AgentRadii[DenseIndex];
+	const float Range = AvoidanceSettings.Range;
+
+	//Closest neighbors, sorted by distance
+	TArray<TPair<double, int32>, TInlineAllocator<16>> Neighbors;
+	const FIntVector Cell = FIntVector((Location / Range).GridSnap(1.0));
+	for (int x = -1; x <= 1; x++)
+	{
+		for (int y = -1; y <= 1; y++)
+		{
+			for (int z = -1; z <= 1; z++)
+			{
+				const int32* Head = AvoidanceCells.Find(Cell + FIntVector(x, y, z));
+				for (int32 Other = Head ? *Head : INDEX_NONE; Other != INDEX_NONE; Other = AvoidanceNext[Other])
+				{
+					if (Other == DenseIndex) continue;
+
+					const double DistanceSq = FVector::DistSquared(Location, PawnLocations[Other]);
+					if (DistanceSq > FMath::Square(Range + AgentRadii[Other])) continue;
+
+					const int32 Insert = Algo::LowerBoundBy(Neighbors, DistanceSq, [](const TPair<double, int32>& Pair) { return Pair.Key; });
+					if (Insert >= AvoidanceSettings.MaxNeighbors) continue;
+					Neighbors.Insert(TPair<double, int32>(DistanceSq, Other), Insert);
+					if (Neighbors.Num() > AvoidanceSettings.MaxNeighbors) Neighbors.Pop(EAllowShrinking::No);
+				}
+			}
+		}
+	}
+
+	FVector Velocity = MoveDirections[DenseIndex] * MaxSpeed;
+	if (!Neighbors.IsEmpty())
+	{
+		const double InvTimeHorizon = 1.0 / AvoidanceSettings.TimeHorizon;
+		const double InvDeltaTime = 1.0 / FMath::Max(AvoidanceSettings.DeltaTime, KINDA_SMALL_NUMBER);
+
+		TArray<TPair<FVector, FVector>, TInlineAllocator<16>> Planes;
+		for (const TPair<double, int32>& Neighbor : Neighbors)
+		{
+			const int32 Other = Neighbor.Value;
+			const FVector RelativePosition = PawnLocations[Other] - Location;
+			const FVector RelativeVelocity = CurrentVelocity - PawnVelocities[Other];
+			const double DistanceSq = Neighbor.Key;
+			const double CombinedRadius = Radius + AgentRadii[Other];
+			const double CombinedRadiusSq = FMath::Square(CombinedRadius);
+
+			FVector Normal;
+			FVector U;
+			if (DistanceSq > CombinedRadiusSq)
+			{
+				//Vector from the center of the cut off sphere to the relative velocity
+				const FVector W = RelativeVelocity - InvTimeHorizon * RelativePosition;
+				const double WLengthSq = W.SizeSquared();
+				const double Dot = W | RelativePosition;
+
+				if (Dot < 0.0 && FMath::Square(Dot) > CombinedRadiusSq * WLengthSq)
+				{
+					//Closest to the cut off sphere
+					const double WLength = FMath::Sqrt(WLengthSq);
+					Normal = W / WLength;
+					U = (CombinedRadius * InvTimeHorizon - WLength) * Normal;
+				}
+				else
+				{
+					//Closest to the side of the cone
+					const double A = DistanceSq;
+					const double B = RelativePosition | RelativeVelocity;
+					const double C = RelativeVelocity.SizeSquared() - (RelativePosition ^ RelativeVelocity).SizeSquared() / (DistanceSq - CombinedRadiusSq);
+					const double T = (B + FMath::Sqrt(FMath::Max(B * B - A * C, 0.0))) / A;
+					const FVector WW = RelativeVelocity - T * RelativePosition;
+					const double WWLength = WW.Size();
+					if (WWLength <= UE_SMALL_NUMBER) continue;
+					Normal = WW / WWLength;
+					U = (CombinedRadius * T - WWLength) * Normal;
+				}
+			}
+			else
+			{
+				//Already overlapping, get apart within this update
+				const FVector W = RelativeVelocity - InvDeltaTime * RelativePosition;
+				const double WLength = W.Size();
+				if (WLength <= UE_SMALL_NUMBER) continue;
+				Normal = W / WLength;
+				U = (CombinedRadius * InvDeltaTime - WLength) * Normal;
+			}
+
+			//Both agents take half of the responsibility
+			Planes.Emplace(CurrentVelocity + 0.5 * U, Normal);
+		}
+
+		for (int Pass = 0; Pass < 2; Pass++)
+		{
+			for (const TPair<FVector, FVector>& Plane : Planes)
+			{
+				const double Distance = (Velocity - Plane.Key) | Plane.Value;
+				if (Distance < 0.0) Velocity -= Distance * Plane.Value;
+			}
+		}
+		Velocity = Velocity.GetClampedToMaxSize(MaxSpeed);
+	}
+
+	ClampToCorridor(DenseIndex, Velocity);
+	MoveDirections[DenseIndex] = Velocity / MaxSpeed;
+}
+
+void UNavigationAgentSubsystem::ClampToCorridor(int32 DenseIndex, FVector& Velocity) const
+{
+	const FNavPolyline* Path = Paths[DenseIndex].Get();
+	if (!Path || Path->NumSegments() == 0 || AvoidanceSettings.CorridorRadius <= 0.f) return;
+
+	const float DeltaTime = AvoidanceSettings.DeltaTime;
+	if (DeltaTime <= 0.f) return;
+
+	//Where the agent ends up after this update, measured against the segment it is on
+	const int32 Segment = PathSegments[DenseIndex];
+	const FVector Predicted = PawnLocations[DenseIndex] + Velocity * DeltaTime;
+	const float Along = FMath::Clamp(Path->ProjectOntoSegment(Segment, FVector3f(Predicted)), 0.f, Path->Lengths[Segment]);
+	const FVector Closest = FVector(Path->Points[Segment] + Path->Directions[Segment] * Along);
+
+	const FVector Offset = Predicted - Closest;
+	const double OffsetLength = Offset.Size();
+	if (OffsetLength <= AvoidanceSettings.CorridorRadius) return;
+
+	const FVector Clamped = Closest + Offset * (AvoidanceSettings.CorridorRadius / OffsetLength);
+	Velocity = ((Clamped - PawnLocations[DenseIndex]) / DeltaTime).GetClampedToMaxSize(MaxSpeeds[DenseIndex]);
+}
+
+void UNavigationAgentSubsystem::ScheduleReplan(int32 DenseIndex)
+{
+	if (ReplanPending[DenseIndex]) return;
+	ReplanPending[DenseIndex] = true;
+
+	const uint8 Attempts = ReplanAttempts[DenseIndex];
+	const float Delay = Attempts == 0 ? 0.f
+		: FMath::Min(CVarReplanBackoff.GetValueOnGameThread() * float(1 << FMath::Min<int32>(Attempts - 1, 16)), CVarReplanMaxBackoff.GetValueOnGameThread());
+	ReplanTimes[DenseIndex] = GetWorld()->GetTimeSeconds() + Delay;
+	ReplanQueue.Add(DenseHandles[DenseIndex]);
+}
+
+void UNavigationAgentSubsystem::ProcessReplans()
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+	const int32 MaxAttempts = CVarMaxReplanAttempts.GetValueOnGameThread();
+	int32 Budget = CVarMaxReplansPerFrame.GetValueOnGameThread();
+
+	for (int32 QueueIndex = 0; QueueIndex < ReplanQueue.Num() && Budget > 0;)
+	{
+		const int32 DenseIndex = GetDenseIndex(ReplanQueue[QueueIndex]);
+		if (DenseIndex == INDEX_NONE || !ReplanPending[DenseIndex] || MoveStates[DenseIndex] != ENavAgentMoveState::Moving)
+		{
+			ReplanQueue.RemoveAt(QueueIndex, 1, EAllowShrinking::No);
+			continue;
+		}
+		if (Now < ReplanTimes[DenseIndex])
+		{
+			QueueIndex++;
+			continue;
+		}
+		ReplanQueue.RemoveAt(QueueIndex, 1, EAllowShrinking::No);
+		Budget--;
+
+		if (++ReplanAttempts[DenseIndex] > MaxAttempts)
+		{
+			FailPath(DenseIndex);
+			continue;
+		}
+
+		//Cheap local repair first, the full search only when that does not work
+		if (RepairPath(DenseIndex))
+		{
+			ReplanPending[DenseIndex] = false;
+			ReplanAttempts[DenseIndex] = 0;
+			continue;
+		}
+
+		const FVector& Location = PawnLocations[DenseIndex];
+		AHeightNavigationVolume* NavGrid = AHeightNavigationVolume::EvaluateNavGrid(DensePawns[DenseIndex], Location, MoveLocations[DenseIndex]);
+		if (!NavGrid)
+		{
+			ReplanPending[DenseIndex] = false;
+			ScheduleReplan(DenseIndex);
+			continue;
+		}
+		LaunchPathRequest(DenseIndex, NavGrid, Location);
+	}
+}
+
+bool UNavigationAgentSubsystem::RepairPath(int32 DenseIndex)
+{
+	AHeightNavigationVolume* NavGrid = NavGrids[DenseIndex].Get();
+	const FNavPolyline* Path = Paths[DenseIndex].Get();
+	if (!NavGrid || !Path || NavGrid->resolutionLevels > 1) return false;
+
+	//The last point is the move location, searching towards it is the full query
+	const uint8 Clearance = NavGrid->GetRequiredClearance(AgentRadii[DenseIndex]);
+	int32 Surviving = PathSegments[DenseIndex] + 1;
+	while (Surviving < Path->Points.Num() - 1 && !NavGrid->IsPositionFree(FVector(Path->Points[Surviving]), Clearance)) Surviving++;
+	if (Surviving >= Path->Points.Num() - 1) return false;
+
+	const FVector& Location = PawnLocations[DenseIndex];
+	const FVector Waypoint(Path->Points[Surviving]);
+	if (FVector::Distance(Location, Waypoint) > CVarRepairRange.GetValueOnGameThread()) return false;
+
+	//Runs on the game thread, so the search is bounded. Detours that need more get the full query on the workers
+	TArray<FVector> Repaired;
+	if (NavGrid->FindLocalPath(Location, Waypoint, AgentRadii[DenseIndex], FMath::Max(CVarRepairMaxExpansions.GetValueOnGameThread(), 1), Repaired, &CostProfiles[DenseIndex]) != Get_Success::Success) return false;
+
+	Repaired.Reserve(Repaired.Num() + Path->Points.Num() - Surviving - 1);
+	for (int32 i = Surviving + 1; i < Path->Points.Num(); i++) Repaired.Add(FVector(Path->Points[i]));
+
+	const bool Smoothed = SmoothedPaths[DenseIndex];
+	SetPath(DenseIndex, MakeShared<FNavPolyline, ESPMode::ThreadSafe>(Location, Repaired));
+	SmoothedPaths[DenseIndex] = Smoothed;
+	return true;
+}
+
+bool UNavigationAgentSubsystem::IsNextWaypointBlocked(int32 DenseIndex) const
+{
+	//Leaves of the multi resolution grid can be free while the coarse node is not
+	const AHeightNavigationVolume* NavGrid = NavGrids[DenseIndex].Get();
+	if (!NavGrid || NavGrid->resolutionLevels > 1) return false;
+
+	const FNavPolyline* Path = Paths[DenseIndex].Get();
+	const int32 NextPoint = PathSegments[DenseIndex] + 1;
+	if (!Path || NextPoint >= Path->Points.Num() - 1) return false;
+
+	return !NavGrid->IsPositionFree(FVector(Path->Points[NextPoint]), NavGrid->GetRequiredClearance(AgentRadii[DenseIndex]));
+}
+
+void UNavigationAgentSubsystem::FailPath(int32 DenseIndex)
+{
+	MoveStates[DenseIndex] = ENavAgentMoveState::Failed;
+	ReplanPending[DenseIndex] = false;
+#if WITH_EDITOR
+	GEngine->AddOnScreenDebugMessage(INDEX_NONE, 5, FColor::Red,
+		TEXT("Move To Actor or Location 3D Failed - Path went missing during execution!"));
+#endif
+	FNavDebugDraw DebugDraw(GetWorld(), ENavDebugLevel::Paths);
+	DebugDraw.Box(MoveLocations[DenseIndex], FVector(50, 50, 50), FColor::Black, 10, 25);
+	DebugDraw.Box(MoveLocations[DenseIndex], FVector(150, 150, 150), FColor::Black, 10, 25);
+	DebugDraw.Box(MoveLocations[DenseIndex], FVector(300, 300, 300), FColor::Black, 10, 25);
+	UE_LOG(LogTemp, Error, TEXT("Move To Actor or Location 3D Failed - Path went missing during execution!"));
+}
+
+void UNavigationAgentSubsystem::UpdatePursuitTargets()
+{
+	for (int32 i = 0; i < DenseHandles.Num(); i++)
+	{
+		if (PursuitTargets[i].IsExplicitlyNull()) continue;
+		if (MoveStates[i] != ENavAgentMoveState::Moving && MoveStates[i] != ENavAgentMoveState::PathPending) continue;
+
+		const AActor* Target = PursuitTargets[i].Get();
+		if (!IsValid(Target))
+		{
+			MoveStates[i] = ENavAgentMoveState::Failed;
+			UE_LOG(LogTemp, Error, TEXT("Move To Actor or Location 3D Failed - Target actor went missing during execution!"));
+			continue;
+		}
+
+		//The goal always follows the target, the path only once it left its cell
+		MoveLocations[i] = Target->GetActorLocation();
+		const FIntVector Cell = GetPursuitCell(i, MoveLocations[i]);
+		if (Cell != PursuitCells[i])
+		{
+			PursuitCells[i] = Cell;
+			PursuitDirty[i] = true;
+		}
+	}
+}
+
+void UNavigationAgentSubsystem::ProcessPursuits()
+{
+	const int32 NumAgents = DenseHandles.Num();
+	int32 Budget = CVarPursuitUpdatesPerFrame.GetValueOnGameThread();
+	int32 Checked = 0;
+	for (; Checked < NumAgents && Budget > 0; Checked++)
+	{
+		const int32 i = (PursuitCursor + Checked) % NumAgents;
+		//Agents still waiting for a path get updated once it is there
+		if (!PursuitDirty[i] || MoveStates[i] != ENavAgentMoveState::Moving || ReplanPending[i]) continue;
+
+		PursuitDirty[i] = false;
+		Budget--;
+		if (ExtendPursuitPath(i)) continue;
+
+		//Full search towards the new location, the agent keeps following the old path meanwhile
+		AHeightNavigationVolume* NavGrid = AHeightNavigationVolume::EvaluateNavGrid(DensePawns[i], PawnLocations[i], MoveLocations[i]);
+		if (!NavGrid)
+		{
+			ScheduleReplan(i);
+			continue;
+		}
+		ReplanPending[i] = true;
+		LaunchPathRequest(i, NavGrid, PawnLocations[i]);
+	}
+	PursuitCursor = NumAgents > 0 ? (PursuitCursor + Checked) % NumAgents : 0;
+}
+
+bool UNavigationAgentSubsystem::ExtendPursuitPath(int32 DenseIndex)
+{
+	const FVector& Location = PawnLocations[DenseIndex];
+	const FVector& Goal = MoveLocations[DenseIndex];
+
+	FCollisionQueryParams QueryParams(NAME_None, false, DensePawns[DenseIndex]);
+	QueryParams.AddIgnoredActor(PursuitTargets[DenseIndex].Get());
+	FHitResult HitResult;
+	if (!CostProfiles[DenseIndex].IsWeighted()) GetWorld()->LineTraceSingleByChannel(HitResult, Location, Goal, ECC_Visibility, QueryParams);
+	if (!CostProfiles[DenseIndex].IsWeighted() && !HitResult.bBlockingHit)
+	{
+		SetPath(DenseIndex, MakeShared<FNavPolyline, ESPMode::ThreadSafe>(Location, MakeArrayView(&Goal, 1)));
+		SmoothedPaths[DenseIndex] = true;
+		return true;
+	}
+
+	AHeightNavigationVolume* NavGrid = NavGrids[DenseIndex].Get();
+	const FNavPolyline* Path = Paths[DenseIndex].Get();
+	if (!NavGrid || !Path || Path->Points.IsEmpty() || NavGrid->resolutionLevels > 1) return false;
+
+	//The target usually only moved a few cells, so only the piece from the old goal to the new one is searched
+	const FVector OldGoal(Path->Points.Last());
+	if (FVector::Distance(OldGoal, Goal) > CVarRepairRange.GetValueOnGameThread()) return false;
+
+	//Bounded like RepairPath, up to PursuitUpdatesPerFrame of these run on the game thread every frame
+	TArray<FVector> Extension;
+	if (NavGrid->FindLocalPath(OldGoal, Goal, AgentRadii[DenseIndex], FMath::Max(CVarRepairMaxExpansions.GetValueOnGameThread(), 1), Extension, &CostProfiles[DenseIndex]) != Get_Success::Success) return false;
+
+	TArray<FVector> Points;
+	Points.Reserve(Path->Points.Num() - PathSegments[DenseIndex] + Extension.Num());
+	for (int32 i = PathSegments[DenseIndex] + 1; i < Path->Points.Num(); i++) Points.Add(FVector(Path->Points[i]));
+	Points.Append(Extension);
+
+	//Targets that keep circling would make the path longer and longer
+	FNavPolylinePtr Extended = MakeShared<FNavPolyline, ESPMode::ThreadSafe>(Location, Points);
+	if (Extended->TotalLength > CVarPursuitMaxDetour.GetValueOnGameThread() * FVector::Distance(Location, Goal) + NavGrid->distanceBetweenNodes * 4) return false;
+
+	const bool Smoothed = SmoothedPaths[DenseIndex] && NavGrid->smoothPaths;
+	SetPath(DenseIndex, MoveTemp(Extended));
+	SmoothedPaths[DenseIndex] = Smoothed;
+	return true;
+}
+
+FIntVector UNavigationAgentSubsystem::GetPursuitCell(int32 DenseIndex, const FVector& Location) const
+{
+	if (const AHeightNavigationVolume* NavGrid = NavGrids[DenseIndex].Get()) return NavGrid->GetNodeCoordinatesFromWorld(Location);
+
+	//Straight paths have no grid, cells twice the closeness threshold are close enough to that
+	const float CellSize = ClosenessThresholds[DenseIndex] * 2.f;
+	return FIntVector(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize), FMath::FloorToInt(Location.Z / CellSize));
+}
+
+void UNavigationAgentSubsystem::SetPath(int32 DenseIndex, FNavPolylinePtr Path)
+{
+	Paths[DenseIndex] = MoveTemp(Path);
+	PathSegments[DenseIndex] = 0;
+	PathProgress[DenseIndex] = 0.f;
+	PathVersions[DenseIndex]++;
+	PendingRoutes[DenseIndex] = false;
+	ShortcutIndices[DenseIndex] = 0;
+	StuckTimers[DenseIndex] = 0.f;
+	StuckProgress[DenseIndex] = 0.f;
+}
+
+void UNavigationAgentSubsystem::UpdateDirectPath(int32 DenseIndex, float DeltaTime)
+{
+	//Timer
+	ShortcutTimers[DenseIndex] += DeltaTime;
+	if (ShortcutTimers[DenseIndex] < ShortcutInterval) return;
+	ShortcutTimers[DenseIndex] -= ShortcutInterval;
+
+	//Still waiting for the last probes
+	if (PendingProbes[DenseIndex] > 0) return;
+
+	//Do we need to check for a direct path or are we almost at our goal
+	//The agent is moving towards the end of its segment, that point is one after the segment index
+	const int32 PointCount = Paths[DenseIndex]->Points.Num();
+	const int32 NextPoint = PathSegments[DenseIndex] + 1;
+	if (NextPoint + 2 >= PointCount) return;
+
+	//Evaluate the next position to check
+	ShortcutIndices[DenseIndex] += 2;
+	if (ShortcutIndices[DenseIndex] >= PointCount)
+	{
+		ShortcutIndices[DenseIndex] = NextPoint;
+		return;
+	}
+
+	//Check if we have a direct path to the goal location or any previous location
+	QueueShortcutProbe(DenseIndex, INDEX_NONE);
+	QueueShortcutProbe(DenseIndex, ShortcutIndices[DenseIndex]);
+}
+
+void UNavigationAgentSubsystem::QueueShortcutProbe(int32 DenseIndex, int32 TargetIndex)
+{
+	FShortcutProbe& Probe = QueuedProbes.AddDefaulted_GetRef();
+	Probe.Handle = DenseHandles[DenseIndex];
+	Probe.PathVersion = PathVersions[DenseIndex];
+	Probe.TargetIndex = TargetIndex;
+	Probe.Target = TargetIndex == INDEX_NONE ? MoveLocations[DenseIndex] : FVector(Paths[DenseIndex]->Points[TargetIndex]);
+	PendingProbes[DenseIndex]++;
+}
+
+void UNavigationAgentSubsystem::SubmitShortcutProbes()
+{
+	UWorld* World = GetWorld();
+	const int32 Budget = FMath::Max(CVarShortcutProbesPerFrame.GetValueOnGameThread(), 1);
+	int32 Submitted = 0;
+
+	for (; Submitted < QueuedProbes.Num() && Submitted < Budget; Submitted++)
+	{
+		FShortcutProbe& Probe = QueuedProbes[Submitted];
+		const int32 DenseIndex = GetDenseIndex(Probe.Handle);
+		if (DenseIndex == INDEX_NONE) continue;
+
+		//The probe starts from where the pawn is now, not where it was when the probe got queued
+		APawn* Pawn = DensePawns[DenseIndex];
+		if (!IsValid(Pawn) || PathVersions[DenseIndex] != Probe.PathVersion)
+		{
+			PendingProbes[DenseIndex]--;
+			continue;
+		}
+
+		FVector Origin;
+		FVector BoxExtent;
+		Pawn->GetActorBounds(true, Origin, BoxExtent);
+
+		const FVector Location = Pawn->GetActorLocation();
+		const FVector Starts[4] = {
+			Location + (Pawn->GetActorUpVector() * BoxExtent.Z * 1.5f),
+			Location - (Pawn->GetActorUpVector() * BoxExtent.Z * 1.5f),
+			Location - (Pawn->GetActorRightVector() * BoxExtent.X * 1.5f),
+			Location + (Pawn->GetActorRightVector() * BoxExtent.X * 1.5f),
+		};
+		for (int i = 0; i < 4; i++)
+		{
+			Probe.Traces[i] = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Starts[i], Probe.Target, ECC_Visibility);
+		}
+		SubmittedProbes.Add(Probe);
+	}
+
+	QueuedProbes.RemoveAt(0, Submitted, EAllowShrinking::No);
+}
+
+void UNavigationAgentSubsystem::ConsumeShortcutProbes()
+{
+	UWorld* World = GetWorld();
+	FNavDebugDraw DebugDraw(World, ENavDebugLevel::Probes);
+	for (const FShortcutProbe& Probe : SubmittedProbes)
+	{
+		bool Complete = true;
+		bool Blocked = false;
+		for (const FTraceHandle& Trace : Probe.Traces)
+		{
+			FTraceDatum Datum;
+			if (!World->QueryTraceData(Trace, Datum))
+			{
+				Complete = false;
+				continue;
+			}
+
+			const bool BlockingHit = Datum.OutHits.ContainsByPredicate([](const FHitResult& Hit) { return Hit.bBlockingHit; });
+			Blocked |= BlockingHit;
+			DebugDraw.Line(Datum.Start, Datum.End, BlockingHit ? FColor::Red : FColor::Green, ShortcutInterval);
+		}
+
+		const int32 DenseIndex = GetDenseIndex(Probe.Handle);
+		if (DenseIndex == INDEX_NONE) continue;
+		PendingProbes[DenseIndex]--;
+
+		if (!Complete || Blocked) continue;
+		if (MoveStates[DenseIndex] != ENavAgentMoveState::Moving || PathVersions[DenseIndex] != Probe.PathVersion) continue;
+
+		//Paths are shared, so the shortcut becomes a new path starting at the agent
+		const FVector& Location = PawnLocations[DenseIndex];
+		if (Probe.TargetIndex == INDEX_NONE)
+		{
+			SetPath(DenseIndex, MakeShared<FNavPolyline, ESPMode::ThreadSafe>(Location, MakeArrayView(&MoveLocations[DenseIndex], 1)));
+		}
+		else if (Probe.TargetIndex > PathSegments[DenseIndex] + 1)
+		{
+			TArray<FVector> Remaining;
+			const TArray<FVector3f>& Points = Paths[DenseIndex]->Points;
+			Remaining.Reserve(Points.Num() - Probe.TargetIndex);
+			for (int32 i = Probe.TargetIndex; i < Points.Num(); i++) Remaining.Add(FVector(Points[i]));
+			const bool PendingRoute = PendingRoutes[DenseIndex];
+			SetPath(DenseIndex, MakeShared<FNavPolyline, ESPMode::ThreadSafe>(Location, Remaining));
+			PendingRoutes[DenseIndex] = PendingRoute;
+		}
+	}
+	SubmittedProbes.Reset();
+}
+#pragma endregion
@@ -0,0 +1,365 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+#include "Containers/Queue.h"
+#include "HeightNavigation/HeightNavigationVolume.h"
+#include "NavPolyline.h"
+#include "WorldCollision.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tasks/Task.h"
+#include "UObject/ObjectKey.h"
+#include "NavigationAgentSubsystem.generated.h"
+
+class APawn;
+class FLatentMoveToActorOrLocation3D;
+class UMoveToLocationOrActor3D;
+
+/**
+ * Refers to one registered moving agent. The generation makes sure a handle of an agent that already finished
+ * can never point to a newer agent that reused the same slot.
+ */
+USTRUCT(BlueprintType)
+struct FNavAgentHandle
+{
+	GENERATED_BODY()
+
+	int32 Index = INDEX_NONE;
+	uint32 Generation = 0;
+
+	bool IsSet() const { return Index != INDEX_NONE; }
+
+	void Reset()
+	{
+		Index = INDEX_NONE;
+		Generation = 0;
+	}
+
+	bool operator==(const FNavAgentHandle& Other) const
+	{
+		return Index == Other.Index && Generation == Other.Generation;
+	}
+};
+
+UENUM(BlueprintType)
+enum class ENavAgentMoveState : uint8
+{
+	Idle,			//Registered but no movement started
+	PathPending,	//Waiting for the path request to finish
+	Moving,
+	Completed,
+	Failed,
+	Canceled,
+};
+
+/**
+ * Slot storage for the agent registry. Slots live in fixed size pages that never move once allocated,
+ * so handles can be validated from any thread without a lock.
+ * Registering and unregistering is only allowed on the game thread.
+ */
+class NAVIGATIONGRID_API FNavAgentRegistry
+{
+public:
+	struct FAgentSlot
+	{
+		//Incremented every time the slot gets freed
+		std::atomic<uint32> Generation{ 1 };
+		TWeakObjectPtr<APawn> Pawn;
+		//Key of PawnToSlot, still valid when the pawn already got garbage collected
+		TObjectKey<APawn> PawnKey;
+		FLatentMoveToActorOrLocation3D* LatentAction = nullptr;
+		TWeakObjectPtr<UMoveToLocationOrActor3D> AsyncAction;
+		//Index into the movement arrays of the subsystem, INDEX_NONE while not moving
+		int32 DenseIndex = INDEX_NONE;
+	};
+
+	static constexpr int32 SlotsPerPage = 1024;
+	static constexpr int32 MaxPages = 64;
+
+	FNavAgentRegistry() = default;
+	~FNavAgentRegistry();
+
+	FNavAgentRegistry(const FNavAgentRegistry&) = delete;
+	FNavAgentRegistry& operator=(const FNavAgentRegistry&) = delete;
+
+	FNavAgentHandle Add(APawn* Pawn);
+	void Remove(const FNavAgentHandle& Handle);
+	void Empty();
+
+	FNavAgentHandle Find(const APawn* Pawn) const;
+
+	//Lock free, safe to call from worker threads
+	bool IsValid(const FNavAgentHandle& Handle) const;
+
+	//Game thread only, nullptr for invalid handles
+	FAgentSlot* GetSlot(const FNavAgentHandle& Handle);
+	const FAgentSlot* GetSlot(const FNavAgentHandle& Handle) const;
+
+	int32 Num() const { return PawnToSlot.Num(); }
+
+private:
+	FAgentSlot* GetSlot(int32 Index) const;
+
+	std::atomic<FAgentSlot*> Pages[MaxPages] = {};
+	int32 NumSlots = 0;
+	TArray<int32> FreeSlots;
+	TMap<TObjectKey<APawn>, int32> PawnToSlot;
+};
+
+/**
+ * One registry per world for every pawn moved by the 3D movement nodes, and the movement manager that moves them.
+ * A pawn can only have one active movement, looking it up, canceling and finishing are all constant time.
+ *
+ * The path following state of every moving agent is kept in contiguous arrays (indexed by the dense index of the
+ * agent) and all agents are updated in one pass per frame. The movement nodes only hold a handle and read the
+ * state back to fire their pins.
+ *
+ * Paths are searched on worker threads, the results are picked up at the start of the next update.
+ */
+UCLASS()
+class NAVIGATIONGRID_API UNavigationAgentSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	static UNavigationAgentSubsystem* Get(const UObject* WorldContext);
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override
+	{
+		RETURN_QUICK_DECLARE_CYCLE_STAT(UNavigationAgentSubsystem, STATGROUP_Tickables);
+	}
+
+	FNavAgentHandle RegisterLatentAction(APawn* Pawn, FLatentMoveToActorOrLocation3D* Action);
+	FNavAgentHandle RegisterAsyncAction(APawn* Pawn, UMoveToLocationOrActor3D* Action);
+	void UnregisterAgent(const FNavAgentHandle& Handle);
+
+	//Cancels whatever movement the pawn is currently doing
+	void CancelAgent(const APawn* Pawn);
+
+	FNavAgentHandle FindAgent(const APawn* Pawn) const { return Registry.Find(Pawn); }
+	bool IsAgentValid(const FNavAgentHandle& Handle) const { return Registry.IsValid(Handle); }
+	int32 GetNumAgents() const { return Registry.Num(); }
+	int32 GetNumMovingAgents() const { return DenseHandles.Num(); }
+
+	FLatentMoveToActorOrLocation3D* GetLatentAction(const FNavAgentHandle& Handle) const;
+	UMoveToLocationOrActor3D* GetAsyncAction(const FNavAgentHandle& Handle) const;
+
+	//Movement
+	//Requests a path to the location, the agent starts moving along it once the path is there.
+	//A new request replaces the previous one. Weighted cost profiles avoid the costly cells of the volume, replans and
+	//repairs keep using the profile of the request
+	void RequestMove(const FNavAgentHandle& Handle, const FVector& Location, const FNavCostProfile& CostProfile = FNavCostProfile());
+	//Like RequestMove, but follows the target actor. The path only gets updated once the target moved to another cell
+	void RequestPursuit(const FNavAgentHandle& Handle, AActor* Target, const FNavCostProfile& CostProfile = FNavCostProfile());
+	ENavAgentMoveState GetMoveState(const FNavAgentHandle& Handle) const;
+	//Direction the agent is currently moving towards, shorter than 1 while avoidance slows the agent down
+	FVector GetMoveDirection(const FNavAgentHandle& Handle) const;
+
+private:
+	int32 GetDenseIndex(const FNavAgentHandle& Handle) const;
+	int32 AddMovingAgent(const FNavAgentHandle& Handle, APawn* Pawn);
+	void RemoveMovingAgent(int32 DenseIndex);
+
+	//Queues the path request, the next FlushPathRequests searches it on a worker thread and
+	//the result is picked up by ProcessPathResults
+	void LaunchPathRequest(int32 DenseIndex, AHeightNavigationVolume* NavGrid, const FVector& Start);
+	//Weighted searches skip smoothing, see AHeightNavigationVolume::FindPath
+	bool IsSmoothedRoute(int32 DenseIndex, const AHeightNavigationVolume* NavGrid) const;
+	//Launches the queued requests as one batch per volume, see AHeightNavigationVolume::GetPaths
+	void FlushPathRequests();
+	void ProcessPathResults();
+	//Tells the async movement nodes about their state changes, they do not poll
+	void NotifyStateChanges();
+
+	//Replanning, replaces the old PathValidationCheck
+	//Queues a replan, the delay doubles with every attempt that did not find a path
+	void ScheduleReplan(int32 DenseIndex);
+	//Runs the replans that are due, at most NavGrid.MaxReplansPerFrame per update
+	void ProcessReplans();
+	//Searches only from the agent to the next waypoint that is still free and keeps the rest of the path
+	bool RepairPath(int32 DenseIndex);
+	bool IsNextWaypointBlocked(int32 DenseIndex) const;
+	void FailPath(int32 DenseIndex);
+
+	//Pursuit
+	//Moves the goals along with the targets and marks agents whose target changed cells
+	void UpdatePursuitTargets();
+	//Updates the paths of marked agents, at most NavGrid.PursuitUpdatesPerFrame per update
+	void ProcessPursuits();
+	//Searches only from the end of the current path to the new target location and appends that
+	bool ExtendPursuitPath(int32 DenseIndex);
+	FIntVector GetPursuitCell(int32 DenseIndex, const FVector& Location) const;
+	void SetPath(int32 DenseIndex, FNavPolylinePtr Path);
+
+	//Everything that only reads and writes the arrays of one agent, safe to run in parallel
+	void UpdateAgent(int32 DenseIndex);
+
+	//Local avoidance
+	void BuildAvoidanceHash();
+	//ORCA style, turns the direction along the path into one that avoids nearby agents and stays inside the corridor
+	void SolveAvoidance(int32 DenseIndex);
+	//Limits the velocity so the agent stays within NavGrid.CorridorRadius of its path
+	void ClampToCorridor(int32 DenseIndex, FVector& Velocity) const;
+	//Looks for shortcuts with physics traces, only for paths that were not smoothed by the nav grid.
+	//Only queues the probes, they are traced in batches and the results get applied during the next update
+	void UpdateDirectPath(int32 DenseIndex, float DeltaTime);
+	//TargetIndex is the point of the path to check, INDEX_NONE checks the move location
+	void QueueShortcutProbe(int32 DenseIndex, int32 TargetIndex);
+	//Starts async traces for the queued probes, limited by NavGrid.ShortcutProbesPerFrame
+	void SubmitShortcutProbes();
+	void ConsumeShortcutProbes();
+
+	FNavAgentRegistry Registry;
+
+	//Agents that request a path between the same cells of the same volume with the same cost profile share one polyline
+	struct FRouteKey
+	{
+		const AHeightNavigationVolume* NavGrid = nullptr;
+		FIntVector Start = FIntVector::ZeroValue;
+		FIntVector Goal = FIntVector::ZeroValue;
+		uint8 Clearance = 0;
+		FNavCostProfile CostProfile;
+
+		bool operator==(const FRouteKey& Other) const
+		{
+			return NavGrid == Other.NavGrid && Start == Other.Start && Goal == Other.Goal && Clearance == Other.Clearance && CostProfile == Other.CostProfile;
+		}
+
+		friend uint32 GetTypeHash(const FRouteKey& Key)
+		{
+			const uint32 RouteHash = HashCombine(HashCombine(GetTypeHash(Key.NavGrid), GetTypeHash(Key.Start)), HashCombine(GetTypeHash(Key.Goal), Key.Clearance));
+			return HashCombine(RouteHash, GetTypeHash(Key.CostProfile));
+		}
+	};
+	FRouteKey MakeRouteKey(int32 DenseIndex, const AHeightNavigationVolume* NavGrid, const FVector& Start, float AgentRadius) const;
+
+	struct FPathResult
+	{
+		FNavAgentHandle Handle;
+		uint32 RequestId = 0;
+		AHeightNavigationVolume* NavGrid = nullptr;
+		FRouteKey RouteKey;
+		FNavPolylinePtr Path;
+		bool Success = false;
+		//Coarse route of a streamed grid, followed until the chunks are loaded
+		bool Pending = false;
+		bool Smoothed = false;
+	};
+
+	struct FPathRequest
+	{
+		FNavAgentHandle Handle;
+		uint32 RequestId = 0;
+		AHeightNavigationVolume* NavGrid = nullptr;
+		FRouteKey RouteKey;
+		FVector Start = FVector::ZeroVector;
+		FVector Location = FVector::ZeroVector;
+		float AgentRadius = 0.f;
+		FNavCostProfile CostProfile;
+	};
+
+	//Requests of the current frame, the agents of a squad that get their orders at once share one batch
+	TArray<FPathRequest> QueuedPathRequests;
+	//Filled by the path tasks, emptied by the game thread
+	TQueue<FPathResult, EQueueMode::Mpsc> PathResults;
+	TArray<UE::Tasks::FTask> PathTasks;
+	//Keeps volumes with running searches alive, one entry per request
+	UPROPERTY()
+	TArray<TObjectPtr<AHeightNavigationVolume>> PathRequestVolumes;
+	uint32 NextPathRequestId = 0;
+	//Polylines only live as long as an agent follows them
+	TMap<FRouteKey, TWeakPtr<const FNavPolyline, ESPMode::ThreadSafe>> RouteCache;
+
+	struct FShortcutProbe
+	{
+		FNavAgentHandle Handle;
+		//Probes of a replaced path are ignored
+		uint32 PathVersion = 0;
+		int32 TargetIndex = INDEX_NONE;
+		FVector Target = FVector::ZeroVector;
+		//Top, bottom, left and right of the pawn
+		FTraceHandle Traces[4];
+	};
+
+	TArray<FShortcutProbe> QueuedProbes;
+	//Submitted during the last update, the trace results are ready during the next one
+	TArray<FShortcutProbe> SubmittedProbes;
+
+#pragma region MovementState
+	TArray<FNavAgentHandle> DenseHandles;
+	UPROPERTY()
+	TArray<TObjectPtr<APawn>> DensePawns;
+	TArray<ENavAgentMoveState> MoveStates;
+	//Last state the async movement node got told about
+	TArray<ENavAgentMoveState> ReportedStates;
+	//Results of older requests are ignored
+	TArray<uint32> PathRequestIds;
+	TArray<FVector> MoveLocations;
+	//Gathered once at the start of every update
+	TArray<FVector> PawnLocations;
+	TArray<FVector> MoveDirections;
+	TArray<float> ClosenessThresholds;
+	//Of the last RequestMove, also used by replans, repairs and pursuit updates
+	TArray<FNavCostProfile> CostProfiles;
+
+	TArray<FNavPolylinePtr> Paths;
+	//Segment of the path the agent is on and the distance along the path it already covered
+	TArray<int32> PathSegments;
+	TArray<float> PathProgress;
+	TArray<bool> SmoothedPaths;
+	//Paths of Pending results only lead as far as the resident chunks allow, the agent waits at their end for the full path
+	TArray<bool> PendingRoutes;
+	//Incremented every time the path gets replaced
+	TArray<uint32> PathVersions;
+
+	//Local avoidance, rebuilt every update
+	struct FAvoidanceSettings
+	{
+		bool Enabled = true;
+		float Range = 400.f;
+		float TimeHorizon = 1.f;
+		int32 MaxNeighbors = 10;
+		float CorridorRadius = 100.f;
+		float DeltaTime = 0.f;
+	};
+	FAvoidanceSettings AvoidanceSettings;
+	TArray<FVector> PawnVelocities;
+	TArray<float> AgentRadii;
+	TArray<float> MaxSpeeds;
+	//Spatial hash with cells of the avoidance range, every cell is a linked list through AvoidanceNext
+	TMap<FIntVector, int32> AvoidanceCells;
+	TArray<int32> AvoidanceNext;
+
+	//Replanning
+	TArray<FNavAgentHandle> ReplanQueue;
+	//Volume the path was searched in, nullptr for straight paths
+	TArray<TWeakObjectPtr<AHeightNavigationVolume>> NavGrids;
+	//From being scheduled until the new path is there
+	TArray<bool> ReplanPending;
+	//Attempts since the last path that was found
+	TArray<uint8> ReplanAttempts;
+	TArray<double> ReplanTimes;
+	//Time without progress along the path
+	TArray<float> StuckTimers;
+	TArray<float> StuckProgress;
+
+	//Pursuit, targets are null for regular moves
+	TArray<TWeakObjectPtr<AActor>> PursuitTargets;
+	//Cell of the target the current path leads to
+	TArray<FIntVector> PursuitCells;
+	TArray<bool> PursuitDirty;
+	//Round robin, so every pursuer gets its turn when there are more than the budget
+	int32 PursuitCursor = 0;
+
+	//Direct path loop
+	TArray<float> ShortcutTimers;
+	TArray<int32> ShortcutIndices;
+	//Probes queued or in flight, an agent only queues new ones once all of them came back
+	TArray<uint8> PendingProbes;
+	float ShortcutInterval = 0.3f;
+#pragma endregion
+};
@@ -13,12 +13,17 @@ public class NavigationGrid : ModuleRules
 			"Core", 
 			"CoreUObject", 
 			"Engine", 
-			"InputCore",
-			"UnrealEd"
+			"InputCore"
 		});
 
 		PrivateDependencyModuleNames.AddRange(new string[] {  });
 
+		// Only for GEditor in editor builds, the runtime module does not need it
+		if (Target.bBuildEditor)
+		{
+			PrivateDependencyModuleNames.Add("UnrealEd");
+		}
+
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
 		